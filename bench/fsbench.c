@@ -0,0 +1,339 @@
+#define _GNU_SOURCE  // O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+
+/*
+    File system benchmark for bench/run.sh, one JSON object per line.
+    Meant for a mounted osfs (lab4), but runs on any directory so the
+    numbers can be put next to tmpfs or ext4.
+
+    Data workloads on dir/fsbench.data, for every I/O size:
+    seq_write   file_bytes written front to back, then fsync
+    seq_read    the same file read front to back
+    rand_read   file_bytes / io_bytes reads at shuffled aligned offsets
+    rand_write  the same with writes, then fsync
+    The file is truncated before every seq_write. Before each read
+    workload the file is fsynced and its pages dropped with
+    POSIX_FADV_DONTNEED, so reads go through the file system rather than
+    pages left behind by the writes. -D opens the file with O_DIRECT.
+
+    Metadata workload, files empty files in dir:
+    create      open(O_CREAT | O_EXCL) and close
+    stat        stat of every file (a lookup each)
+    unlink      only if the file system supports it; osfs has no unlink,
+                so there the files stay and every run needs new inodes
+
+    When dir is on osfs, each record also has "osfs": the change of the
+    counters in /sys/fs/osfs/<major>:<minor>/stats during the workload.
+
+    ./fsbench -d dir [-s file_bytes] [-b 4096,65536] [-n files] [-r reps] [-D] [-w workloads]
+    -s size of the data file, K/M/G suffixes allowed (default 16M)
+    -b I/O sizes (default 4096,65536)
+    -n files of the metadata workload (default 1000)
+    -r runs of every workload (default 3)
+    -w any of data,meta (default data,meta)
+*/
+
+#define MAX_LIST 32
+#define MAX_STATS 64
+#define NAME_SIZE 64
+
+typedef struct {
+    int count;
+    char names[MAX_STATS][NAME_SIZE];
+    unsigned long long values[MAX_STATS];
+} fs_stats_t;
+
+static const char *dir;
+static char stats_path[128];    // empty when dir is not on osfs
+static bool direct;
+static unsigned long fs_type;
+
+static inline long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// "16M" -> 16777216
+static long long parse_size(const char *s){
+    char *end;
+    long long n = strtoll(s, &end, 10);
+
+    switch (*end) {
+    case 'G': case 'g': n <<= 10;  // fall through
+    case 'M': case 'm': n <<= 10;  // fall through
+    case 'K': case 'k': n <<= 10;
+    }
+    return n;
+}
+
+// "4096,64K" -> {4096, 65536}, returns how many
+static int parse_size_list(char *s, long long *out){
+    int n = 0;
+    for (char *tok = strtok(s, ","); tok && n < MAX_LIST; tok = strtok(NULL, ","))
+        out[n++] = parse_size(tok);
+    return n;
+}
+
+static void stats_read(fs_stats_t *stats){
+    char name[NAME_SIZE];
+    unsigned long long value;
+
+    stats->count = 0;
+    if (!stats_path[0])
+        return;
+    FILE *f = fopen(stats_path, "r");
+    if (f == NULL)
+        return;
+    while (stats->count < MAX_STATS && fscanf(f, "%63s %llu", name, &value) == 2) {
+        // A ratio, its change means nothing
+        if (strcmp(name, "lookup_hit_percent") == 0)
+            continue;
+        strcpy(stats->names[stats->count], name);
+        stats->values[stats->count++] = value;
+    }
+    fclose(f);
+}
+
+/*
+    Start of a record; the caller prints its own fields and ends it with
+    record_end(), which adds the osfs counter deltas.
+*/
+static void record_begin(const char *workload, int rep){
+    printf("{\"suite\":\"osfs\",\"fs_type\":\"0x%lx\",\"workload\":\"%s\",\"rep\":%d",
+           fs_type, workload, rep);
+}
+
+static void record_end(const fs_stats_t *before){
+    fs_stats_t after;
+
+    stats_read(&after);
+    if (after.count > 0) {
+        printf(",\"osfs\":{");
+        for (int i = 0; i < after.count; i++) {
+            long long delta = (long long)after.values[i];
+            if (i < before->count && strcmp(before->names[i], after.names[i]) == 0)
+                delta -= (long long)before->values[i];
+            printf("%s\"%s\":%lld", i ? "," : "", after.names[i], delta);
+        }
+        printf("}");
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+static void data_record(const char *workload, int rep, long long file_bytes, long long io_bytes,
+                        double seconds, const fs_stats_t *before){
+    long long ops = file_bytes / io_bytes;
+
+    record_begin(workload, rep);
+    printf(",\"file_bytes\":%lld,\"io_bytes\":%lld,\"direct\":%s,\"seconds\":%.9f,"
+           "\"mib_per_sec\":%.3f,\"ops_per_sec\":%.1f",
+           file_bytes, io_bytes, direct ? "true" : "false", seconds,
+           seconds > 0 ? file_bytes / seconds / (1 << 20) : 0.0,
+           seconds > 0 ? ops / seconds : 0.0);
+    record_end(before);
+}
+
+static void die(const char *what){
+    perror(what);
+    exit(1);
+}
+
+// Write back and drop the cached pages, so the next read comes from the file system
+static void drop_cache(int fd){
+    if (fsync(fd) < 0)
+        die("fsync");
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static void shuffle(long long *offsets, long long n, long long io_bytes, unsigned int *seed){
+    for (long long i = 0; i < n; i++)
+        offsets[i] = i * io_bytes;
+    for (long long i = n - 1; i > 0; i--) {
+        long long j = rand_r(seed) % (i + 1), t = offsets[i];
+        offsets[i] = offsets[j];
+        offsets[j] = t;
+    }
+}
+
+static void data_workloads(long long file_bytes, long long io_bytes, int rep){
+    char path[4096];
+    fs_stats_t before;
+    long long n = file_bytes / io_bytes;
+    long long *offsets = malloc(n * sizeof(long long));
+    unsigned int seed = rep;
+    void *buf;
+
+    if (offsets == NULL || posix_memalign(&buf, 4096, io_bytes) != 0)
+        die("malloc");
+    memset(buf, 'o', io_bytes);
+    snprintf(path, sizeof(path), "%s/fsbench.data", dir);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | (direct ? O_DIRECT : 0), 0644);
+    if (fd < 0)
+        die(path);
+
+    stats_read(&before);
+    long start = now_ns();
+    for (long long i = 0; i < n; i++)
+        if (pwrite(fd, buf, io_bytes, i * io_bytes) != io_bytes)
+            die("pwrite");
+    if (fsync(fd) < 0)
+        die("fsync");
+    data_record("seq_write", rep, n * io_bytes, io_bytes, (now_ns() - start) / 1e9, &before);
+
+    drop_cache(fd);
+    stats_read(&before);
+    start = now_ns();
+    for (long long i = 0; i < n; i++)
+        if (pread(fd, buf, io_bytes, i * io_bytes) != io_bytes)
+            die("pread");
+    data_record("seq_read", rep, n * io_bytes, io_bytes, (now_ns() - start) / 1e9, &before);
+
+    shuffle(offsets, n, io_bytes, &seed);
+    drop_cache(fd);
+    stats_read(&before);
+    start = now_ns();
+    for (long long i = 0; i < n; i++)
+        if (pread(fd, buf, io_bytes, offsets[i]) != io_bytes)
+            die("pread");
+    data_record("rand_read", rep, n * io_bytes, io_bytes, (now_ns() - start) / 1e9, &before);
+
+    shuffle(offsets, n, io_bytes, &seed);
+    stats_read(&before);
+    start = now_ns();
+    for (long long i = 0; i < n; i++)
+        if (pwrite(fd, buf, io_bytes, offsets[i]) != io_bytes)
+            die("pwrite");
+    if (fsync(fd) < 0)
+        die("fsync");
+    data_record("rand_write", rep, n * io_bytes, io_bytes, (now_ns() - start) / 1e9, &before);
+
+    close(fd);
+    free(buf);
+    free(offsets);
+}
+
+static void meta_record(const char *workload, int rep, int files, double seconds,
+                        const fs_stats_t *before){
+    record_begin(workload, rep);
+    printf(",\"files\":%d,\"seconds\":%.9f,\"ops_per_sec\":%.1f",
+           files, seconds, seconds > 0 ? files / seconds : 0.0);
+    record_end(before);
+}
+
+static void meta_workloads(int files, int rep){
+    char path[4096];
+    fs_stats_t before;
+    struct stat st;
+    long start;
+
+    // The names have to be new on every run: osfs cannot remove them
+    stats_read(&before);
+    start = now_ns();
+    for (int i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/fsbench.%d.%d.%d", dir, (int)getpid(), rep, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0)
+            die(path);
+        close(fd);
+    }
+    meta_record("create", rep, files, (now_ns() - start) / 1e9, &before);
+
+    stats_read(&before);
+    start = now_ns();
+    for (int i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/fsbench.%d.%d.%d", dir, (int)getpid(), rep, i);
+        if (stat(path, &st) < 0)
+            die(path);
+    }
+    meta_record("stat", rep, files, (now_ns() - start) / 1e9, &before);
+
+    stats_read(&before);
+    start = now_ns();
+    for (int i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/fsbench.%d.%d.%d", dir, (int)getpid(), rep, i);
+        if (unlink(path) < 0) {
+            if (i == 0 && (errno == EPERM || errno == ENOSYS || errno == EOPNOTSUPP))
+                return;
+            die(path);
+        }
+    }
+    meta_record("unlink", rep, files, (now_ns() - start) / 1e9, &before);
+}
+
+int main(int argc, char *argv[]){
+    long long file_bytes = 16 << 20, io_sizes[MAX_LIST] = { 4096, 65536 };
+    int nio = 2, files = 1000, reps = 3;
+    bool data = true, meta = true;
+    struct stat st;
+    struct statfs sfs;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:s:b:n:r:Dw:")) != -1) {
+        switch (opt) {
+        case 'd':
+            dir = optarg;
+            break;
+        case 's':
+            file_bytes = parse_size(optarg);
+            break;
+        case 'b':
+            nio = parse_size_list(optarg, io_sizes);
+            break;
+        case 'n':
+            files = atoi(optarg);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'D':
+            direct = true;
+            break;
+        case 'w':
+            data = strstr(optarg, "data") != NULL;
+            meta = strstr(optarg, "meta") != NULL;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s -d dir [-s file_bytes] [-b 4096,65536] [-n files] [-r reps] [-D] "
+                            "[-w data,meta]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (dir == NULL) {
+        fprintf(stderr, "%s: -d dir is required\n", argv[0]);
+        return 1;
+    }
+    if (stat(dir, &st) < 0 || statfs(dir, &sfs) < 0)
+        die(dir);
+    fs_type = (unsigned long)sfs.f_type;
+    snprintf(stats_path, sizeof(stats_path), "/sys/fs/osfs/%u:%u/stats",
+             major(st.st_dev), minor(st.st_dev));
+    if (access(stats_path, R_OK) != 0)
+        stats_path[0] = '\0';
+    if (reps < 1)
+        reps = 1;
+
+    for (int r = 1; r <= reps; r++) {
+        for (int b = 0; data && b < nio; b++) {
+            if (io_sizes[b] < 1 || file_bytes < io_sizes[b]) {
+                fprintf(stderr, "%s: need 0 < io size <= file size\n", argv[0]);
+                return 1;
+            }
+            data_workloads(file_bytes, io_sizes[b], r);
+        }
+        if (meta && files > 0)
+            meta_workloads(files, r);
+    }
+    return 0;
+}
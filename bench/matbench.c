@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "../lab3/common/matmul.h"
+#include "../lab3/common/gemm_simd.h"
+
+/*
+    Matrix multiply benchmark for bench/run.sh, one JSON object per line.
+
+    Square n x n matrices of random ints are multiplied with the lab3
+    engine (matmul.h, kernel from gemm_select(), so GEMM_ISA works here
+    too) for every size and thread count. Each point runs once untimed to
+    fault the pages in, then reps timed runs into a zeroed z.
+
+    giops counts a multiply-add as two integer operations, 2 n^3 per run.
+    ok checks the result by its total: the sum of z is the sum over k of
+    (column k of x summed) * (row k of y summed), in wrapping 32-bit
+    arithmetic like the kernels.
+
+    ./matbench [-n 256,512] [-t 1,2,4] [-r reps] [-S static|dynamic]
+    -n matrix sizes (default 256,512,1024)
+    -t thread counts (default 1, 2, 4, ... up to the online CPUs)
+    -r timed runs per point (default 3)
+    -S tile schedule of matmul_config_t (default static)
+*/
+
+#define MAX_LIST 32
+
+static matmul_block_fn block;
+static const char *kernel;
+
+static inline long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// "1,2,4" -> {1, 2, 4}, returns how many
+static int parse_list(char *s, int *out){
+    int n = 0;
+    for (char *tok = strtok(s, ","); tok && n < MAX_LIST; tok = strtok(NULL, ","))
+        out[n++] = atoi(tok);
+    return n;
+}
+
+static void fill_random(matrix_t *m, unsigned int *seed){
+    for (long i = 0; i < (long)m->rows * m->cols; i++)
+        m->data[i] = rand_r(seed) % 1000;
+}
+
+static uint32_t expected_sum(const matrix_t *x, const matrix_t *y){
+    uint32_t sum = 0;
+
+    for (int k = 0; k < x->cols; k++) {
+        uint32_t col = 0, row = 0;
+        for (int i = 0; i < x->rows; i++)
+            col += (uint32_t)MAT(x, i, k);
+        for (int j = 0; j < y->cols; j++)
+            row += (uint32_t)MAT(y, k, j);
+        sum += col * row;
+    }
+    return sum;
+}
+
+static uint32_t matrix_sum(const matrix_t *m){
+    uint32_t sum = 0;
+
+    for (long i = 0; i < (long)m->rows * m->cols; i++)
+        sum += (uint32_t)m->data[i];
+    return sum;
+}
+
+// All reps of one size and thread count; returns false if a result is wrong
+static bool run(int n, int threads, int reps, int schedule){
+    matrix_t x, y, z;
+    matmul_config_t cfg;
+    unsigned int seed = n;
+    bool ok = true;
+
+    if (matrix_alloc(&x, n, n) < 0 || matrix_alloc(&y, n, n) < 0 || matrix_alloc(&z, n, n) < 0) {
+        perror("matrix_alloc");
+        exit(1);
+    }
+    fill_random(&x, &seed);
+    fill_random(&y, &seed);
+    uint32_t want = expected_sum(&x, &y);
+
+    matmul_default_config(&cfg);
+    cfg.threads = threads;
+    cfg.schedule = schedule;
+    cfg.block = block;
+
+    matmul(&x, &y, &z, &cfg);
+    for (int r = 1; r <= reps; r++) {
+        memset(z.data, 0, (size_t)n * n * sizeof(int));
+        long start = now_ns();
+        matmul(&x, &y, &z, &cfg);
+        double seconds = (now_ns() - start) / 1e9;
+        bool good = matrix_sum(&z) == want;
+
+        printf("{\"suite\":\"matmul\",\"kernel\":\"%s\",\"schedule\":\"%s\",\"threads\":%d,"
+               "\"n\":%d,\"rep\":%d,\"seconds\":%.9f,\"giops\":%.3f,\"ok\":%s}\n",
+               kernel, schedule == MATMUL_DYNAMIC ? "dynamic" : "static", threads, n, r,
+               seconds, seconds > 0 ? 2.0 * n * n * n / seconds / 1e9 : 0.0,
+               good ? "true" : "false");
+        fflush(stdout);
+        ok &= good;
+    }
+    matrix_free(&x);
+    matrix_free(&y);
+    matrix_free(&z);
+    return ok;
+}
+
+int main(int argc, char *argv[]){
+    int sizes[MAX_LIST] = { 256, 512, 1024 }, nsizes = 3;
+    int threads[MAX_LIST], nthreads = 0;
+    int reps = 3, schedule = MATMUL_STATIC;
+    int opt;
+    bool ok = true;
+
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "n:t:r:S:")) != -1) {
+        switch (opt) {
+        case 'n':
+            nsizes = parse_list(optarg, sizes);
+            break;
+        case 't':
+            nthreads = parse_list(optarg, threads);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'S':
+            if (strcmp(optarg, "static") == 0) {
+                schedule = MATMUL_STATIC;
+            } else if (strcmp(optarg, "dynamic") == 0) {
+                schedule = MATMUL_DYNAMIC;
+            } else {
+                fprintf(stderr, "%s: unknown schedule %s\n", argv[0], optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n 256,512] [-t 1,2,4] [-r reps] [-S static|dynamic]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nthreads == 0) {
+        for (int t = 1; t < ncpus && nthreads < MAX_LIST - 1; t *= 2)
+            threads[nthreads++] = t;
+        threads[nthreads++] = ncpus > 0 ? ncpus : 1;
+    }
+    if (reps < 1)
+        reps = 1;
+    block = gemm_select();
+    kernel = block == matmul_block ? "none" : gemm_active->name;
+
+    for (int s = 0; s < nsizes; s++) {
+        for (int t = 0; t < nthreads; t++) {
+            if (sizes[s] < 1 || threads[t] < 1) {
+                fprintf(stderr, "%s: sizes and thread counts must be positive\n", argv[0]);
+                return 1;
+            }
+            ok &= run(sizes[s], threads[t], reps, schedule);
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+#!/bin/sh
+#
+# Runs the benchmarks of all four labs and writes one JSON document:
+#
+#   {"schema":1, "meta":{...}, "ok":true, "results":[{...}, ...]}
+#
+# meta describes the machine and the tree (time, git commit, kernel, CPU,
+# memory, compiler) and the parameters below. Every result is one
+# measurement with a "suite" field and its rep number, repetitions are
+# kept apart so the reader can take a median or look at the spread.
+#
+# suites
+#   ipc     lab1 sender | receiver for every mechanism and message size,
+#           with the -f json reports of both sides
+#   shell   lab2 my_shell running scripts of pipelines of /bin/true,
+#           startup subtracted, per pipeline and per process (and the
+#           same scripts under SHELL_REFERENCE for comparison)
+#   matmul  lab3 matrix multiply by matrix size and thread count (matbench.c)
+#   osfs    lab4 sequential / random I/O and file creation on the mounted
+#           osfs at OSFS_DIR (fsbench.c); skipped when OSFS_DIR is not set.
+#           osfs cannot delete files, so the volume needs room for
+#           REPS * OSFS_FILES inodes per run, e.g.
+#           mount -t osfs -o inodes=8192,blocks=16384 none /mnt/osfs
+#
+# Everything is set through the environment (bench/Makefile passes its
+# variables on); lists are space separated, except the comma lists that
+# go straight to matbench and fsbench.
+
+set -u
+
+BUILD=${BUILD:-build}
+OUT=${OUT:-}
+SUITES=${SUITES:-ipc shell matmul osfs}
+REPS=${REPS:-3}
+
+IPC_MECHANISMS=${IPC_MECHANISMS:-1 2 3 4}
+IPC_SIZES=${IPC_SIZES:-16 64 256 1000}
+IPC_MESSAGES=${IPC_MESSAGES:-10000}
+
+SHELL_STAGES=${SHELL_STAGES:-1 2 4 8}
+SHELL_PIPELINES=${SHELL_PIPELINES:-200}
+SHELL_REFERENCE=${SHELL_REFERENCE-/bin/sh}   # empty: my_shell only
+
+MAT_SIZES=${MAT_SIZES:-256,512,1024}
+MAT_THREADS=${MAT_THREADS:-}
+
+OSFS_DIR=${OSFS_DIR:-}
+OSFS_FILE_SIZE=${OSFS_FILE_SIZE:-16M}
+OSFS_IO_SIZES=${OSFS_IO_SIZES:-4096,65536}
+OSFS_FILES=${OSFS_FILES:-1000}
+OSFS_DIRECT=${OSFS_DIRECT:-0}
+
+TMP=$(mktemp -d "${TMPDIR:-/tmp}/bench.XXXXXX") || exit 1
+RESULTS=$TMP/results
+: > "$RESULTS"
+failed=0
+trap 'rm -rf "$TMP"' EXIT
+trap 'exit 130' INT TERM
+
+now_ns() {
+	date +%s%N
+}
+
+# JSON string: escape backslashes and quotes, drop control characters
+json_str() {
+	printf '"%s"' "$(printf '%s' "$1" | tr -d '\000-\037' | sed 's/\\/\\\\/g; s/"/\\"/g')"
+}
+
+# Comma separated JSON numbers from a space or comma separated list
+json_list() {
+	printf '[%s]' "$(echo "$1" | tr ', ' '\n\n' | sed '/^$/d' | paste -sd, -)"
+}
+
+result() {
+	echo "$1" >> "$RESULTS"
+}
+
+fail() {
+	echo "bench: $1" >&2
+	failed=1
+}
+
+# The last line of a program's output if it is a JSON object
+json_line() {
+	line=$(tail -n 1 "$1" 2>/dev/null)
+	case $line in
+	'{'*'}') echo "$line" ;;
+	*) echo null ;;
+	esac
+}
+
+meta() {
+	commit=$(git rev-parse HEAD 2>/dev/null || echo unknown)
+	dirty=false
+	[ -n "$(git status --porcelain --untracked-files=no 2>/dev/null)" ] && dirty=true
+	cpu=$(sed -n 's/^model name[[:space:]]*: //p' /proc/cpuinfo 2>/dev/null | head -n 1)
+	[ -n "$cpu" ] || cpu=$(uname -p)
+	governor=$(cat /sys/devices/system/cpu/cpu0/cpufreq/scaling_governor 2>/dev/null || echo unknown)
+	mem_kb=$(sed -n 's/^MemTotal:[[:space:]]*\([0-9]*\).*/\1/p' /proc/meminfo 2>/dev/null)
+
+	printf '{"time":%s,"host":%s,"kernel":%s,"arch":%s,' \
+		"$(json_str "$(date -u +%Y-%m-%dT%H:%M:%SZ)")" "$(json_str "$(uname -n)")" \
+		"$(json_str "$(uname -sr)")" "$(json_str "$(uname -m)")"
+	printf '"cpu":%s,"cpus":%s,"governor":%s,"mem_kb":%s,' \
+		"$(json_str "$cpu")" "$(getconf _NPROCESSORS_ONLN)" "$(json_str "$governor")" "${mem_kb:-0}"
+	printf '"compiler":%s,"git_commit":%s,"git_dirty":%s,' \
+		"$(json_str "$(${CC:-gcc} --version 2>/dev/null | head -n 1)")" "$(json_str "$commit")" "$dirty"
+	printf '"params":{"suites":%s,"reps":%s,' "$(json_str "$SUITES")" "$REPS"
+	printf '"ipc_mechanisms":%s,"ipc_sizes":%s,"ipc_messages":%s,' \
+		"$(json_list "$IPC_MECHANISMS")" "$(json_list "$IPC_SIZES")" "$IPC_MESSAGES"
+	printf '"shell_stages":%s,"shell_pipelines":%s,"shell_reference":%s,' \
+		"$(json_list "$SHELL_STAGES")" "$SHELL_PIPELINES" "$(json_str "$SHELL_REFERENCE")"
+	printf '"mat_sizes":%s,"mat_threads":%s,' "$(json_list "$MAT_SIZES")" "$(json_list "$MAT_THREADS")"
+	printf '"osfs_dir":%s,"osfs_file_size":%s,"osfs_io_sizes":%s,"osfs_files":%s,"osfs_direct":%s}}' \
+		"$(json_str "$OSFS_DIR")" "$(json_str "$OSFS_FILE_SIZE")" "$(json_str "$OSFS_IO_SIZES")" \
+		"$OSFS_FILES" "$([ "$OSFS_DIRECT" = 1 ] && echo true || echo false)"
+}
+
+# lab1: the sender has to create the mailbox before the receiver opens it,
+# so the receiver is retried until it gets in (or 5 s have passed)
+suite_ipc() {
+	for size in $IPC_SIZES; do
+		input=$TMP/ipc_$size.txt
+		awk -v n="$IPC_MESSAGES" -v s="$size" \
+			'BEGIN { l = sprintf("%*s", s, ""); gsub(/ /, "x", l); for (i = 0; i < n; i++) print l }' > "$input"
+		for m in $IPC_MECHANISMS; do
+			r=1
+			while [ $r -le "$REPS" ]; do
+				"$BUILD/sender" "$m" "$input" -f json > "$TMP/sender.out" 2>&1 &
+				sender=$!
+				tries=0
+				until "$BUILD/receiver" "$m" -f json > "$TMP/receiver.out" 2>&1; do
+					# A fast sender may already be done, its mailbox stays until the receiver has run
+					tries=$((tries + 1))
+					[ $tries -lt 100 ] || break
+					sleep 0.05
+				done
+				wait $sender
+				s=$(json_line "$TMP/sender.out")
+				v=$(json_line "$TMP/receiver.out")
+				[ "$s" = null ] || [ "$v" = null ] && fail "ipc mechanism $m size $size rep $r failed"
+				result "{\"suite\":\"ipc\",\"mechanism\":$m,\"msg_bytes\":$size,\"messages\":$IPC_MESSAGES,\"rep\":$r,\"sender\":$s,\"receiver\":$v}"
+				r=$((r + 1))
+			done
+		done
+	done
+}
+
+# Nanoseconds of one run of script under the shell, "failed" if it did not exit 0
+time_script() {
+	start=$(now_ns)
+	"$1" "$2" > /dev/null 2>&1 || { echo failed; return; }
+	end=$(now_ns)
+	echo $((end - start))
+}
+
+# lab2: time of a pipeline = (time of the script - time of an empty script) / pipelines
+suite_shell() {
+	: > "$TMP/empty.sh"
+	shells="$BUILD/my_shell"
+	[ -n "$SHELL_REFERENCE" ] && [ -x "$SHELL_REFERENCE" ] && shells="$shells $SHELL_REFERENCE"
+	for stages in $SHELL_STAGES; do
+		script=$TMP/pipe_$stages.sh
+		line=/bin/true
+		i=1
+		while [ $i -lt "$stages" ]; do
+			line="$line | /bin/true"
+			i=$((i + 1))
+		done
+		awk -v n="$SHELL_PIPELINES" -v l="$line" 'BEGIN { for (i = 0; i < n; i++) print l }' > "$script"
+		for sh in $shells; do
+			r=1
+			while [ $r -le "$REPS" ]; do
+				base=$(time_script "$sh" "$TMP/empty.sh")
+				total=$(time_script "$sh" "$script")
+				if [ "$base" = failed ] || [ "$total" = failed ]; then
+					fail "$sh $stages stages rep $r failed"
+					r=$((r + 1))
+					continue
+				fi
+				result "$(awk -v sh="$(basename "$sh")" -v st="$stages" -v n="$SHELL_PIPELINES" -v r="$r" \
+					-v t="$total" -v b="$base" 'BEGIN {
+					d = t > b ? t - b : 0
+					printf "{\"suite\":\"shell\",\"shell\":\"%s\",\"stages\":%d,\"pipelines\":%d,\"rep\":%d,", sh, st, n, r
+					printf "\"seconds\":%.9f,\"startup_seconds\":%.9f,", t / 1e9, b / 1e9
+					printf "\"us_per_pipeline\":%.3f,\"us_per_process\":%.3f}", d / n / 1e3, d / (n * st) / 1e3
+				}')"
+				r=$((r + 1))
+			done
+		done
+	done
+}
+
+# lab3
+suite_matmul() {
+	set -- -n "$MAT_SIZES" -r "$REPS"
+	[ -n "$MAT_THREADS" ] && set -- "$@" -t "$MAT_THREADS"
+	"$BUILD/matbench" "$@" > "$TMP/matmul.out" || fail "matbench failed or computed a wrong result"
+	cat "$TMP/matmul.out" >> "$RESULTS"
+}
+
+# lab4
+suite_osfs() {
+	if [ -z "$OSFS_DIR" ]; then
+		result '{"suite":"osfs","skipped":"OSFS_DIR is not set"}'
+		return
+	fi
+	set -- -d "$OSFS_DIR" -s "$OSFS_FILE_SIZE" -b "$OSFS_IO_SIZES" -n "$OSFS_FILES" -r "$REPS"
+	[ "$OSFS_DIRECT" = 1 ] && set -- "$@" -D
+	"$BUILD/fsbench" "$@" > "$TMP/osfs.out" || fail "fsbench failed"
+	cat "$TMP/osfs.out" >> "$RESULTS"
+}
+
+META=$(meta)
+for suite in $SUITES; do
+	case $suite in
+	ipc|shell|matmul|osfs)
+		echo "bench: $suite" >&2
+		suite_$suite
+		;;
+	*)
+		fail "unknown suite $suite"
+		;;
+	esac
+done
+
+{
+	printf '{"schema":1,"meta":%s,"ok":%s,"results":[\n' "$META" "$([ $failed = 0 ] && echo true || echo false)"
+	awk 'NR > 1 { printf ",\n" } { printf "%s", $0 } END { printf "\n" }' "$RESULTS"
+	printf ']}\n'
+} > "$TMP/bench.json"
+
+if [ -n "$OUT" ]; then
+	mkdir -p "$(dirname "$OUT")" && cp "$TMP/bench.json" "$OUT" && echo "bench: wrote $OUT" >&2
+else
+	cat "$TMP/bench.json"
+fi
+exit $failed
@@ -0,0 +1,85 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    Packed frame for the batched message passing mode. One msgsnd carries
+    many lines, each stored as a 2-byte length prefix, the 8-byte send stamp
+    and the bytes (no terminating '\0'). The System V queue keeps frames in FIFO order and
+    lines keep their order inside a frame, so ordering is unchanged.
+*/
+
+#define BATCH_FRAME_SIZE 8192       // default System V MSGMAX
+#define BATCH_HEADER_SIZE (sizeof(uint16_t) + sizeof(uint64_t))
+#define BATCH_MAX_LINE (BATCH_FRAME_SIZE - BATCH_HEADER_SIZE)  // longer lines are cut
+#define BATCH_DEFAULT_SIZE 64       // lines per frame
+#define BATCH_DEFAULT_FLUSH_US 1000 // flush a partial frame after 1 ms of idle input
+
+typedef struct {
+    long mType;
+    char frame[BATCH_FRAME_SIZE];
+} batch_t;
+
+typedef struct {
+    batch_t msg;
+    size_t used;            // bytes packed into msg.frame
+    int count;              // lines packed into msg.frame
+    struct timespec first;  // when the oldest pending line was packed
+} batch_writer_t;
+
+static inline void batch_reset(batch_writer_t *writer){
+    writer->used = 0;
+    writer->count = 0;
+}
+
+static inline int batch_fits(const batch_writer_t *writer, size_t len){
+    return writer->used + BATCH_HEADER_SIZE + len <= BATCH_FRAME_SIZE;
+}
+
+// Append one line to the frame. Caller must check batch_fits() first.
+static inline void batch_append(batch_writer_t *writer, const char *text, size_t len, uint64_t stamp){
+    uint16_t prefix = (uint16_t)len;
+    char *record = writer->msg.frame + writer->used;
+
+    if (writer->count == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &writer->first);
+    }
+    memcpy(record, &prefix, sizeof(prefix));
+    memcpy(record + sizeof(prefix), &stamp, sizeof(stamp));
+    memcpy(record + BATCH_HEADER_SIZE, text, len);
+    writer->used += BATCH_HEADER_SIZE + len;
+    writer->count++;
+}
+
+// Microseconds since the oldest pending line was packed
+static inline long batch_age_us(const batch_writer_t *writer){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - writer->first.tv_sec) * 1000000L +
+           (now.tv_nsec - writer->first.tv_nsec) / 1000L;
+}
+
+/*
+    Walk the records of a received frame. Returns a pointer to the next line
+    and stores its length and send stamp, or NULL when the frame is exhausted.
+*/
+static inline const char *batch_next(const char *frame, size_t size, size_t *offset,
+                                     size_t *len, uint64_t *stamp){
+    uint16_t prefix;
+
+    if (*offset + BATCH_HEADER_SIZE > size)
+        return NULL;
+    memcpy(&prefix, frame + *offset, sizeof(prefix));
+    if (*offset + BATCH_HEADER_SIZE + prefix > size)
+        return NULL;
+
+    memcpy(stamp, frame + *offset + sizeof(prefix), sizeof(*stamp));
+    *len = prefix;
+    *offset += BATCH_HEADER_SIZE + prefix;
+    return frame + *offset - prefix;
+}
+
+#endif
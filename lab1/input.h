@@ -0,0 +1,120 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    Line source for the sender. In stdio mode lines are read with fgets into
+    a caller buffer (and cut at its size, as before). In mmap mode the whole
+    input file is mapped read-only and each line is returned as a slice of
+    the mapping, so there is no per-line buffering and no length limit.
+*/
+
+typedef struct {
+    FILE *fp;           // stdio mode, NULL in mmap mode
+    int fd;
+    const char *data;   // mmap mode: the mapped file
+    size_t size;
+    size_t offset;      // mmap mode: start of the next line
+    int pollable;       // stdio mode on a pipe, tty or socket: reads can block
+} input_t;
+
+static int input_open(input_t *in, const char *path, int use_mmap){
+    memset(in, 0, sizeof(*in));
+
+    if (!use_mmap) {
+        in->fp = fopen(path, "r");
+        if (in->fp == NULL)
+            return -1;
+        in->fd = fileno(in->fp);
+        struct stat st;
+        in->pollable = fstat(in->fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode) ||
+                                                    S_ISSOCK(st.st_mode));
+        return 0;
+    }
+
+    in->fd = open(path, O_RDONLY);
+    if (in->fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(in->fd, &st) < 0) {
+        close(in->fd);
+        return -1;
+    }
+    in->size = st.st_size;
+    if (in->size == 0)
+        return 0;   // nothing to map, input_next_line() reports EOF right away
+
+    in->data = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+    if (in->data == MAP_FAILED) {
+        close(in->fd);
+        return -1;
+    }
+    // The file is consumed front to back once: read ahead aggressively, drop pages behind
+    madvise((void *)in->data, in->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+// mmap mode: return the next line as a slice of the mapping (not '\0' terminated)
+static const char *input_next_slice(input_t *in, size_t *len){
+    *len = 0;
+    if (in->offset >= in->size)
+        return NULL;
+
+    const char *line = in->data + in->offset;
+    const char *newline = memchr(line, '\n', in->size - in->offset);
+    *len = newline ? (size_t)(newline - line) : in->size - in->offset;
+    in->offset += *len + (newline != NULL);
+    return line;
+}
+
+/*
+    Return the next line without its '\n' and store its length, or NULL at EOF.
+    stdio mode reads at most size-1 bytes into buf and returns buf; mmap mode
+    returns a slice of the mapping and ignores buf.
+*/
+static const char *input_next_line(input_t *in, char *buf, size_t size, size_t *len){
+    if (!in->fp)
+        return input_next_slice(in, len);
+
+    *len = 0;
+    if (fgets(buf, size, in->fp) == NULL)
+        return NULL;
+    *len = strcspn(buf, "\n");
+    buf[*len] = '\0';
+    return buf;
+}
+
+/*
+    True if the next line can be read without blocking: the mapping or the
+    stdio buffer still holds data, or the file is a regular file (a read
+    returns data or EOF at once). Only pipes, ttys and sockets have to be
+    polled.
+*/
+static int input_ready(const input_t *in){
+    if (!in->fp)
+        return 1;
+#ifdef __GLIBC__
+    if (in->fp->_IO_read_ptr < in->fp->_IO_read_end)
+        return 1;
+#endif
+    return !in->pollable;
+}
+
+static void input_close(input_t *in){
+    if (in->fp) {
+        fclose(in->fp);
+        return;
+    }
+    if (in->data)
+        munmap((void *)in->data, in->size);
+    close(in->fd);
+}
+
+#endif
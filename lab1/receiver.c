@@ -1,12 +1,8 @@
 #include "receiver.h"
 
-// Semaphore names
-#define SEM_SENDER "/sem_sender"
-#define SEM_RECEIVER "/sem_receiver"
+// Shared keys and semaphore names for System V IPC live in topology.h
 
-// Shared keys for System V IPC
-#define MSG_KEY 1234
-#define SHM_KEY 5678
+static const char *mechanism_names[] = { "", "msg_passing", "shared_mem", "ring_buffer", "msg_batch" };
 
 void receive(message_t* message_ptr, mailbox_t* mailbox_ptr){
     /*  TODO: 
@@ -20,7 +16,7 @@ void receive(message_t* message_ptr, mailbox_t* mailbox_ptr){
         // kernel 介入(記憶體複製兩次)
         // Fix: correct size parameter
         if (msgrcv(mailbox_ptr->storage.msqid, message_ptr, 
-                   sizeof(message_t) - sizeof(long), 1, 0) == -1) {
+                   sizeof(message_t) - sizeof(long), mailbox_ptr->channel + 1, 0) == -1) {
             perror("msgrcv failed");
             exit(1);
         }
@@ -29,8 +25,132 @@ void receive(message_t* message_ptr, mailbox_t* mailbox_ptr){
     } else if (mailbox_ptr->flag == SHARED_MEM) {
         // Shared Memory - using System V shared memory
         // 記憶體複製 (直接存取)
-        strcpy(message_ptr->msgText, mailbox_ptr->storage.shm_addr);
+        message_ptr->sendTime = stamp_read(mailbox_ptr->storage.shm_addr);
+        strcpy(message_ptr->msgText, SHM_TEXT(mailbox_ptr->storage.shm_addr));
         printf("Receive message: %s\n", message_ptr->msgText);
+
+    } else if (mailbox_ptr->flag == RING_BUFFER) {
+        // Ring Buffer - copy the oldest record out, no semaphore needed
+        size_t len;
+        ring_wait_readable(mailbox_ptr->storage.ring);
+        const char *record = ring_peek(mailbox_ptr->storage.ring, &len);
+        message_ptr->sendTime = stamp_read(record);
+        // Records can be up to RING_MAX_MESSAGE bytes, msgText holds a truncated copy
+        size_t text_len = len - STAMP_SIZE;
+        if (text_len > sizeof(message_ptr->msgText) - 1)
+            text_len = sizeof(message_ptr->msgText) - 1;
+        memcpy(message_ptr->msgText, record + STAMP_SIZE, text_len);
+        message_ptr->msgText[text_len] = '\0';
+        ring_release(mailbox_ptr->storage.ring, len);
+        printf("Receive message: %s\n", message_ptr->msgText);
+    }
+}
+
+ssize_t receive_batch(batch_t* batch_ptr, mailbox_t* mailbox_ptr){
+    // One msgrcv returns a whole frame of packed lines
+    ssize_t size = msgrcv(mailbox_ptr->storage.msqid, batch_ptr,
+                          sizeof(batch_ptr->frame), mailbox_ptr->channel + 1, 0);
+    if (size == -1) {
+        perror("msgrcv failed");
+        exit(1);
+    }
+    return size;
+}
+
+/*
+    Pick the next ring (one per sender, stride rings apart) that holds a
+    record, skipping senders that already sent their exit message. With a
+    single sender this is the plain blocking wait.
+*/
+static ring_t *ring_select(mailbox_t *mailbox_ptr, int stride, const char *done){
+    ring_t *ring;
+    int spin = 0;
+
+    if (mailbox_ptr->channels == 1) {
+        ring_wait_readable(mailbox_ptr->storage.ring);
+        return mailbox_ptr->storage.ring;
+    }
+    while (1) {
+        for (int i = 0; i < mailbox_ptr->channels; i++) {
+            int p = (mailbox_ptr->channel + i) % mailbox_ptr->channels;
+            ring = mailbox_ptr->storage.ring + p * stride;
+            if (!done[p] && ring_readable(ring)) {
+                // Start the next scan after this sender so none of them starves
+                mailbox_ptr->channel = (p + 1) % mailbox_ptr->channels;
+                return ring;
+            }
+        }
+        if (++spin < RING_SPIN_COUNT) {
+            cpu_relax();
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+// Ring buffer: print each message straight out of the shared segment, then release it
+static double receive_zero_copy(mailbox_t *mailbox_ptr, const topology_t *topo, ipc_stats_t *stats){
+    struct timespec start, end;
+    double total_time = 0.0;
+    char done[topo->producers];
+    int exits = 0;
+
+    memset(done, 0, sizeof(done));
+    // channel is reused as the round-robin cursor over the senders' rings
+    mailbox_ptr->channel = 0;
+    while (1) {
+        ring_t *ring = ring_select(mailbox_ptr, topo->consumers, done);
+
+        size_t len;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        const char *record = ring_peek(ring, &len);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total_time += (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+        const char *text = record + STAMP_SIZE;
+        int exit_message = (strcmp(text, "exit") == 0);
+        if (!exit_message) {
+            stats_message(stats, strlen(text), now_ns() - stamp_read(record));
+            printf("receive message: %s\n", text);
+        }
+        ring_release(ring, len);
+        if (exit_message) {
+            done[(ring - mailbox_ptr->storage.ring) / topo->consumers] = 1;
+            if (++exits == topo->producers)
+                return total_time;
+        }
+    }
+}
+
+// Batched message passing: unpack every line of each frame until every sender's exit message
+static double receive_batched(mailbox_t *mailbox_ptr, ipc_stats_t *stats){
+    static batch_t batch;
+    struct timespec start, end;
+    double total_time = 0.0;
+    int exits = 0;
+
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ssize_t size = receive_batch(&batch, mailbox_ptr);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total_time += (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+        uint64_t arrival = now_ns();
+        size_t offset = 0, len;
+        uint64_t stamp;
+        const char *text;
+        while ((text = batch_next(batch.frame, size, &offset, &len, &stamp)) != NULL) {
+            if (len == 4 && strncmp(text, "exit", 4) == 0) {
+                if (++exits == mailbox_ptr->channels)
+                    return total_time;
+                continue;
+            }
+            // Includes the time the line waited in the sender's frame
+            stats_message(stats, len, arrival - stamp);
+            printf("receive message: %.*s\n", (int)len, text);
+        }
     }
 }
 
@@ -46,26 +166,91 @@ int main(int argc, char *argv[]){
     
     // (3) Get the mechanism from command line arguments
     // error check
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <mechanism>\n", argv[0]);
-        fprintf(stderr, "mechanism: 1 for Message Passing, 2 for Shared Memory\n");
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <mechanism> [-f text|csv|json] [-k key] [-c consumer_id] [-P producers] [-C consumers]\n"
+                        "       [-w block|spin[:N]|poll] [-a cpu]\n", argv[0]);
+        fprintf(stderr, "mechanism: 1 for Message Passing, 2 for Shared Memory, 3 for Ring Buffer, 4 for Batched Message Passing\n");
+        fprintf(stderr, "-f: print a throughput and end-to-end latency report in this format\n");
+        fprintf(stderr, "-k/-c/-P/-C: mailbox key, this receiver's index, number of senders and receivers\n");
+        fprintf(stderr, "-w: how to wait for the sender in the 1:1 handshake, -a: pin to this CPU\n");
         return 1;
     }
     
     int mechanism = atoi(argv[1]);
     
-    if (mechanism != MSG_PASSING && mechanism != SHARED_MEM) {
-        fprintf(stderr, "Invalid mechanism. Use 1 or 2.\n");
+    if (mechanism != MSG_PASSING && mechanism != SHARED_MEM && mechanism != RING_BUFFER &&
+        mechanism != MSG_BATCH) {
+        fprintf(stderr, "Invalid mechanism. Use 1, 2, 3 or 4.\n");
+        return 1;
+    }
+    
+    int report = REPORT_NONE;
+    int base_key = 0, id = 0, producers = 1, consumers = 1;
+    wait_strategy_t wait = { WAIT_BLOCK, WAIT_DEFAULT_SPINS };
+    int cpu = -1;
+    int opt;
+    optind = 2;
+    while ((opt = getopt(argc, argv, "f:k:c:P:C:w:a:")) != -1) {
+        switch (opt) {
+        case 'f':
+            report = stats_format(optarg);
+            if (report < 0) {
+                fprintf(stderr, "Invalid report format. Use text, csv or json.\n");
+                return 1;
+            }
+            break;
+        case 'k':
+            base_key = atoi(optarg);
+            break;
+        case 'c':
+            id = atoi(optarg);
+            break;
+        case 'P':
+            producers = atoi(optarg);
+            break;
+        case 'C':
+            consumers = atoi(optarg);
+            break;
+        case 'w':
+            if (wait_parse(&wait, optarg) < 0) {
+                fprintf(stderr, "Invalid wait strategy. Use block, spin, spin:N or poll.\n");
+                return 1;
+            }
+            break;
+        case 'a':
+            cpu = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+    
+    if (cpu >= 0 && pin_cpu(cpu) < 0)
+        return 1;
+    
+    topology_t topo;
+    topology_init(&topo, base_key);
+    topo.id = id;
+    topo.producers = producers;
+    topo.consumers = consumers;
+    if (producers < 1 || consumers < 1 || id < 0 || id >= consumers) {
+        fprintf(stderr, "Invalid topology. Need 0 <= consumer_id < consumers and producers >= 1.\n");
+        return 1;
+    }
+    if (topology_shared(&topo) && mechanism == SHARED_MEM) {
+        fprintf(stderr, "Shared Memory has a single slot. Use 1, 3 or 4 for several senders or receivers.\n");
         return 1;
     }
     
     // Initialize mailbox structure
     mailbox_t mailbox;
     mailbox.flag = mechanism;
+    mailbox.channel = id;
+    mailbox.channels = producers;
     
     // Open existing semaphores created by sender
-    sem_t *sem_sender = sem_open(SEM_SENDER, 0);
-    sem_t *sem_receiver = sem_open(SEM_RECEIVER, 0);
+    sem_t *sem_sender = sem_open(topo.sem_sender, 0);
+    sem_t *sem_receiver = sem_open(topo.sem_receiver, 0);
     
     if (sem_sender == SEM_FAILED || sem_receiver == SEM_FAILED) {
         perror("sem_open failed - make sure sender is running first");
@@ -73,21 +258,44 @@ int main(int argc, char *argv[]){
     }
     
     // Get existing communication mechanism
-    if (mechanism == MSG_PASSING) {
+    if (mechanism == MSG_PASSING || mechanism == MSG_BATCH) {
         // Get message queue using System V API
-        mailbox.storage.msqid = msgget(MSG_KEY, 0666);
+        mailbox.storage.msqid = msgget(topo.msg_key, 0666);
         if (mailbox.storage.msqid == -1) {
             perror("msgget failed - make sure sender is running first");
             sem_close(sem_sender);
             sem_close(sem_receiver);
             return 1;
         }
-        printf("Message Passing\n");
+        if (mechanism == MSG_BATCH)
+            printf("Batched Message Passing\n");
+        else
+            printf("Message Passing\n");
+        
+    } else if (mechanism == RING_BUFFER) {
+        // Attach the rings created (and initialized) by the senders
+        int shmid = shmget(topo.ring_key, sizeof(ring_t) * topology_rings(&topo), 0666);
+        if (shmid == -1) {
+            perror("shmget failed - make sure sender is running first");
+            sem_close(sem_sender);
+            sem_close(sem_receiver);
+            return 1;
+        }
+        mailbox.storage.ring = (ring_t *)shmat(shmid, NULL, 0);
+        if (mailbox.storage.ring == (ring_t *)-1) {
+            perror("shmat failed");
+            sem_close(sem_sender);
+            sem_close(sem_receiver);
+            return 1;
+        }
+        // Ring of sender p for this receiver is ring[p * consumers + id]
+        mailbox.storage.ring += id;
+        printf("Ring Buffer\n");
         
     } else {
         // Get shared memory using System V API
         // Get the shared memory segment ID
-        int shmid = shmget(SHM_KEY, 1024, 0666);
+        int shmid = shmget(topo.shm_key, SHM_SIZE, 0666);
         if (shmid == -1) {
             perror("shmget failed - make sure sender is running first");
             sem_close(sem_sender);
@@ -107,54 +315,97 @@ int main(int argc, char *argv[]){
     message_t message;
     struct timespec start, end;
     double total_time = 0.0;
+    static ipc_stats_t stats;
     
-    // (1) Call receive(&message, &mailbox) according to the flow in slide 4
-    // (4) Print information on the console according to the output format
-    while (1) {
-        // Flow: Wait for sender to send message (wait Sender_SEM)
-        sem_wait(sem_sender);
+    if (mailbox.flag == MSG_BATCH) {
+        // No per-line handshake, the queue itself provides flow control
+        total_time = receive_batched(&mailbox, &stats);
+    } else if (mailbox.flag == RING_BUFFER) {
+        // No per-line handshake, the ring only blocks when it is empty
+        total_time = receive_zero_copy(&mailbox, &topo, &stats);
+    } else {
+        int exits = 0;
+        // (1) Call receive(&message, &mailbox) according to the flow in slide 4
+        // (4) Print information on the console according to the output format
+        while (1) {
+            // Flow: Wait for sender to send message (wait Sender_SEM)
+            // Shared mailboxes rely on the queue's own flow control instead
+            if (!topology_shared(&topo))
+                handshake_wait(sem_sender, &wait);
         
-        // (2) Measure only the actual communication time
-        clock_gettime(CLOCK_MONOTONIC, &start);
+            // (2) Measure only the actual communication time
+            clock_gettime(CLOCK_MONOTONIC, &start);
         
-        // Receive message without printing yet
-        if (mailbox.flag == MSG_PASSING) {
-            if (msgrcv(mailbox.storage.msqid, &message, 
-                       sizeof(message_t) - sizeof(long), 1, 0) == -1) {
-                perror("msgrcv failed");
-                exit(1);
+            // Receive message without printing yet
+            if (mailbox.flag == MSG_PASSING) {
+                if (msgrcv(mailbox.storage.msqid, &message, 
+                           sizeof(message_t) - sizeof(long), mailbox.channel + 1, 0) == -1) {
+                    perror("msgrcv failed");
+                    exit(1);
+                }
+            } else if (mailbox.flag == SHARED_MEM) {
+                message.sendTime = stamp_read(mailbox.storage.shm_addr);
+                strcpy(message.msgText, SHM_TEXT(mailbox.storage.shm_addr));
             }
-        } else if (mailbox.flag == SHARED_MEM) {
-            strcpy(message.msgText, mailbox.storage.shm_addr);
-        }
         
-        clock_gettime(CLOCK_MONOTONIC, &end);
+            clock_gettime(CLOCK_MONOTONIC, &end);
         
-        // Accumulate communication time
-        total_time += (end.tv_sec - start.tv_sec) + 
-                      (end.tv_nsec - start.tv_nsec) * 1e-9;
+            // Accumulate communication time
+            total_time += (end.tv_sec - start.tv_sec) + 
+                          (end.tv_nsec - start.tv_nsec) * 1e-9;
         
-        // (5) Check if exit message is received
-        if (strcmp(message.msgText, "exit") == 0) {
-            break;
-        }
+            // (5) Check if exit message is received (one from every sender)
+            if (strcmp(message.msgText, "exit") == 0) {
+                if (++exits == producers)
+                    break;
+                continue;
+            }
+        
+            // End-to-end latency from the sender's stamp
+            stats_message(&stats, strlen(message.msgText), now_ns() - message.sendTime);
         
-        // Print message only if it's not exit
-        printf("receive message: %s\n", message.msgText);
+            // Print message only if it's not exit
+            printf("receive message: %s\n", message.msgText);
         
-        // Signal receiver semaphore (signal Receiver_SEM)
-        sem_post(sem_receiver);
+            // Signal receiver semaphore (signal Receiver_SEM)
+            if (!topology_shared(&topo))
+                sem_post(sem_receiver);
+        }
     }
     
     // (5) Print the total receiving time
     printf("\033[31mSender Exit!\033[0m\n");
     printf("Total time taken in receiving messages: %f seconds\n", total_time);
+    stats_report(&stats, report, "receiver", mechanism_names[mechanism], total_time);
+    
+    // With several receivers only the last one to finish removes the mailbox
+    int last = 1;
+    if (consumers > 1) {
+        sem_t *sem_done = sem_open(topo.sem_done, O_CREAT, 0666, 0);
+        int finished = 0;
+        if (sem_done == SEM_FAILED) {
+            perror("sem_open failed");
+            return 1;
+        }
+        sem_post(sem_done);
+        sem_getvalue(sem_done, &finished);
+        sem_close(sem_done);
+        last = (finished >= consumers);
+        if (last)
+            sem_unlink(topo.sem_done);
+    }
     
     // Cleanup IPC resources
-    if (mechanism == MSG_PASSING) {
-        msgctl(mailbox.storage.msqid, IPC_RMID, NULL);
+    if (mechanism == MSG_PASSING || mechanism == MSG_BATCH) {
+        if (last)
+            msgctl(mailbox.storage.msqid, IPC_RMID, NULL);
+    } else if (mechanism == RING_BUFFER) {
+        int shmid = shmget(topo.ring_key, sizeof(ring_t) * topology_rings(&topo), 0666);
+        shmdt(mailbox.storage.ring - id);
+        if (last)
+            shmctl(shmid, IPC_RMID, NULL);
     } else {
-        int shmid = shmget(SHM_KEY, 1024, 0666);
+        int shmid = shmget(topo.shm_key, SHM_SIZE, 0666);
         shmdt(mailbox.storage.shm_addr);
         shmctl(shmid, IPC_RMID, NULL);
     }
@@ -162,8 +413,10 @@ int main(int argc, char *argv[]){
     // Cleanup semaphores
     sem_close(sem_sender);
     sem_close(sem_receiver);
-    sem_unlink(SEM_SENDER);
-    sem_unlink(SEM_RECEIVER);
+    if (last) {
+        sem_unlink(topo.sem_sender);
+        sem_unlink(topo.sem_receiver);
+    }
     
     return 0;
 }
\ No newline at end of file
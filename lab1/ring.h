@@ -0,0 +1,158 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sched.h>
+
+/*
+    Single-producer / single-consumer ring buffer living in the shared memory
+    segment. The sender only ever writes `head`, the receiver only ever writes
+    `tail`, so no lock is needed: each side publishes its index with a release
+    store and reads the other side's index with an acquire load.
+    head and tail sit on their own cache lines so the two processes do not
+    invalidate each other's line on every update (false sharing).
+
+    Messages are variable-length records (4-byte length + payload, padded to
+    8 bytes) written in place:
+        sender:   p = ring_reserve(ring, max); fill p; ring_commit(ring, len);
+        receiver: p = ring_peek(ring, &len);   use p;  ring_release(ring, len);
+    A record never straddles the end of the buffer; if it would, the sender
+    leaves a wrap marker and starts the record at offset 0.
+*/
+
+#define CACHE_LINE_SIZE 64
+#define RING_DATA_SIZE (256 * 1024)  // must be a power of two
+#define RING_MAX_MESSAGE (RING_DATA_SIZE / 4)  // largest payload a single record may carry
+#define RING_ALIGN 8
+#define RING_WRAP 0xFFFFFFFFu        // length value marking "continue at offset 0"
+#define RING_SPIN_COUNT 128          // busy-wait iterations before yielding the CPU
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint head;   // bytes ever committed by the sender
+    unsigned int reserved;                        // sender-private: size of the open reservation
+    _Alignas(CACHE_LINE_SIZE) atomic_uint tail;   // bytes ever released by the receiver
+    _Alignas(CACHE_LINE_SIZE) char data[RING_DATA_SIZE];
+} ring_t;
+
+static inline void cpu_relax(void){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+static inline unsigned int ring_record_size(size_t len){
+    return (sizeof(uint32_t) + len + RING_ALIGN - 1) & ~(RING_ALIGN - 1);
+}
+
+// Bytes a reservation of len consumes, including the skipped tail when it must wrap
+static inline unsigned int ring_footprint(unsigned int head, size_t len){
+    unsigned int pos = head & (RING_DATA_SIZE - 1);
+    unsigned int need = ring_record_size(len);
+
+    if (pos + need > RING_DATA_SIZE)
+        need += RING_DATA_SIZE - pos;
+    return need;
+}
+
+static inline void ring_init(ring_t *ring){
+    atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+    ring->reserved = 0;
+}
+
+// Wait until the sender can reserve len bytes (only blocks when the ring is full)
+static inline void ring_wait_writable(ring_t *ring, size_t len){
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int need = ring_footprint(head, len);
+    int spin = 0;
+    while (RING_DATA_SIZE - (head - atomic_load_explicit(&ring->tail, memory_order_acquire)) < need) {
+        if (++spin < RING_SPIN_COUNT) {
+            cpu_relax();
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+// Wait until the receiver has a committed record (only blocks when the ring is empty)
+static inline void ring_wait_readable(ring_t *ring){
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    int spin = 0;
+    while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+        if (++spin < RING_SPIN_COUNT) {
+            cpu_relax();
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+// Non-blocking check for a committed record, for receivers polling several rings
+static inline int ring_readable(ring_t *ring){
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    return atomic_load_explicit(&ring->head, memory_order_acquire) != tail;
+}
+
+/*
+    Reserve room for up to len payload bytes and return where to write them.
+    Caller must ring_wait_writable(ring, len) first. Nothing is visible to the
+    receiver until ring_commit().
+*/
+static inline char *ring_reserve(ring_t *ring, size_t len){
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int pos = head & (RING_DATA_SIZE - 1);
+
+    ring->reserved = len;
+    if (pos + ring_record_size(len) > RING_DATA_SIZE)
+        pos = 0;
+    return ring->data + pos + sizeof(uint32_t);
+}
+
+// Publish the first len bytes of the open reservation as one message
+static inline void ring_commit(ring_t *ring, size_t len){
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int pos = head & (RING_DATA_SIZE - 1);
+    uint32_t length = len;
+
+    if (pos + ring_record_size(ring->reserved) > RING_DATA_SIZE) {
+        memcpy(ring->data + pos, &(uint32_t){RING_WRAP}, sizeof(uint32_t));
+        head += RING_DATA_SIZE - pos;
+        pos = 0;
+    }
+    memcpy(ring->data + pos, &length, sizeof(length));
+    ring->reserved = 0;
+    atomic_store_explicit(&ring->head, head + ring_record_size(len), memory_order_release);
+}
+
+/*
+    Return a view of the oldest message and store its length. The bytes stay
+    valid until ring_release(). Caller must ring_wait_readable() first.
+*/
+static inline const char *ring_peek(ring_t *ring, size_t *len){
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int pos = tail & (RING_DATA_SIZE - 1);
+    uint32_t length;
+
+    memcpy(&length, ring->data + pos, sizeof(length));
+    if (length == RING_WRAP) {
+        // Hand the padding at the end back to the sender and read from offset 0
+        tail += RING_DATA_SIZE - pos;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        pos = 0;
+        memcpy(&length, ring->data, sizeof(length));
+    }
+    *len = length;
+    return ring->data + pos + sizeof(uint32_t);
+}
+
+// Give the space of the message returned by ring_peek() back to the sender
+static inline void ring_release(ring_t *ring, size_t len){
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + ring_record_size(len), memory_order_release);
+}
+
+#endif
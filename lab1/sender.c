@@ -1,12 +1,8 @@
 #include "sender.h"
 
-// Semaphore names
-#define SEM_SENDER "/sem_sender"
-#define SEM_RECEIVER "/sem_receiver"
+// Shared keys and semaphore names for System V IPC live in topology.h
 
-// Shared keys for System V IPC
-#define MSG_KEY 1234
-#define SHM_KEY 5678
+static const char *mechanism_names[] = { "", "msg_passing", "shared_mem", "ring_buffer", "msg_batch" };
 
 void send(message_t message, mailbox_t* mailbox_ptr){
     /*  TODO: 
@@ -14,10 +10,17 @@ void send(message_t message, mailbox_t* mailbox_ptr){
         2. According to the communication method, send the message
     */
     
+    // Stamp the message so the receiver can measure end-to-end latency
+    message.sendTime = now_ns();
+    // mType selects the receiver (channel) this message is sharded to
+    message.mType = mailbox_ptr->channel + 1;
+    
     // (1) Determine communication method by flag
     if (mailbox_ptr->flag == MSG_PASSING) {
         // Message Passing - using System V message queue
-        if (msgsnd(mailbox_ptr->storage.msqid, &message, sizeof(message.msgText), 0) == -1) {
+        // Only the stamp, the text and its terminator are shipped, not the whole 1024-byte buffer
+        if (msgsnd(mailbox_ptr->storage.msqid, &message,
+                   MSG_PAYLOAD_SIZE(strlen(message.msgText) + 1), 0) == -1) {
             perror("msgsnd failed");
             exit(1);
         }
@@ -25,9 +28,172 @@ void send(message_t message, mailbox_t* mailbox_ptr){
 
     } else if (mailbox_ptr->flag == SHARED_MEM) {
         // Shared Memory - using System V shared memory
-        strcpy(mailbox_ptr->storage.shm_addr, message.msgText);
+        stamp_write(mailbox_ptr->storage.shm_addr, message.sendTime);
+        strcpy(SHM_TEXT(mailbox_ptr->storage.shm_addr), message.msgText);
+        printf("Send message: %s\n", message.msgText);
+
+    } else if (mailbox_ptr->flag == RING_BUFFER) {
+        // Ring Buffer - variable-length record in shared memory, no semaphore needed
+        ring_t *ring = mailbox_ptr->storage.ring + mailbox_ptr->channel;
+        size_t len = STAMP_SIZE + strlen(message.msgText) + 1;
+        ring_wait_writable(ring, len);
+        char *record = ring_reserve(ring, len);
+        stamp_write(record, message.sendTime);
+        strcpy(record + STAMP_SIZE, message.msgText);
+        ring_commit(ring, len);
         printf("Send message: %s\n", message.msgText);
     }
+    // Round-robin over the receivers
+    mailbox_ptr->channel = (mailbox_ptr->channel + 1) % mailbox_ptr->channels;
+}
+
+void send_batch(batch_writer_t* writer, mailbox_t* mailbox_ptr){
+    // Ship every packed line with a single msgsnd, only the used bytes go to the kernel
+    if (writer->count == 0)
+        return;
+    // Whole frames are sharded round-robin over the receivers
+    writer->msg.mType = mailbox_ptr->channel + 1;
+    if (msgsnd(mailbox_ptr->storage.msqid, &writer->msg, writer->used, 0) == -1) {
+        perror("msgsnd failed");
+        exit(1);
+    }
+    mailbox_ptr->channel = (mailbox_ptr->channel + 1) % mailbox_ptr->channels;
+    batch_reset(writer);
+}
+
+// Block until the input has more data or the pending frame is older than flush_us
+static int input_idle(input_t *in, batch_writer_t *writer, long flush_us){
+    long remaining_us = flush_us - batch_age_us(writer);
+    if (remaining_us <= 0)
+        return 1;
+    // Lines already buffered or mapped, or a regular file: poll() would say readable anyway
+    if (input_ready(in))
+        return 0;
+
+    struct pollfd pfd = { .fd = in->fd, .events = POLLIN };
+    struct timespec timeout = {
+        .tv_sec = remaining_us / 1000000L,
+        .tv_nsec = (remaining_us % 1000000L) * 1000L,
+    };
+    return ppoll(&pfd, 1, &timeout, NULL) == 0;
+}
+
+/*
+    Ring buffer: read each line straight into space reserved in the shared
+    segment, so fgets (or the copy out of the input mapping) is the only copy
+    a message ever goes through. Lines go round-robin over this sender's
+    rings (one per receiver); at EOF every ring gets an exit message.
+*/
+static double send_zero_copy(input_t *in, mailbox_t *mailbox_ptr, ipc_stats_t *stats){
+    struct timespec start, end;
+    double total_time = 0.0;
+    int exits = 0;
+
+    while (exits < mailbox_ptr->channels) {
+        ring_t *ring = mailbox_ptr->storage.ring + mailbox_ptr->channel;
+        const char *line;
+        char *record;
+        size_t len;
+
+        // Each record is the send stamp followed by the '\0' terminated text
+        if (exits > 0) {
+            ring_wait_writable(ring, STAMP_SIZE + MSG_TEXT_SIZE);
+            record = ring_reserve(ring, STAMP_SIZE + MSG_TEXT_SIZE);
+            line = NULL;
+        } else if (in->fp) {
+            ring_wait_writable(ring, STAMP_SIZE + MSG_TEXT_SIZE);
+            record = ring_reserve(ring, STAMP_SIZE + MSG_TEXT_SIZE);
+            line = input_next_line(in, record + STAMP_SIZE, MSG_TEXT_SIZE, &len);
+        } else {
+            // The slice length is known up front, reserve exactly what it needs
+            line = input_next_slice(in, &len);
+            if (len > RING_MAX_MESSAGE - STAMP_SIZE - 1)
+                len = RING_MAX_MESSAGE - STAMP_SIZE - 1;
+            ring_wait_writable(ring, STAMP_SIZE + (line ? len + 1 : MSG_TEXT_SIZE));
+            record = ring_reserve(ring, STAMP_SIZE + (line ? len + 1 : MSG_TEXT_SIZE));
+            if (line) {
+                memcpy(record + STAMP_SIZE, line, len);
+                record[STAMP_SIZE + len] = '\0';
+            }
+        }
+
+        char *text = record + STAMP_SIZE;
+        int eof = (line == NULL);
+        if (eof)
+            strcpy(text, "exit");
+        len = strlen(text);
+        if (!eof)
+            printf("Send message: %s\n", text);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        stamp_write(record, now_ns());
+        ring_commit(ring, STAMP_SIZE + len + 1);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total_time += (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec) * 1e-9;
+        if (!eof)
+            stats_message(stats, len, timespec_diff_ns(&start, &end));
+        else
+            exits++;
+
+        mailbox_ptr->channel = (mailbox_ptr->channel + 1) % mailbox_ptr->channels;
+    }
+    return total_time;
+}
+
+// Batched message passing: pack many lines per msgsnd, flush on size, count or timeout
+static double send_batched(input_t *in, mailbox_t *mailbox_ptr, int batch_size, long flush_us,
+                           ipc_stats_t *stats){
+    static batch_writer_t writer;
+    char buffer[MSG_TEXT_SIZE];
+    struct timespec start, end;
+    double total_time = 0.0;
+
+    batch_reset(&writer);
+
+    while (1) {
+        // Flush a partial frame instead of holding lines back when the input stalls
+        if (writer.count > 0 && input_idle(in, &writer, flush_us)) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            send_batch(&writer, mailbox_ptr);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            total_time += (end.tv_sec - start.tv_sec) +
+                          (end.tv_nsec - start.tv_nsec) * 1e-9;
+        }
+
+        size_t len;
+        const char *line = input_next_line(in, buffer, sizeof(buffer), &len);
+        int eof = (line == NULL);
+        if (eof) {
+            // The exit message rides in the last frame
+            line = "exit";
+            len = strlen(line);
+        } else if (len > BATCH_MAX_LINE) {
+            len = BATCH_MAX_LINE;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!batch_fits(&writer, len))
+            send_batch(&writer, mailbox_ptr);
+        batch_append(&writer, line, len, now_ns());
+        if (eof || writer.count >= batch_size)
+            send_batch(&writer, mailbox_ptr);
+        // Every other receiver gets a frame holding just the exit message
+        for (int c = 1; eof && c < mailbox_ptr->channels; c++) {
+            batch_append(&writer, line, len, now_ns());
+            send_batch(&writer, mailbox_ptr);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total_time += (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec) * 1e-9;
+        if (!eof)
+            stats_message(stats, len, timespec_diff_ns(&start, &end));
+
+        if (eof)
+            break;
+        printf("Send message: %.*s\n", (int)len, line);
+    }
+    return total_time;
 }
 
 int main(int argc, char *argv[]){
@@ -45,27 +211,110 @@ int main(int argc, char *argv[]){
     
     // (3) Get the mechanism and the input file from command line arguments
     // error check
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <mechanism> <input_file>\n", argv[0]);
-        fprintf(stderr, "mechanism: 1 for Message Passing, 2 for Shared Memory\n");
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <mechanism> <input_file> [-b batch_size] [-t flush_us] [-m] [-f text|csv|json]\n"
+                        "       [-k key] [-p producer_id] [-P producers] [-C consumers] [-w block|spin[:N]|poll] [-a cpu]\n", argv[0]);
+        fprintf(stderr, "mechanism: 1 for Message Passing, 2 for Shared Memory, 3 for Ring Buffer, 4 for Batched Message Passing\n");
+        fprintf(stderr, "-m: mmap the input file instead of reading it with fgets\n");
+        fprintf(stderr, "-f: print a throughput and send-call latency report in this format\n");
+        fprintf(stderr, "-k/-p/-P/-C: mailbox key, this sender's index, number of senders and receivers\n");
+        fprintf(stderr, "-w: how to wait for the receiver in the 1:1 handshake, -a: pin to this CPU\n");
         return 1;
     }
     
     int mechanism = atoi(argv[1]);
     char *input_file = argv[2];
     
-    if (mechanism != MSG_PASSING && mechanism != SHARED_MEM) {
-        fprintf(stderr, "Invalid mechanism. Use 1 or 2.\n");
+    if (mechanism != MSG_PASSING && mechanism != SHARED_MEM && mechanism != RING_BUFFER &&
+        mechanism != MSG_BATCH) {
+        fprintf(stderr, "Invalid mechanism. Use 1, 2, 3 or 4.\n");
+        return 1;
+    }
+    
+    // Optional tuning flags after the positional arguments
+    int batch_size = BATCH_DEFAULT_SIZE;
+    long flush_us = BATCH_DEFAULT_FLUSH_US;
+    int use_mmap = 0;
+    int report = REPORT_NONE;
+    int base_key = 0, id = 0, producers = 1, consumers = 1;
+    wait_strategy_t wait = { WAIT_BLOCK, WAIT_DEFAULT_SPINS };
+    int cpu = -1;
+    int opt;
+    optind = 3;
+    while ((opt = getopt(argc, argv, "b:t:mf:k:p:P:C:w:a:")) != -1) {
+        switch (opt) {
+        case 'b':
+            batch_size = atoi(optarg);
+            break;
+        case 't':
+            flush_us = atol(optarg);
+            break;
+        case 'm':
+            use_mmap = 1;
+            break;
+        case 'f':
+            report = stats_format(optarg);
+            if (report < 0) {
+                fprintf(stderr, "Invalid report format. Use text, csv or json.\n");
+                return 1;
+            }
+            break;
+        case 'k':
+            base_key = atoi(optarg);
+            break;
+        case 'p':
+            id = atoi(optarg);
+            break;
+        case 'P':
+            producers = atoi(optarg);
+            break;
+        case 'C':
+            consumers = atoi(optarg);
+            break;
+        case 'w':
+            if (wait_parse(&wait, optarg) < 0) {
+                fprintf(stderr, "Invalid wait strategy. Use block, spin, spin:N or poll.\n");
+                return 1;
+            }
+            break;
+        case 'a':
+            cpu = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (batch_size < 1) {
+        fprintf(stderr, "Invalid batch size. Use a positive number.\n");
+        return 1;
+    }
+    
+    if (cpu >= 0 && pin_cpu(cpu) < 0)
+        return 1;
+    
+    topology_t topo;
+    topology_init(&topo, base_key);
+    topo.id = id;
+    topo.producers = producers;
+    topo.consumers = consumers;
+    if (producers < 1 || consumers < 1 || id < 0 || id >= producers) {
+        fprintf(stderr, "Invalid topology. Need 0 <= producer_id < producers and consumers >= 1.\n");
+        return 1;
+    }
+    if (topology_shared(&topo) && mechanism == SHARED_MEM) {
+        fprintf(stderr, "Shared Memory has a single slot. Use 1, 3 or 4 for several senders or receivers.\n");
         return 1;
     }
     
     // Initialize mailbox structure
     mailbox_t mailbox;
     mailbox.flag = mechanism;
+    mailbox.channel = 0;
+    mailbox.channels = consumers;
     
     // Create semaphores using POSIX API
-    sem_t *sem_sender = sem_open(SEM_SENDER, O_CREAT, 0666, 0);
-    sem_t *sem_receiver = sem_open(SEM_RECEIVER, O_CREAT, 0666, 1);
+    sem_t *sem_sender = sem_open(topo.sem_sender, O_CREAT, 0666, 0);
+    sem_t *sem_receiver = sem_open(topo.sem_receiver, O_CREAT, 0666, 1);
     
     if (sem_sender == SEM_FAILED || sem_receiver == SEM_FAILED) {
         perror("sem_open failed");
@@ -73,22 +322,47 @@ int main(int argc, char *argv[]){
     }
     
     // Create communication mechanism
-    if (mechanism == MSG_PASSING) {
+    if (mechanism == MSG_PASSING || mechanism == MSG_BATCH) {
         // Create message queue using System V API
         // msqid得到queue的ID, MSG是kernel key, 0666是權限設定
-        mailbox.storage.msqid = msgget(MSG_KEY, IPC_CREAT | 0666);
+        mailbox.storage.msqid = msgget(topo.msg_key, IPC_CREAT | 0666);
         if (mailbox.storage.msqid == -1) {
             perror("msgget failed");
             sem_close(sem_sender);
             sem_close(sem_receiver);
             return 1;
         }
-        printf("Message Passing\n");
+        if (mechanism == MSG_BATCH)
+            printf("Batched Message Passing (batch %d, flush %ld us)\n", batch_size, flush_us);
+        else
+            printf("Message Passing\n");
+        
+    } else if (mechanism == RING_BUFFER) {
+        // Create the rings in their own segment, the size differs from the 1024-byte mailbox
+        int shmid = shmget(topo.ring_key, sizeof(ring_t) * topology_rings(&topo), IPC_CREAT | 0666);
+        if (shmid == -1) {
+            perror("shmget failed");
+            sem_close(sem_sender);
+            sem_close(sem_receiver);
+            return 1;
+        }
+        mailbox.storage.ring = (ring_t *)shmat(shmid, NULL, 0);
+        if (mailbox.storage.ring == (ring_t *)-1) {
+            perror("shmat failed");
+            sem_close(sem_sender);
+            sem_close(sem_receiver);
+            return 1;
+        }
+        // This sender owns (and initializes) one ring per receiver
+        mailbox.storage.ring += id * consumers;
+        for (int c = 0; c < consumers; c++)
+            ring_init(mailbox.storage.ring + c);
+        printf("Ring Buffer\n");
         
     } else {
         // Create shared memory using System V API
         // shmget得到segment的ID, SHM是kernel key, 0666是權限設定
-        int shmid = shmget(SHM_KEY, 1024, IPC_CREAT | 0666);
+        int shmid = shmget(topo.shm_key, SHM_SIZE, IPC_CREAT | 0666);
         if (shmid == -1) {
             perror("shmget failed");
             sem_close(sem_sender);
@@ -109,78 +383,106 @@ int main(int argc, char *argv[]){
     }
     
     // (4) Get the messages to be sent from the input file
-    FILE *fp = fopen(input_file, "r");
-    if (fp == NULL) {
+    input_t in;
+    if (input_open(&in, input_file, use_mmap) < 0) {
         perror("Error opening file");
         return 1;
     }
     
     message_t message;
-    message.mType = 1;
     
     struct timespec start, end;
     double total_time = 0.0;
+    static ipc_stats_t stats;
     
-    // (1) Call send(message, &mailbox) according to the flow in slide 4
-    // (5) Print information on the console according to the output format
-    // 從input file讀取每一行, 直到\n或EOF, 最多讀取sizeof(msgText)-1個字元
-    while (fgets(message.msgText, sizeof(message.msgText), fp) != NULL) {
-        // Remove trailing newline character
-        size_t len = strlen(message.msgText);
-        if (len > 0 && message.msgText[len - 1] == '\n') {
-            message.msgText[len - 1] = '\0';
-        }
+    if (mailbox.flag == MSG_BATCH) {
+        // No per-line handshake, the queue itself provides flow control
+        total_time = send_batched(&in, &mailbox, batch_size, flush_us, &stats);
+    } else if (mailbox.flag == RING_BUFFER) {
+        // No per-line handshake, the ring only blocks when it is full
+        total_time = send_zero_copy(&in, &mailbox, &stats);
+    } else {
+        // (1) Call send(message, &mailbox) according to the flow in slide 4
+        // (5) Print information on the console according to the output format
+        // 從input file讀取每一行, 直到\n或EOF, 最多讀取sizeof(msgText)-1個字元
+        // (trailing newline is removed by input_next_line)
+        const char *line;
+        size_t len;
+        while ((line = input_next_line(&in, message.msgText, sizeof(message.msgText), &len)) != NULL) {
+            // mmap mode hands out a slice, the fixed-size mailboxes still need it in msgText
+            if (line != message.msgText) {
+                if (len > sizeof(message.msgText) - 1)
+                    len = sizeof(message.msgText) - 1;
+                memcpy(message.msgText, line, len);
+                message.msgText[len] = '\0';
+            }
         
-        // Flow: Wait for receiver to be ready (wait Receiver_SEM)
-        sem_wait(sem_receiver);
+            // Flow: Wait for receiver to be ready (wait Receiver_SEM)
+            // Shared mailboxes rely on the queue's own flow control instead
+            if (!topology_shared(&topo))
+                handshake_wait(sem_receiver, &wait);
         
-        // (2) Measure only the actual communication time
-        clock_gettime(CLOCK_MONOTONIC, &start);
-        send(message, &mailbox);
-        clock_gettime(CLOCK_MONOTONIC, &end);
+            // (2) Measure only the actual communication time
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            send(message, &mailbox);
+            clock_gettime(CLOCK_MONOTONIC, &end);
         
-        // Accumulate communication time
-        total_time += (end.tv_sec - start.tv_sec) + 
-                      (end.tv_nsec - start.tv_nsec) * 1e-9;
+            // Accumulate communication time
+            total_time += (end.tv_sec - start.tv_sec) + 
+                          (end.tv_nsec - start.tv_nsec) * 1e-9;
+            stats_message(&stats, strlen(message.msgText), timespec_diff_ns(&start, &end));
         
-        // Signal sender semaphore (signal Sender_SEM)
-        sem_post(sem_sender);
-    }
+            // Signal sender semaphore (signal Sender_SEM)
+            if (!topology_shared(&topo))
+                sem_post(sem_sender);
+        }
     
-    // (6) If the message form the input file is EOF, send an exit message to the receiver.c
-    sem_wait(sem_receiver);
-    // 把msgText設為"exit"
-    strcpy(message.msgText, "exit");
+        // (6) If the message form the input file is EOF, send an exit message to the receiver.c
+        if (!topology_shared(&topo))
+            handshake_wait(sem_receiver, &wait);
+        // 把msgText設為"exit"
+        strcpy(message.msgText, "exit");
     
-    // (2) Measure only the actual communication time
-    clock_gettime(CLOCK_MONOTONIC, &start);
+        // (2) Measure only the actual communication time
+        clock_gettime(CLOCK_MONOTONIC, &start);
     
-    // Send exit message without printing
-    if (mailbox.flag == MSG_PASSING) {
-        if (msgsnd(mailbox.storage.msqid, &message, sizeof(message.msgText), 0) == -1) {
-            perror("msgsnd failed");
-            exit(1);
+        // Send exit message without printing, one per receiver
+        for (int c = 0; c < consumers; c++) {
+            message.sendTime = now_ns();
+            message.mType = c + 1;
+            if (mailbox.flag == MSG_PASSING) {
+                if (msgsnd(mailbox.storage.msqid, &message,
+                           MSG_PAYLOAD_SIZE(strlen(message.msgText) + 1), 0) == -1) {
+                    perror("msgsnd failed");
+                    exit(1);
+                }
+            } else if (mailbox.flag == SHARED_MEM) {
+                stamp_write(mailbox.storage.shm_addr, message.sendTime);
+                strcpy(SHM_TEXT(mailbox.storage.shm_addr), message.msgText);
+            }
         }
-    } else if (mailbox.flag == SHARED_MEM) {
-        strcpy(mailbox.storage.shm_addr, message.msgText);
-    }
     
-    clock_gettime(CLOCK_MONOTONIC, &end);
+        clock_gettime(CLOCK_MONOTONIC, &end);
     
-    total_time += (end.tv_sec - start.tv_sec) + 
-                  (end.tv_nsec - start.tv_nsec) * 1e-9;
+        total_time += (end.tv_sec - start.tv_sec) + 
+                      (end.tv_nsec - start.tv_nsec) * 1e-9;
     
-    sem_post(sem_sender);
+        if (!topology_shared(&topo))
+            sem_post(sem_sender);
+    }
     
     // (7) Print the total sending time
     printf("\033[31mEnd of input file! exit!\033[0m\n");
     printf("Total time taken in sending messages: %f seconds\n", total_time);
+    stats_report(&stats, report, "sender", mechanism_names[mechanism], total_time);
     
     // Cleanup
-    fclose(fp);
+    input_close(&in);
     
     if (mechanism == SHARED_MEM) {
         shmdt(mailbox.storage.shm_addr);
+    } else if (mechanism == RING_BUFFER) {
+        shmdt(mailbox.storage.ring - id * consumers);
     }
     
     sem_close(sem_sender);
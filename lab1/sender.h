@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // ppoll, sched_setaffinity
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,16 +12,31 @@
 #include <sys/shm.h>
 #include <semaphore.h>
 #include <time.h>
+#include <stddef.h>
+#include <poll.h>
+#include "ring.h"
+#include "batch.h"
+#include "stats.h"
+#include "topology.h"
+#include "wait.h"
+#include "input.h"
 
 #define MSG_PASSING 1
 #define SHARED_MEM 2
+#define RING_BUFFER 3
+#define MSG_BATCH 4
+
+#define MSG_TEXT_SIZE 1024
 
 typedef struct {
-    int flag;      // 1 for message passing, 2 for shared memory
+    int flag;      // 1 for message passing, 2 for shared memory, 3 for SPSC ring buffer, 4 for batched message passing
     union{
         int msqid; //for system V api. You can replace it with structure for POSIX api
         char* shm_addr;
+        ring_t* ring;  //ring buffer placed in the shared memory segment
     }storage;
+    int channel;   // receiver index: the mType-1 / ring this process sends to next or drains
+    int channels;  // number of receivers (sender) or senders (receiver) sharing the mailbox
 } mailbox_t;
 
 
@@ -29,7 +45,16 @@ typedef struct {
         Message structure for wrapper
     */
     long mType;
-    char msgText[1024];
+    uint64_t sendTime;  // CLOCK_MONOTONIC ns when the sender shipped it
+    char msgText[MSG_TEXT_SIZE];
 } message_t;
 
+// Bytes after mType that msgsnd ships for len bytes of text (including '\0')
+#define MSG_PAYLOAD_SIZE(len) (offsetof(message_t, msgText) - sizeof(long) + (len))
+
+// Shared memory mailbox layout: the send stamp followed by the text
+#define SHM_SIZE (STAMP_SIZE + MSG_TEXT_SIZE)
+#define SHM_TEXT(addr) ((addr) + STAMP_SIZE)
+
 void send(message_t message, mailbox_t* mailbox_ptr);
+void send_batch(batch_writer_t* writer, mailbox_t* mailbox_ptr);
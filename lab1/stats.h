@@ -0,0 +1,192 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    Benchmark statistics for the lab1 transports.
+
+    Latencies go into an HDR-style log-linear histogram: values below
+    2^HIST_SUB_BITS ns are counted exactly, every higher power of two is split
+    into 2^HIST_SUB_BITS equal buckets, so any recorded value is reported
+    with < 1/2^HIST_SUB_BITS (~3%) relative error using a fixed 15 KiB table.
+*/
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+#define REPORT_NONE 0
+#define REPORT_TEXT 1
+#define REPORT_CSV 2
+#define REPORT_JSON 3
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} histogram_t;
+
+typedef struct {
+    histogram_t latency;    // ns; end-to-end on the receiver, per send call on the sender
+    uint64_t messages;
+    uint64_t bytes;         // payload bytes, without framing
+    uint64_t first_ns;      // CLOCK_MONOTONIC of the first and last message
+    uint64_t last_ns;
+} ipc_stats_t;
+
+static inline uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t timespec_diff_ns(const struct timespec *start, const struct timespec *end){
+    return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000ull + end->tv_nsec - start->tv_nsec;
+}
+
+/*
+    Send stamp (CLOCK_MONOTONIC ns, shared by all processes on the host) that
+    travels in front of every message so the receiver can measure end-to-end
+    latency. Stored with memcpy because records are not 8-byte aligned.
+*/
+#define STAMP_SIZE sizeof(uint64_t)
+
+static inline void stamp_write(void *dst, uint64_t stamp){
+    memcpy(dst, &stamp, sizeof(stamp));
+}
+
+static inline uint64_t stamp_read(const void *src){
+    uint64_t stamp;
+    memcpy(&stamp, src, sizeof(stamp));
+    return stamp;
+}
+
+static inline int hist_index(uint64_t value){
+    if (value < HIST_SUB_COUNT)
+        return value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int)((value >> shift) - HIST_SUB_COUNT);
+}
+
+// Highest value that falls into bucket index
+static inline uint64_t hist_value(int index){
+    int group = index / HIST_SUB_COUNT;
+    uint64_t sub = index % HIST_SUB_COUNT;
+    if (group == 0)
+        return sub;
+    int shift = group - 1;
+    return ((sub + HIST_SUB_COUNT) << shift) + ((1ull << shift) - 1);
+}
+
+static inline void hist_record(histogram_t *hist, uint64_t value){
+    if (hist->total == 0 || value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+}
+
+// Value at percentile p (0..100), clamped to the exact recorded max
+static uint64_t hist_percentile(const histogram_t *hist, double p){
+    if (hist->total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * hist->total + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank)
+            return hist_value(i) < hist->max ? hist_value(i) : hist->max;
+    }
+    return hist->max;
+}
+
+/*
+    Account one message of len payload bytes. latency_ns is recorded in the
+    histogram unless it is UINT64_MAX (nothing to measure for this message).
+*/
+static inline void stats_message(ipc_stats_t *stats, size_t len, uint64_t latency_ns){
+    uint64_t now = now_ns();
+
+    if (stats->messages == 0)
+        stats->first_ns = now;
+    stats->last_ns = now;
+    stats->messages++;
+    stats->bytes += len;
+    if (latency_ns != UINT64_MAX)
+        hist_record(&stats->latency, latency_ns);
+}
+
+// Parse the -f argument, returns -1 for an unknown format
+static int stats_format(const char *name){
+    if (strcmp(name, "text") == 0)
+        return REPORT_TEXT;
+    if (strcmp(name, "csv") == 0)
+        return REPORT_CSV;
+    if (strcmp(name, "json") == 0)
+        return REPORT_JSON;
+    return -1;
+}
+
+/*
+    Print the report. side is "sender" or "receiver", total_time is the
+    communication time already shown on the console.
+*/
+static void stats_report(const ipc_stats_t *stats, int format, const char *side,
+                         const char *mechanism, double total_time){
+    const histogram_t *hist = &stats->latency;
+    double elapsed = (stats->last_ns - stats->first_ns) * 1e-9;
+    double msgs_per_sec = elapsed > 0 ? stats->messages / elapsed : 0.0;
+    double bytes_per_sec = elapsed > 0 ? stats->bytes / elapsed : 0.0;
+    double mean = hist->total ? hist->sum / hist->total : 0.0;
+    uint64_t p50 = hist_percentile(hist, 50.0);
+    uint64_t p90 = hist_percentile(hist, 90.0);
+    uint64_t p99 = hist_percentile(hist, 99.0);
+    uint64_t p999 = hist_percentile(hist, 99.9);
+
+    switch (format) {
+    case REPORT_TEXT:
+        printf("%s %s: %llu messages, %llu bytes in %.6f s (%.0f msg/s, %.0f B/s)\n",
+               side, mechanism, (unsigned long long)stats->messages,
+               (unsigned long long)stats->bytes, elapsed, msgs_per_sec, bytes_per_sec);
+        printf("latency (ns): min %llu p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu mean %.0f\n",
+               (unsigned long long)hist->min, (unsigned long long)p50,
+               (unsigned long long)p90, (unsigned long long)p99,
+               (unsigned long long)p999, (unsigned long long)hist->max, mean);
+        break;
+    case REPORT_CSV:
+        printf("side,mechanism,messages,bytes,total_time_s,elapsed_s,msgs_per_sec,bytes_per_sec,"
+               "lat_min_ns,lat_p50_ns,lat_p90_ns,lat_p99_ns,lat_p999_ns,lat_max_ns,lat_mean_ns\n");
+        printf("%s,%s,%llu,%llu,%.9f,%.9f,%.1f,%.1f,%llu,%llu,%llu,%llu,%llu,%llu,%.1f\n",
+               side, mechanism, (unsigned long long)stats->messages,
+               (unsigned long long)stats->bytes, total_time, elapsed, msgs_per_sec, bytes_per_sec,
+               (unsigned long long)hist->min, (unsigned long long)p50,
+               (unsigned long long)p90, (unsigned long long)p99,
+               (unsigned long long)p999, (unsigned long long)hist->max, mean);
+        break;
+    case REPORT_JSON:
+        printf("{\"side\":\"%s\",\"mechanism\":\"%s\",\"messages\":%llu,\"bytes\":%llu,"
+               "\"total_time_s\":%.9f,\"elapsed_s\":%.9f,\"msgs_per_sec\":%.1f,\"bytes_per_sec\":%.1f,"
+               "\"latency_ns\":{\"min\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+               "\"p99_9\":%llu,\"max\":%llu,\"mean\":%.1f}}\n",
+               side, mechanism, (unsigned long long)stats->messages,
+               (unsigned long long)stats->bytes, total_time, elapsed, msgs_per_sec, bytes_per_sec,
+               (unsigned long long)hist->min, (unsigned long long)p50,
+               (unsigned long long)p90, (unsigned long long)p99,
+               (unsigned long long)p999, (unsigned long long)hist->max, mean);
+        break;
+    }
+}
+
+#endif
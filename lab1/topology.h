@@ -0,0 +1,78 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+    Who shares a mailbox: N producers (senders) and M consumers (receivers).
+
+    Message passing (modes 1 and 4) shards by mType: consumer c drains
+    mType c + 1 and every sender spreads its lines (frames in mode 4) over
+    the channels round-robin. The ring (mode 3) keeps every pair SPSC: the
+    segment holds producers x consumers rings, ring[p * consumers + c] is only
+    written by sender p and read by receiver c.
+
+    Each sender ends every channel with an exit message, a receiver stops
+    after it has seen one from every producer. The lockstep semaphore
+    handshake is only kept for the classic 1:1 setup.
+
+    -k <key> moves all System V keys and semaphore names, so several
+    independent mailboxes can run side by side.
+*/
+
+// Default System V keys (shared by sender and receiver)
+#define MSG_KEY 1234
+#define SHM_KEY 5678
+#define RING_KEY 5679
+
+// Default semaphore names
+#define SEM_SENDER "/sem_sender"
+#define SEM_RECEIVER "/sem_receiver"
+#define SEM_DONE "/sem_done"
+
+typedef struct {
+    int id;             // index of this sender among producers / receiver among consumers
+    int producers;
+    int consumers;
+    key_t msg_key;
+    key_t shm_key;
+    key_t ring_key;
+    char sem_sender[32];
+    char sem_receiver[32];
+    char sem_done[32];  // counts receivers that finished, the last one cleans up
+} topology_t;
+
+// base_key 0 keeps the original keys and names
+static void topology_init(topology_t *topo, int base_key){
+    topo->id = 0;
+    topo->producers = 1;
+    topo->consumers = 1;
+
+    if (base_key == 0) {
+        topo->msg_key = MSG_KEY;
+        topo->shm_key = SHM_KEY;
+        topo->ring_key = RING_KEY;
+        snprintf(topo->sem_sender, sizeof(topo->sem_sender), "%s", SEM_SENDER);
+        snprintf(topo->sem_receiver, sizeof(topo->sem_receiver), "%s", SEM_RECEIVER);
+        snprintf(topo->sem_done, sizeof(topo->sem_done), "%s", SEM_DONE);
+    } else {
+        topo->msg_key = base_key;
+        topo->shm_key = base_key + 1;
+        topo->ring_key = base_key + 2;
+        snprintf(topo->sem_sender, sizeof(topo->sem_sender), "%s_%d", SEM_SENDER, base_key);
+        snprintf(topo->sem_receiver, sizeof(topo->sem_receiver), "%s_%d", SEM_RECEIVER, base_key);
+        snprintf(topo->sem_done, sizeof(topo->sem_done), "%s_%d", SEM_DONE, base_key);
+    }
+}
+
+// More than one process on either side: no lockstep handshake, shard instead
+static inline int topology_shared(const topology_t *topo){
+    return topo->producers > 1 || topo->consumers > 1;
+}
+
+static inline int topology_rings(const topology_t *topo){
+    return topo->producers * topo->consumers;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <semaphore.h>
+#include "ring.h"
+
+/*
+    How a process waits for its peer in the lockstep semaphore handshake.
+
+    block: plain sem_wait, sleeps in the kernel (futex) right away.
+    spin:  try sem_trywait up to `spins` times with a pause in between, then
+           fall back to sem_wait. The peer usually posts within a few hundred
+           nanoseconds, so the futex sleep and wakeup are mostly avoided.
+    poll:  never sleep, spin on sem_trywait. Only sensible when both
+           processes are pinned to their own cores (-a).
+
+    sem_trywait on an unlocked glibc semaphore is a single atomic in user
+    space, and sem_post only enters the kernel when the peer is asleep.
+*/
+
+#define WAIT_BLOCK 0
+#define WAIT_SPIN 1
+#define WAIT_POLL 2
+#define WAIT_DEFAULT_SPINS 4096
+
+typedef struct {
+    int mode;
+    long spins;     // WAIT_SPIN: sem_trywait attempts before blocking
+} wait_strategy_t;
+
+static inline void handshake_wait(sem_t *sem, const wait_strategy_t *wait){
+    switch (wait->mode) {
+    case WAIT_SPIN:
+        for (long i = 0; i < wait->spins; i++) {
+            if (sem_trywait(sem) == 0)
+                return;
+            cpu_relax();
+        }
+        break;
+    case WAIT_POLL:
+        while (sem_trywait(sem) != 0)
+            cpu_relax();
+        return;
+    }
+    sem_wait(sem);
+}
+
+// Parse the -w argument: block, spin, spin:N or poll. Returns -1 on error.
+static int wait_parse(wait_strategy_t *wait, const char *arg){
+    wait->spins = WAIT_DEFAULT_SPINS;
+
+    if (strcmp(arg, "block") == 0) {
+        wait->mode = WAIT_BLOCK;
+    } else if (strcmp(arg, "poll") == 0) {
+        wait->mode = WAIT_POLL;
+    } else if (strncmp(arg, "spin", 4) == 0 && (arg[4] == '\0' || arg[4] == ':')) {
+        wait->mode = WAIT_SPIN;
+        if (arg[4] == ':') {
+            wait->spins = atol(arg + 5);
+            if (wait->spins <= 0)
+                return -1;
+        }
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Pin the calling process to one CPU (-a), so spinning never fights its peer for a core
+static int pin_cpu(int cpu){
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE 4096
+#define ARENA_ALIGN 8
+
+/*
+ * Bump allocator for everything that lives as long as one input line: the
+ * line buffer, the cmd / cmd_node structures and their args vectors.
+ * arena_reset() releases it all at once but keeps the chunks, so once the
+ * arena has grown to fit the longest line, parsing does not call malloc.
+ */
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct arena {
+	struct arena_chunk *head;
+	struct arena_chunk *current;
+};
+
+void *arena_alloc(struct arena *arena, size_t size);
+void arena_reset(struct arena *arena);
+void arena_free(struct arena *arena);
+
+#endif
@@ -12,6 +12,11 @@ int cd(char **args);
 int echo(char **args);
 int exit_shell(char **args);
 int record(char **args);
+int hash_cmd(char **args);
+int wait_cmd(char **args);
+int stats_cmd(char **args);
+int cat(char **args);
+int pipesize(char **args);
 
 extern const char *builtin_str[];
 
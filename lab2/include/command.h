@@ -1,14 +1,18 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
-#define MAX_RECORD_NUM 16
+#define MAX_RECORD_NUM 16	// entries "record" shows by default
 #define BUF_SIZE 1024
+#define ARGS_INIT_SIZE 8
 
+#include <stdio.h>
 #include <stdbool.h>
+#include "arena.h"
 
 struct cmd_node {
 	char **args;
 	int length;
+	int capacity;	// slots in args, grows on demand
 	char *in_file, *out_file;
 	int in,out;
 	struct cmd_node *next;
@@ -18,13 +22,11 @@ struct cmd_node {
 struct cmd {
 	struct cmd_node *head;
 	int pipe_num;
+	bool background;	// ended with "&"
 };
 
-extern char *history[MAX_RECORD_NUM];
-extern int history_count;
-
-char *read_line();
-struct cmd *split_line(char *);
+char *read_line(struct arena *, FILE *);
+struct cmd *split_line(char *, struct arena *);
 void test_cmd_struct(struct cmd *);
 void test_pipe_struct(struct cmd_node *pipe);
 #endif
@@ -0,0 +1,21 @@
+#ifndef FASTCOPY_H
+#define FASTCOPY_H
+
+#include <sys/types.h>
+
+#define COPY_CHUNK (1 << 20)
+
+/*
+ * In-kernel copies between file descriptors, so the cat built-in does
+ * not bounce data through user space (redirection of the other built-ins
+ * dup2()s the file or pipe onto stdout, there is no copy to replace):
+ * copy_file_range for file -> file, splice when either side is a pipe,
+ * sendfile from a file to anything else, read/write as the last resort.
+ */
+
+extern int pipe_size;	// F_SETPIPE_SZ for new pipeline pipes, 0 keeps the kernel default
+
+ssize_t fd_copy(int in, int out);
+void pipe_tune(int fd);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+
+#define HISTORY_FILE ".my_shell_history"
+
+/*
+ * Command history, persistent across sessions.
+ *
+ * The history file is an append-only log, one command per line. At startup
+ * it is only mmapped, nothing is read or parsed, so startup cost does not
+ * depend on its size. Commands of this session are appended to the file
+ * and kept in memory. The line-offset index, and the sorted prefix index
+ * used by "!prefix", are built the first time they are needed.
+ *
+ * Entries are numbered from 1 (oldest) to history_length().
+ */
+
+void history_init(const char *path);
+void history_close();
+void history_add(const char *line);
+int history_length();
+const char *history_get(int n, size_t *len);
+int history_find_prefix(const char *prefix, size_t len);
+int history_find_substring(const char *text, int before);
+int history_expand(char *line, size_t size);
+
+#endif
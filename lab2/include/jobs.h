@@ -0,0 +1,31 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "stats.h"
+
+#define MAX_JOBS 64
+
+/*
+ * Background jobs started with "&". A job is one pipeline: the stages
+ * (pid and start time), it is done when all of them have been reaped. At most
+ * max_jobs run at the same time, starting another one first waits for a
+ * running job to finish (like xargs -P).
+ */
+struct job {
+	int id;
+	struct stage *stages;
+	int count;
+	int remaining;	// stages not reaped yet
+};
+
+extern int max_jobs;
+
+void job_throttle();
+int job_add(struct stage *stages, int count);
+int job_reap(bool block, bool report);
+int job_wait(int id);
+void job_wait_all();
+
+#endif
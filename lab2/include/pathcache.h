@@ -0,0 +1,24 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#define PATH_CACHE_BUCKETS 64
+
+/*
+ * Command name -> absolute path cache, so that running a command does not
+ * re-walk every $PATH directory with failed execve() attempts each time.
+ * The whole table is dropped when $PATH changes; a single entry is dropped
+ * when its file disappears (ENOENT on spawn).
+ */
+struct path_entry {
+	char *name;
+	char *path;
+	int hits;
+	struct path_entry *next;
+};
+
+const char *path_lookup(const char *name);
+void path_forget(const char *name);
+void path_clear();
+void path_print();
+
+#endif
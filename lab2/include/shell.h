@@ -6,6 +6,6 @@
 int spawn_proc(struct cmd_node *);
 int fork_cmd_node(struct cmd *cmd);
 void redirection(struct cmd_node *cmd);
-void shell();
+void shell(FILE *input, bool interactive);
 
 #endif
@@ -0,0 +1,46 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define STATS_MAX_COMMANDS 64
+#define STATS_NAME_SIZE 32
+
+/*
+ * Cost of one pipeline stage, filled from wait4() for children and from
+ * getrusage(RUSAGE_SELF) deltas for built-ins that run in the shell.
+ * "time" prints the stages of the command it prefixes; with stats on,
+ * every stage is also added to a per-command table ("stats" builtin).
+ */
+struct stage {
+	pid_t pid;			// 0 for a built-in run in the shell process
+	char name[STATS_NAME_SIZE];
+	struct timespec start;
+	double wall, user, sys;		// seconds
+	long maxrss;			// KB
+	long nvcsw, nivcsw;		// voluntary / involuntary context switches
+};
+
+struct stats_entry {
+	char name[STATS_NAME_SIZE];
+	long runs;
+	double wall, user, sys;
+	long maxrss;			// largest seen
+	long nvcsw, nivcsw;
+};
+
+extern bool stats_enabled;
+
+void stage_start(struct stage *s, pid_t pid, const char *name);
+void stage_end(struct stage *s, const struct rusage *ru);
+void stage_end_self(struct stage *s, const struct rusage *before);
+void stats_begin();
+void time_report();
+void stats_print(char **names);
+void stats_reset();
+
+#endif
@@ -1,20 +1,85 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "include/shell.h"
 #include "include/command.h"
+#include "include/jobs.h"
+#include "include/stats.h"
+#include "include/history.h"
+#include "include/fastcopy.h"
 
-int history_count;
-char *history[MAX_RECORD_NUM];
-
+/*
+ * my_shell                     interactive, reads the terminal
+ * my_shell script              runs the lines of script
+ * my_shell -c "command"        runs command (may hold several lines)
+ * -j n                         at most n background jobs at a time, default: online CPUs
+ * -s                           collect per-command stats from the start (see "stats")
+ * -p bytes                     capacity of pipeline pipes (see "pipesize")
+ *
+ * Interactive sessions keep their history in $MY_SHELL_HISTFILE, by default ~/.my_shell_history
+ */
 int main(int argc, char *argv[])
 {
-	history_count = 0;
-	for (int i = 0; i < MAX_RECORD_NUM; ++i)
-    	history[i] = (char *)malloc(BUF_SIZE * sizeof(char));
+	char *command = NULL;
+	int opt;
+
+	max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (max_jobs < 1)
+		max_jobs = 1;
+
+	while ((opt = getopt(argc, argv, "c:j:sp:")) != -1) {
+		switch (opt) {
+		case 'c':
+			command = optarg;
+			break;
+		case 'j':
+			max_jobs = atoi(optarg);
+			if (max_jobs < 1) {
+				fprintf(stderr, "%s: -j expects a positive number\n", argv[0]);
+				return 1;
+			}
+			break;
+		case 's':
+			stats_enabled = true;
+			break;
+		case 'p':
+			pipe_size = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-j jobs] [-s] [-p pipe_bytes] [-c command | script]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	FILE *input = stdin;
+	bool interactive = true;
+	if (command) {
+		input = fmemopen(command, strlen(command), "r");
+		interactive = false;
+	} else if (optind < argc) {
+		input = fopen(argv[optind], "r");
+		interactive = false;
+	}
+	if (input == NULL) {
+		perror(command ? "fmemopen" : argv[optind]);
+		return 1;
+	}
+
+	char path[BUF_SIZE];
+	const char *histfile = getenv("MY_SHELL_HISTFILE");
+	if (histfile == NULL && getenv("HOME")) {
+		snprintf(path, sizeof(path), "%s/%s", getenv("HOME"), HISTORY_FILE);
+		histfile = path;
+	}
+	// Scripts do not add to the persistent history
+	history_init(interactive ? histfile : NULL);
 
-	shell();
+	shell(input, interactive);
 
-	for (int i = 0; i < MAX_RECORD_NUM; ++i)
-    	free(history[i]);
+	history_close();
+	if (input != stdin)
+		fclose(input);
 
 	return 0;
 }
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/arena.h"
+
+/**
+ * @brief Allocate size bytes that stay valid until the next arena_reset()
+ *
+ * @param arena Arena
+ * @param size Bytes wanted
+ * @return void*
+ * Return aligned storage, never NULL (exits when out of memory)
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	// Reuse the chunks kept by earlier lines before asking for a new one
+	struct arena_chunk *c = arena->current;
+	while (c && c->used + size > c->size)
+		c = c->next;
+
+	if (c == NULL) {
+		size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+		c = (struct arena_chunk *)malloc(sizeof(struct arena_chunk) + chunk_size);
+		if (c == NULL) {
+			perror("Unable to allocate arena");
+			exit(1);
+		}
+		c->size = chunk_size;
+		c->used = 0;
+		c->next = NULL;
+		// Append, so the chain keeps its order and a reset walks it from the start
+		if (arena->head == NULL) {
+			arena->head = c;
+		} else {
+			struct arena_chunk *tail = arena->current ? arena->current : arena->head;
+			while (tail->next)
+				tail = tail->next;
+			tail->next = c;
+		}
+	}
+
+	arena->current = c;
+	void *p = c->data + c->used;
+	c->used += size;
+	return p;
+}
+
+/**
+ * @brief Release every allocation at once, the chunks are kept for reuse
+ */
+void arena_reset(struct arena *arena)
+{
+	for (struct arena_chunk *c = arena->head; c; c = c->next)
+		c->used = 0;
+	arena->current = arena->head;
+}
+
+/**
+ * @brief Give the chunks back to malloc
+ */
+void arena_free(struct arena *arena)
+{
+	while (arena->head) {
+		struct arena_chunk *c = arena->head;
+		arena->head = c->next;
+		free(c);
+	}
+	arena->current = NULL;
+}
@@ -7,6 +7,11 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include "../include/builtin.h"
+#include "../include/pathcache.h"
+#include "../include/jobs.h"
+#include "../include/stats.h"
+#include "../include/history.h"
+#include "../include/fastcopy.h"
 
 /**
  * @brief 
@@ -18,6 +23,14 @@
  */
 int searchBuiltInCommand(struct cmd_node *cmd)
 {
+	if (cmd->args[0] == NULL)
+		return -1;
+	// The built-in cat has no options, leave those to the real one
+	if (strcmp(cmd->args[0], "cat") == 0) {
+		for (int i = 1; cmd->args[i]; ++i)
+			if (cmd->args[i][0] == '-' && cmd->args[i][1] != '\0')
+				return -1;
+	}
 	for (int i = 0; i < num_builtins(); ++i){
 		if (strcmp(cmd->args[0], builtin_str[i]) == 0){
 			return i;
@@ -102,15 +115,140 @@ int exit_shell(char **args)
 	return 0;
 }
 
+static void print_record(int n)
+{
+	size_t len;
+	const char *text = history_get(n, &len);
+	printf("%2d: %.*s\n", n, (int)len, text);
+}
+
+/**
+ * @brief Show the command history, numbered for !n
+ * "record" shows the last MAX_RECORD_NUM entries, "record n" the last n,
+ * "record -s text" all entries containing text, "record -p prefix" the
+ * newest entry starting with prefix
+ */
 int record(char **args)
 {
-	if (history_count < MAX_RECORD_NUM) {
-		for (int i = 0; i < history_count; ++i)
-			printf("%2d: %s\n", i + 1, history[i]);
+	int count = history_length();
+
+	if (args[1] && strcmp(args[1], "-s") == 0 && args[2]) {
+		for (int n = history_find_substring(args[2], 0); n; n = history_find_substring(args[2], n))
+			print_record(n);
+		return 1;
+	}
+	if (args[1] && strcmp(args[1], "-p") == 0 && args[2]) {
+		int n = history_find_prefix(args[2], strlen(args[2]));
+		if (n)
+			print_record(n);
+		return 1;
+	}
+
+	int shown = args[1] ? atoi(args[1]) : MAX_RECORD_NUM;
+	for (int n = shown < count ? count - shown + 1 : 1; n <= count; ++n)
+		print_record(n);
+	return 1;
+}
+
+/**
+ * @brief Show or fill the command path cache
+ * "hash" lists it, "hash -r" empties it, "hash name..." looks the names up now
+ */
+int hash_cmd(char **args)
+{
+	if (args[1] == NULL) {
+		path_print();
+		return 1;
+	}
+	if (strcmp(args[1], "-r") == 0) {
+		path_clear();
+		return 1;
+	}
+	for (int i = 1; args[i]; ++i) {
+		if (path_lookup(args[i]) == NULL)
+			fprintf(stderr, "hash: %s: not found\n", args[i]);
+	}
+	return 1;
+}
+
+/**
+ * @brief Wait for background jobs
+ * "wait" waits for all of them, "wait n" (or "wait %n") for job n
+ */
+int wait_cmd(char **args)
+{
+	if (args[1] == NULL) {
+		job_wait_all();
+		return 1;
+	}
+	for (int i = 1; args[i]; ++i) {
+		const char *id = args[i][0] == '%' ? args[i] + 1 : args[i];
+		if (job_wait(atoi(id)) < 0)
+			fprintf(stderr, "wait: %s: no such job\n", args[i]);
+	}
+	return 1;
+}
+
+/**
+ * @brief Per-command cost table, a companion to record
+ * "stats" prints it, "stats on" / "stats off" switch collecting,
+ * "stats -r" empties it, "stats name..." shows only those commands
+ */
+int stats_cmd(char **args)
+{
+	if (args[1] && strcmp(args[1], "on") == 0) {
+		stats_enabled = true;
+	} else if (args[1] && strcmp(args[1], "off") == 0) {
+		stats_enabled = false;
+	} else if (args[1] && strcmp(args[1], "-r") == 0) {
+		stats_reset();
 	} else {
-		for (int i = history_count % MAX_RECORD_NUM; i < history_count % MAX_RECORD_NUM + MAX_RECORD_NUM; ++i)
-			printf("%2d: %s\n", i - history_count % MAX_RECORD_NUM + 1, history[i % MAX_RECORD_NUM]);
+		if (!stats_enabled && args[1] == NULL)
+			printf("stats: collecting is off, use \"stats on\" or my_shell -s\n");
+		stats_print(args + 1);
+	}
+	return 1;
+}
+
+/**
+ * @brief Concatenate files (or stdin) to stdout with in-kernel copies
+ * "-" or no argument reads stdin; see fd_copy() for the copy methods
+ */
+int cat(char **args)
+{
+	fflush(stdout);
+	if (args[1] == NULL) {
+		if (fd_copy(STDIN_FILENO, STDOUT_FILENO) < 0)
+			perror("cat");
+		return 1;
+	}
+	for (int i = 1; args[i]; ++i) {
+		int fd = strcmp(args[i], "-") == 0 ? STDIN_FILENO : open(args[i], O_RDONLY);
+		if (fd < 0) {
+			perror(args[i]);
+			continue;
+		}
+		if (fd_copy(fd, STDOUT_FILENO) < 0)
+			perror(args[i]);
+		if (fd != STDIN_FILENO)
+			close(fd);
+	}
+	return 1;
+}
+
+/**
+ * @brief Capacity of the pipes created for the following pipelines
+ * "pipesize" prints it, "pipesize n" sets it (bytes, 0 for the kernel default)
+ */
+int pipesize(char **args)
+{
+	if (args[1] == NULL) {
+		printf("%d\n", pipe_size);
+		return 1;
 	}
+	pipe_size = atoi(args[1]);
+	if (pipe_size < 0)
+		pipe_size = 0;
 	return 1;
 }
 
@@ -121,6 +259,11 @@ const char *builtin_str[] = {
 	"echo",
  	"exit",
  	"record",
+	"hash",
+	"wait",
+	"stats",
+	"cat",
+	"pipesize",
 };
 
 const int (*builtin_func[]) (char **) = {
@@ -130,6 +273,11 @@ const int (*builtin_func[]) (char **) = {
 	&echo,
 	&exit_shell,
   	&record,
+	&hash_cmd,
+	&wait_cmd,
+	&stats_cmd,
+	&cat,
+	&pipesize,
 };
 
 int num_builtins() {
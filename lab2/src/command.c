@@ -3,84 +3,99 @@
 #include <stdbool.h>
 #include <string.h>
 #include "../include/command.h"
+#include "../include/history.h"
 
 /**
  * @brief Read the user's input string
  * 
+ * @param arena Arena of the current line, the buffer lives in it
+ * @param input Terminal, script file or -c string
  * @return char* 
- * Return string
+ * Return string, NULL for an empty or comment line and at EOF (check feof)
  */
-char *read_line()
+char *read_line(struct arena *arena, FILE *input)
 {
-    char *buffer = (char *)malloc(BUF_SIZE * sizeof(char));
-    if (buffer == NULL) {
-        perror("Unable to allocate buffer");
-        exit(1);
-    }
+    char *buffer = (char *)arena_alloc(arena, BUF_SIZE * sizeof(char));
 
-	if (fgets(buffer, BUF_SIZE, stdin) != NULL) {
-		if (buffer[0] == '\n' || buffer[0] == ' ' || buffer[0] == '\t') {
-			free(buffer);
+	if (fgets(buffer, BUF_SIZE, input) == NULL) {
+		buffer = NULL;
+	} else {
+		if (buffer[0] == '\n' || buffer[0] == ' ' || buffer[0] == '\t' || buffer[0] == '#') {
 			buffer = NULL;
 		} 
 		else {
 			buffer[strcspn(buffer, "\n")] = 0;
-			strncpy(history[history_count % MAX_RECORD_NUM], buffer, BUF_SIZE);
-			++history_count;
+			// !n / !prefix are replaced before the line is run or recorded
+			if (history_expand(buffer, BUF_SIZE) < 0)
+				return NULL;
+			history_add(buffer);
 		}
 	}
 
 	return buffer;
 }
 
+// Empty cmd_node with room for ARGS_INIT_SIZE arguments
+static struct cmd_node *new_cmd_node(struct arena *arena)
+{
+	struct cmd_node *node = (struct cmd_node *)arena_alloc(arena, sizeof(struct cmd_node));
+	node->capacity = ARGS_INIT_SIZE;
+	node->args = (char **)arena_alloc(arena, node->capacity * sizeof(char *));
+	node->args[0] = NULL;
+	node->length = 0;
+	node->next = NULL;
+	node->in_file  = NULL;
+	node->out_file = NULL;
+	node->in = 0;
+	node->out = 1;
+	return node;
+}
+
+// Append one argument, doubling the vector when it is full (args stays NULL terminated)
+static void push_arg(struct arena *arena, struct cmd_node *node, char *token)
+{
+	if (node->length + 1 >= node->capacity) {
+		char **args = (char **)arena_alloc(arena, 2 * node->capacity * sizeof(char *));
+		memcpy(args, node->args, node->length * sizeof(char *));
+		node->args = args;
+		node->capacity *= 2;
+	}
+	node->args[node->length++] = token;
+	node->args[node->length] = NULL;
+}
+
 /**
  * @brief Parse the user's command
  * 
  * @param line User input command
+ * @param arena Arena of the current line, every node is allocated from it
  * @return struct cmd* 
  * Return the parsed cmd structure
  */
-struct cmd *split_line(char *line)
+struct cmd *split_line(char *line, struct arena *arena)
 {
-	int args_length = 10;
-    struct cmd *new_cmd = (struct cmd *)malloc(sizeof(struct cmd));
-    new_cmd->head = (struct cmd_node *)malloc(sizeof(struct cmd_node));
-    new_cmd->head->args = (char **)malloc(args_length * sizeof(char *));
-	for (int i = 0; i < args_length; ++i)
-		new_cmd->head->args[i] = NULL;
-    new_cmd->head->length = 0;
-    new_cmd->head->next = NULL;
+    struct cmd *new_cmd = (struct cmd *)arena_alloc(arena, sizeof(struct cmd));
+    new_cmd->head = new_cmd_node(arena);
 	new_cmd->pipe_num = 0;
+	new_cmd->background = false;
 
 	struct cmd_node *temp = new_cmd->head;
-	temp->in_file 	= NULL;
-	temp->out_file 	= NULL;
-	temp->in       	= 0;
-	temp->out 		= 1;
     char *token = strtok(line, " ");
     while (token != NULL) {
         if (token[0] == '|') {
-            struct cmd_node *new_pipe = (struct cmd_node *)malloc(sizeof(struct cmd_node));
-			new_pipe->args = (char **)malloc(args_length * sizeof(char *));
-			for (int i = 0; i < args_length; ++i)
-				new_pipe->args[i] = NULL;
-			new_pipe->length = 0;
-			new_pipe->next = NULL;
-			new_pipe->in_file  = NULL;
-    		new_pipe->out_file = NULL;
-		    new_pipe->in = 0;  
-    		new_pipe->out = 1; 
+            struct cmd_node *new_pipe = new_cmd_node(arena);
 			temp->next = new_pipe;
 			temp = new_pipe;
         } else if (token[0] == '<') {
 			token = strtok(NULL, " ");
             temp->in_file = token;
+        } else if (token[0] == '&') {
+            new_cmd->background = true;
         } else if (token[0] == '>') {
 			token = strtok(NULL, " ");
             temp->out_file = token;
         } else {
-			temp->args[temp->length] = token;
-			temp->length++;
+			push_arg(arena, temp, token);
         }
         token = strtok(NULL, " ");
 		new_cmd->pipe_num++;
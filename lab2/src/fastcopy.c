@@ -0,0 +1,96 @@
+#define _GNU_SOURCE  // splice, copy_file_range, F_SETPIPE_SZ
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "../include/command.h"
+#include "../include/fastcopy.h"
+
+int pipe_size = 0;
+
+// The method does not apply to this pair of descriptors, try the next one
+static bool unsupported(int err)
+{
+	return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP ||
+		   err == EBADF || err == ESPIPE;
+}
+
+/**
+ * @brief Copy everything from in (at its current offset) to out
+ * Each method advances the file offsets, so a later one picks up where an
+ * unsupported one stopped.
+ *
+ * @param in Source descriptor
+ * @param out Destination descriptor
+ * @return ssize_t
+ * Return the bytes copied, -1 on error (errno set)
+ */
+ssize_t fd_copy(int in, int out)
+{
+	struct stat in_st, out_st;
+	ssize_t total = 0, n;
+
+	if (fstat(in, &in_st) < 0 || fstat(out, &out_st) < 0)
+		return -1;
+	bool in_file = S_ISREG(in_st.st_mode), out_file = S_ISREG(out_st.st_mode);
+	bool pipes = S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode);
+
+	if (in_file && out_file) {
+		while ((n = copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0)) > 0)
+			total += n;
+		if (n == 0)
+			return total;
+		if (!unsupported(errno))
+			return -1;
+	}
+	if (pipes) {
+		while ((n = splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+			total += n;
+		if (n == 0)
+			return total;
+		if (!unsupported(errno))
+			return -1;
+	}
+	if (in_file) {
+		while ((n = sendfile(out, in, NULL, COPY_CHUNK)) > 0)
+			total += n;
+		if (n == 0)
+			return total;
+		if (!unsupported(errno))
+			return -1;
+	}
+
+	char buf[BUF_SIZE * 64];
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		for (ssize_t done = 0; done < n; ) {
+			ssize_t w = write(out, buf + done, n - done);
+			if (w < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			done += w;
+		}
+		total += n;
+	}
+	return n < 0 ? -1 : total;
+}
+
+/**
+ * @brief Apply the configured capacity to a new pipe
+ */
+void pipe_tune(int fd)
+{
+	static bool warned;
+
+	if (pipe_size <= 0)
+		return;
+	// Above /proc/sys/fs/pipe-max-size an unprivileged process gets EPERM
+	if (fcntl(fd, F_SETPIPE_SZ, pipe_size) < 0 && !warned) {
+		perror("pipesize: F_SETPIPE_SZ");
+		warned = true;
+	}
+}
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE  // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "../include/history.h"
+
+static int fd = -1;
+
+// Entries of earlier sessions: the history file as it was at startup
+static const char *map;
+static size_t map_size;
+static size_t *offsets;		// offsets[k - 1]: start of entry k, offsets[mapped_count]: end
+static int mapped_count;
+static bool indexed;
+
+// Prefix index over the mapped entries: entry numbers sorted by text, plus
+// a max segment tree over that order so the newest match in a range is O(log n)
+static int *sorted;
+static int *tree;
+static bool prefix_indexed;
+
+// Entries added in this session (also appended to the file)
+static char **session;
+static int session_count, session_size;
+
+static void index_lines()
+{
+	if (indexed)
+		return;
+	indexed = true;
+
+	int count = 0;
+	for (const char *p = map, *end = map + map_size; p < end; ++count) {
+		const char *nl = memchr(p, '\n', end - p);
+		p = nl ? nl + 1 : end;
+	}
+
+	offsets = (size_t *)malloc((count + 1) * sizeof(size_t));
+	size_t pos = 0;
+	for (int i = 0; i < count; ++i) {
+		offsets[i] = pos;
+		const char *nl = memchr(map + pos, '\n', map_size - pos);
+		// A last line without '\n' (interrupted write) still counts as an entry
+		pos = nl ? (size_t)(nl - map) + 1 : map_size + 1;
+	}
+	offsets[count] = pos;
+	mapped_count = count;
+}
+
+/**
+ * @brief Map the history file of earlier sessions
+ *
+ * @param path History file, NULL keeps the history in memory only
+ */
+void history_init(const char *path)
+{
+	indexed = true;		// nothing mapped yet, nothing to index
+	if (path == NULL)
+		return;
+
+	fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+	if (fd < 0) {
+		perror(path);
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			perror("history: mmap");
+			map = NULL;
+		} else {
+			map_size = st.st_size;
+			indexed = false;
+		}
+	}
+}
+
+/**
+ * @brief Unmap the file and drop the in-memory entries
+ */
+void history_close()
+{
+	if (map)
+		munmap((void *)map, map_size);
+	if (fd >= 0)
+		close(fd);
+	for (int i = 0; i < session_count; ++i)
+		free(session[i]);
+	free(session);
+	free(offsets);
+	free(sorted);
+	free(tree);
+}
+
+/**
+ * @brief Append one command to the history and to the history file
+ */
+void history_add(const char *line)
+{
+	if (session_count == session_size) {
+		session_size = session_size ? 2 * session_size : 64;
+		session = (char **)realloc(session, session_size * sizeof(char *));
+	}
+	session[session_count++] = strdup(line);
+
+	if (fd >= 0) {
+		struct iovec iov[2] = {
+			{ (void *)line, strlen(line) },
+			{ "\n", 1 },
+		};
+		if (writev(fd, iov, 2) < 0)
+			perror("history: write");
+	}
+}
+
+/**
+ * @brief Number of entries, the newest one is history_length()
+ */
+int history_length()
+{
+	index_lines();
+	return mapped_count + session_count;
+}
+
+/**
+ * @brief Text of entry n (1-based), not '\0' terminated for old entries
+ *
+ * @param n Entry number
+ * @param len Stores the length of the text
+ * @return const char*
+ * Return the text, NULL if there is no entry n
+ */
+const char *history_get(int n, size_t *len)
+{
+	index_lines();
+	if (n < 1 || n > mapped_count + session_count)
+		return NULL;
+	if (n <= mapped_count) {
+		*len = offsets[n] - offsets[n - 1] - 1;
+		return map + offsets[n - 1];
+	}
+	*len = strlen(session[n - mapped_count - 1]);
+	return session[n - mapped_count - 1];
+}
+
+// < 0 before the block of entries starting with prefix, 0 inside it, > 0 after it
+static int prefix_cmp(int n, const char *prefix, size_t len)
+{
+	size_t elen;
+	const char *text = history_get(n, &elen);
+	int r = memcmp(text, prefix, elen < len ? elen : len);
+	if (r != 0)
+		return r;
+	return elen < len ? -1 : 0;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+	size_t xlen, ylen;
+	const char *xt = history_get(x, &xlen), *yt = history_get(y, &ylen);
+	int r = memcmp(xt, yt, xlen < ylen ? xlen : ylen);
+	if (r != 0)
+		return r;
+	if (xlen != ylen)
+		return xlen < ylen ? -1 : 1;
+	return x - y;
+}
+
+static void index_prefixes()
+{
+	if (prefix_indexed)
+		return;
+	prefix_indexed = true;
+	index_lines();
+
+	int m = mapped_count;
+	sorted = (int *)malloc((m + 1) * sizeof(int));
+	tree = (int *)malloc((2 * m + 1) * sizeof(int));
+	for (int i = 0; i < m; ++i)
+		sorted[i] = i + 1;
+	qsort(sorted, m, sizeof(int), entry_cmp);
+
+	for (int i = 0; i < m; ++i)
+		tree[m + i] = sorted[i];
+	for (int i = m - 1; i > 0; --i)
+		tree[i] = tree[2 * i] > tree[2 * i + 1] ? tree[2 * i] : tree[2 * i + 1];
+}
+
+// Newest entry number among sorted[lo, hi)
+static int newest_in(int lo, int hi)
+{
+	int m = mapped_count, best = 0;
+	for (lo += m, hi += m; lo < hi; lo /= 2, hi /= 2) {
+		if (lo & 1) {
+			if (tree[lo] > best)
+				best = tree[lo];
+			lo++;
+		}
+		if (hi & 1) {
+			hi--;
+			if (tree[hi] > best)
+				best = tree[hi];
+		}
+	}
+	return best;
+}
+
+/**
+ * @brief Newest entry starting with prefix
+ *
+ * @return int
+ * Return its number, 0 if there is none
+ */
+int history_find_prefix(const char *prefix, size_t len)
+{
+	// This session's entries are the newest, they are few: scan them first
+	for (int i = session_count - 1; i >= 0; --i) {
+		if (strncmp(session[i], prefix, len) == 0)
+			return mapped_count + i + 1;
+	}
+
+	index_prefixes();
+	int lo = 0, hi = mapped_count;
+	while (lo < hi) {	// first position not before the prefix block
+		int mid = (lo + hi) / 2;
+		if (prefix_cmp(sorted[mid], prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	int first = lo;
+	hi = mapped_count;
+	while (lo < hi) {	// first position after it
+		int mid = (lo + hi) / 2;
+		if (prefix_cmp(sorted[mid], prefix, len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return first < lo ? newest_in(first, lo) : 0;
+}
+
+/**
+ * @brief Oldest entry after entry number after that contains text
+ * Old entries are searched with one memmem() pass over the mapping; call
+ * again with the returned number to walk all matches.
+ *
+ * @return int
+ * Return its number, 0 if there is none
+ */
+int history_find_substring(const char *text, int after)
+{
+	size_t len = strlen(text);
+	index_lines();
+	if (after < 0)
+		after = 0;
+
+	if (after < mapped_count && len > 0) {
+		const char *hit = memmem(map + offsets[after], map_size - offsets[after], text, len);
+		if (hit) {
+			// The text has no '\n', so the hit lies inside one entry: find it
+			size_t pos = hit - map;
+			int lo = after, hi = mapped_count - 1;
+			while (lo < hi) {
+				int mid = (lo + hi + 1) / 2;
+				if (offsets[mid] <= pos)
+					lo = mid;
+				else
+					hi = mid - 1;
+			}
+			return lo + 1;
+		}
+	}
+
+	int start = after > mapped_count ? after - mapped_count : 0;
+	for (int i = start; i < session_count; ++i) {
+		if (strstr(session[i], text))
+			return mapped_count + i + 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Expand a leading history event: !!, !n, !-n, !?text or !prefix
+ * The event is replaced by the entry, the rest of the line is kept.
+ *
+ * @param line Input line, rewritten in place
+ * @param size Size of the line buffer
+ * @return int
+ * Return 1 if the line was expanded, 0 if it has no event, -1 if the
+ * event was not found
+ */
+int history_expand(char *line, size_t size)
+{
+	if (line[0] != '!' || line[1] == '\0' || line[1] == ' ')
+		return 0;
+
+	size_t event_len = strcspn(line, " ");
+	char event[event_len + 1];
+	memcpy(event, line, event_len);
+	event[event_len] = '\0';
+
+	int n = 0;
+	if (strcmp(event, "!!") == 0) {
+		n = history_length();
+	} else if (event[1] == '-' && event[2] >= '0' && event[2] <= '9') {
+		n = history_length() + 1 - atoi(event + 2);
+	} else if (event[1] >= '0' && event[1] <= '9') {
+		n = atoi(event + 1);
+	} else if (event[1] == '?') {
+		for (int k = history_find_substring(event + 2, 0); k; k = history_find_substring(event + 2, k))
+			n = k;
+	} else {
+		n = history_find_prefix(event + 1, event_len - 1);
+	}
+
+	size_t len;
+	const char *text = history_get(n, &len);
+	if (text == NULL) {
+		fprintf(stderr, "%s: event not found\n", event);
+		return -1;
+	}
+
+	const char *rest = line + event_len;
+	size_t rest_len = strlen(rest);
+	if (len > size - 1)
+		len = size - 1;
+	if (len + rest_len > size - 1)
+		rest_len = size - 1 - len;
+	memmove(line + len, rest, rest_len);
+	memcpy(line, text, len);
+	line[len + rest_len] = '\0';
+
+	// Show what is actually run, like sh does
+	printf("%s\n", line);
+	return 1;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "../include/jobs.h"
+
+int max_jobs = 1;
+
+static struct job jobs[MAX_JOBS];
+static int running;	// jobs in the table
+static int next_id = 1;
+
+// Find the job a reaped pid belongs to, account the stage and drop the job when its last stage ended
+static int job_exited(pid_t pid, const struct rusage *ru, bool report)
+{
+	for (int i = 0; i < running; ++i) {
+		struct job *j = &jobs[i];
+		for (int k = 0; k < j->count; ++k) {
+			if (j->stages[k].pid != pid)
+				continue;
+			stage_end(&j->stages[k], ru);
+			j->stages[k].pid = -1;
+			if (--j->remaining > 0)
+				return 0;
+
+			int id = j->id;
+			if (report)
+				printf("[%d] Done\n", id);
+			free(j->stages);
+			jobs[i] = jobs[--running];
+			return id;
+		}
+	}
+	return 0;
+}
+
+// Reap the first stage of the table that has exited, return 1 if there was one
+static int job_reap_one(bool report, int *done)
+{
+	struct rusage ru;
+
+	for (int i = 0; i < running; ++i) {
+		for (int k = 0; k < jobs[i].count; ++k) {
+			pid_t pid = jobs[i].stages[k].pid;
+			if (pid <= 0)
+				continue;
+			pid_t r = wait4(pid, NULL, WNOHANG, &ru);
+			if (r == 0 || (r < 0 && errno == EINTR))
+				continue;
+			// ECHILD: someone else reaped it, it is gone all the same
+			if (r < 0)
+				ru = (struct rusage){ 0 };
+			int id = job_exited(pid, &ru, report);
+			if (id)
+				*done = id;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void sigchld_wake(int sig)
+{
+	(void)sig;
+}
+
+/**
+ * @brief Reap finished background processes
+ *
+ * Only the pids in the table are waited for: the "wait" built-in can run
+ * in the shell while the other stages of its own pipeline are still
+ * running, and those belong to the foreground wait4() in fork_cmd_node().
+ * Blocking sleeps in sigsuspend() until the next SIGCHLD and looks again.
+ *
+ * @param block Wait for at least one job to finish instead of polling
+ * @param report Print "[id] Done" for finished jobs
+ * @return int
+ * Return the id of the job that finished last, 0 if none did
+ */
+int job_reap(bool block, bool report)
+{
+	static bool handler;
+	int done = 0;
+	sigset_t chld, old;
+
+	if (!handler) {
+		struct sigaction sa = { .sa_handler = sigchld_wake, .sa_flags = SA_RESTART | SA_NOCLDSTOP };
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGCHLD, &sa, NULL);
+		handler = true;
+	}
+	// SIGCHLD stays blocked between the last look and sigsuspend(), so no exit is missed
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, &old);
+	while (running > 0) {
+		if (job_reap_one(report, &done))
+			continue;
+		if (!block || done)
+			break;
+		sigsuspend(&old);
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return done;
+}
+
+/**
+ * @brief Block until fewer than max_jobs background jobs are running
+ */
+void job_throttle()
+{
+	while (running >= max_jobs || running >= MAX_JOBS)
+		job_reap(true, false);
+}
+
+/**
+ * @brief Register a started pipeline as a background job
+ *
+ * @param stages Started stages, the job table takes ownership (malloc'ed)
+ * @param count Number of stages
+ * @return int
+ * Return the job id
+ */
+int job_add(struct stage *stages, int count)
+{
+	if (count == 0) {
+		free(stages);
+		return 0;
+	}
+	job_throttle();
+	struct job *j = &jobs[running++];
+	j->id = next_id++;
+	j->stages = stages;
+	j->count = count;
+	j->remaining = count;
+	return j->id;
+}
+
+/**
+ * @brief Wait for one background job
+ *
+ * @param id Job id
+ * @return int
+ * Return 0 when the job finished, -1 if there is no such job
+ */
+int job_wait(int id)
+{
+	while (1) {
+		int found = 0;
+		for (int i = 0; i < running; ++i)
+			found |= (jobs[i].id == id);
+		if (!found)
+			return (id > 0 && id < next_id) ? 0 : -1;
+		job_reap(true, false);
+	}
+}
+
+/**
+ * @brief Wait for every background job
+ */
+void job_wait_all()
+{
+	while (running > 0)
+		job_reap(true, false);
+}
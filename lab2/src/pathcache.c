@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/command.h"
+#include "../include/pathcache.h"
+
+static struct path_entry *table[PATH_CACHE_BUCKETS];
+static char *cached_path_env;	// $PATH the table was filled from
+
+static unsigned int path_hash(const char *name)
+{
+	unsigned int h = 5381;
+	while (*name)
+		h = h * 33 + (unsigned char)*name++;
+	return h % PATH_CACHE_BUCKETS;
+}
+
+/**
+ * @brief Drop every cached entry
+ */
+void path_clear()
+{
+	for (int i = 0; i < PATH_CACHE_BUCKETS; ++i) {
+		while (table[i]) {
+			struct path_entry *e = table[i];
+			table[i] = e->next;
+			free(e->name);
+			free(e->path);
+			free(e);
+		}
+	}
+}
+
+/**
+ * @brief Drop the entry of one command, e.g. after its file went away
+ *
+ * @param name Command name
+ */
+void path_forget(const char *name)
+{
+	struct path_entry **link = &table[path_hash(name)];
+	while (*link) {
+		struct path_entry *e = *link;
+		if (strcmp(e->name, name) == 0) {
+			*link = e->next;
+			free(e->name);
+			free(e->path);
+			free(e);
+			return;
+		}
+		link = &e->next;
+	}
+}
+
+// Flush the table when $PATH is not the one the entries were resolved against
+static void path_check_env()
+{
+	const char *env = getenv("PATH");
+	if (env == NULL)
+		env = "";
+	if (cached_path_env && strcmp(cached_path_env, env) == 0)
+		return;
+	path_clear();
+	free(cached_path_env);
+	cached_path_env = strdup(env);
+}
+
+// Walk $PATH once, the way execvp() does (an empty element is the current directory)
+static char *path_search(const char *name)
+{
+	char buf[BUF_SIZE];
+	const char *dir = cached_path_env;
+
+	while (1) {
+		const char *end = strchr(dir, ':');
+		int len = end ? end - dir : (int)strlen(dir);
+		struct stat st;
+
+		if (len == 0)
+			snprintf(buf, sizeof(buf), "%s", name);
+		else
+			snprintf(buf, sizeof(buf), "%.*s/%s", len, dir, name);
+		if (stat(buf, &st) == 0 && S_ISREG(st.st_mode) && access(buf, X_OK) == 0)
+			return strdup(buf);
+		if (end == NULL)
+			return NULL;
+		dir = end + 1;
+	}
+}
+
+/**
+ * @brief Resolve a command name to the file to execute
+ *
+ * @param name Command name (args[0])
+ * @return const char*
+ * Return the cached absolute path, name itself if it contains a '/',
+ * NULL if no $PATH directory has it
+ */
+const char *path_lookup(const char *name)
+{
+	if (strchr(name, '/'))
+		return name;
+
+	path_check_env();
+	unsigned int h = path_hash(name);
+	for (struct path_entry *e = table[h]; e; e = e->next) {
+		if (strcmp(e->name, name) == 0) {
+			e->hits++;
+			return e->path;
+		}
+	}
+
+	char *path = path_search(name);
+	if (path == NULL)
+		return NULL;
+	struct path_entry *e = (struct path_entry *)malloc(sizeof(struct path_entry));
+	e->name = strdup(name);
+	e->path = path;
+	e->hits = 1;
+	e->next = table[h];
+	table[h] = e;
+	return e->path;
+}
+
+/**
+ * @brief Print the table like the "hash" builtin of sh
+ */
+void path_print()
+{
+	int empty = 1;
+	for (int i = 0; i < PATH_CACHE_BUCKETS; ++i) {
+		for (struct path_entry *e = table[i]; e; e = e->next) {
+			if (empty)
+				printf("hits\tcommand\n");
+			empty = 0;
+			printf("%4d\t%s\n", e->hits, e->path);
+		}
+	}
+	if (empty)
+		printf("hash: hash table empty\n");
+}
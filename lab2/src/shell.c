@@ -5,9 +5,20 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <errno.h>
 #include "../include/command.h"
 #include "../include/builtin.h"
+#include "../include/pathcache.h"
+#include "../include/jobs.h"
+#include "../include/stats.h"
+#include "../include/fastcopy.h"
+
+static bool shell_interactive;
+
+extern char **environ;
 
 // ======================= requirement 2.3 =======================
 /**
@@ -64,39 +75,120 @@ void redirection(struct cmd_node *p){
 }
 // ===============================================================
 
+/**
+ * @brief 
+ * Start an external command without waiting for it
+ * posix_spawn() creates the child with vfork semantics (no copy of the
+ * shell's page tables) and applies the same redirections as redirection()
+ * through file actions before the exec. The file comes from the path cache,
+ * an entry whose file went away is dropped and looked up once more.
+ * @param p cmd_node structure
+ * @param close_fd Pipe end the child must not inherit, -1 if none
+ * @return pid_t 
+ * Return the child pid, -1 if it could not be started
+ */
+static pid_t spawn_external(struct cmd_node *p, int close_fd)
+{
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+
+    posix_spawn_file_actions_init(&actions);
+    if (close_fd >= 0)
+        posix_spawn_file_actions_addclose(&actions, close_fd);
+
+    if (p->in_file) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, p->in_file, O_RDONLY, 0);
+    } else if (p->in != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, p->in, STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, p->in);
+    }
+    if (p->out_file) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, p->out_file,
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    } else if (p->out != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, p->out, STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, p->out);
+    }
+
+    int err, retry = 1;
+    do {
+        const char *path = path_lookup(p->args[0]);
+        if (path == NULL) {
+            fprintf(stderr, "%s: command not found\n", p->args[0]);
+            posix_spawn_file_actions_destroy(&actions);
+            return -1;
+        }
+        err = posix_spawn(&pid, path, &actions, NULL, p->args, environ);
+        // ENOENT can also come from a missing "<" file, only a stale entry is retried
+        if (err != ENOENT || access(path, X_OK) == 0)
+            break;
+        path_forget(p->args[0]);
+    } while (retry--);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", p->args[0], strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+/**
+ * @brief 
+ * Run a built-in command in the shell process
+ * stdin and stdout are redirected for the duration of the call and restored
+ * afterwards, so the shell keeps its terminal.
+ * @param status Index of the built-in command
+ * @param p cmd_node structure
+ * @return int 
+ * Return the built-in command's status
+ */
+static int run_builtin(int status, struct cmd_node *p)
+{
+    struct stage st;
+    struct rusage before;
+    stage_start(&st, 0, p->args[0]);
+    getrusage(RUSAGE_SELF, &before);
+
+    int in = dup(STDIN_FILENO), out = dup(STDOUT_FILENO);
+    if (in == -1 || out == -1)
+        perror("dup");
+    redirection(p);
+    status = execBuiltInCommand(status, p);
+
+    // recover shell stdin and stdout, flush first so output goes where it was redirected
+    fflush(stdout);
+    dup2(in, STDIN_FILENO);
+    dup2(out, STDOUT_FILENO);
+    close(in);
+    close(out);
+    stage_end_self(&st, &before);
+    return status;
+}
+
 // ======================= requirement 2.2 =======================
 /**
  * @brief 
  * Execute external command
  * The external command is mainly divided into the following two steps:
- * 1. Call "fork()" to create child process
- * 2. Call "execvp()" to execute the corresponding executable file
+ * 1. Create the child process (posix_spawn, see spawn_external())
+ * 2. Execute the corresponding executable file in it
  * @param p cmd_node structure
  * @return int 
  * Return execution status
  */
 int spawn_proc(struct cmd_node *p)
 {
-    pid_t pid = fork();
-
-    if (pid < 0) {
-        perror("spawn_proc: fork");
-        return 1;
-    } else if (pid == 0) {
-        // Child process
-        redirection(p); // 處理重導向
-        
-        execvp(p->args[0], p->args);
-        
-        // 如果 execvp 返回，表示發生錯誤
-        perror("spawn_proc: execvp");
-        exit(EXIT_FAILURE);
-    } else {
-        // Parent process
+    pid_t pid = spawn_external(p, -1);
+
+    if (pid > 0) {
         int status;
-        waitpid(pid, &status, 0); // 等待子行程結束
-        return 1;
+        struct stage st;
+        struct rusage ru;
+        stage_start(&st, pid, p->args[0]);
+        wait4(pid, &status, 0, &ru); // 等待子行程結束
+        stage_end(&st, &ru);
     }
+    return 1;
 }
 // ===============================================================
 
@@ -105,7 +197,10 @@ int spawn_proc(struct cmd_node *p)
 /**
  * @brief 
  * Use "pipe()" to create a communication bridge between processes
- * Call "spawn_proc()" in order according to the number of cmd_node
+ * Start every cmd_node in order: external commands are spawned, built-ins
+ * run in a forked child without exec, except a built-in in the last stage,
+ * which runs in the shell process itself. A background ("&") pipeline is
+ * handed to the job table instead of being waited for.
  * @param cmd Command structure  
  * @return int
  * Return execution status 
@@ -115,14 +210,28 @@ int fork_cmd_node(struct cmd *cmd)
     struct cmd_node *p = cmd->head;
     int pipe_fd[2];
     int input_fd = STDIN_FILENO; // 初始輸入為標準輸入
+    int status = 1;
+    int count = 0, started = 0;
+
+    for (struct cmd_node *q = cmd->head; q != NULL; q = q->next)
+        count++;
+    struct stage *stages = (struct stage *)malloc(count * sizeof(struct stage));
+
+    // Respect the concurrency limit before starting another background job
+    if (cmd->background)
+        job_throttle();
+
+    // Forked built-ins inherit stdio buffers, empty them first
+    fflush(stdout);
 
     while (p != NULL) {
         // 如果還有下一個指令，建立 pipe
         if (p->next != NULL) {
             if (pipe(pipe_fd) < 0) {
                 perror("fork_cmd_node: pipe");
-                return 1;
+                break;
             }
+            pipe_tune(pipe_fd[1]);
             p->out = pipe_fd[1]; // 當前指令輸出到 pipe 寫入端
         } else {
             p->out = STDOUT_FILENO; // 最後一個指令輸出到標準輸出
@@ -131,26 +240,32 @@ int fork_cmd_node(struct cmd *cmd)
         // 設定當前指令的輸入 (來自上一個 pipe 或標準輸入)
         p->in = input_fd;
 
-        // Fork 行程
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork_cmd_node: fork");
-            return 1;
-        } else if (pid == 0) {
-            // Child process
-            
-            // 如果當前有下一個指令，子行程不需要讀取端，應關閉避免 hang
-            if (p->next != NULL) {
-                close(pipe_fd[0]);
-            }
-
-            // 執行重導向 (處理 p->in, p->out 以及檔案重導向)
-            redirection(p);
+        // 子行程不需要讀取端，應關閉避免 hang
+        int close_fd = (p->next != NULL) ? pipe_fd[0] : -1;
+        int builtin = searchBuiltInCommand(p);
+        pid_t pid = -1;
 
-            execvp(p->args[0], p->args);
-            perror("fork_cmd_node: execvp");
-            exit(EXIT_FAILURE);
+        if (builtin != -1 && p->next == NULL && !cmd->background) {
+            // Last stage: no exec and no fork
+            status = run_builtin(builtin, p);
+            if (p->in_file == NULL)
+                input_fd = STDIN_FILENO; // redirection() already closed it
+        } else if (builtin != -1) {
+            pid = fork();
+            if (pid < 0) {
+                perror("fork_cmd_node: fork");
+            } else if (pid == 0) {
+                close(close_fd);
+                redirection(p);
+                execBuiltInCommand(builtin, p);
+                fflush(stdout);
+                _exit(EXIT_SUCCESS);
+            }
+        } else {
+            pid = spawn_external(p, close_fd);
         }
+        if (pid > 0)
+            stage_start(&stages[started++], pid, p->args[0]);
 
         // Parent process
         
@@ -171,45 +286,91 @@ int fork_cmd_node(struct cmd *cmd)
 
         p = p->next;
     }
+    if (input_fd != STDIN_FILENO)
+        close(input_fd);
+
+    if (cmd->background) {
+        int id = job_add(stages, started);
+        if (shell_interactive && id)
+            printf("[%d] %d\n", id, stages[started - 1].pid);
+        return status;
+    }
 
-    // 等待所有子行程結束
-    while (wait(NULL) > 0);
+    // 等待這條 pipeline 的子行程結束, wait4 also reports what each stage cost
+    for (int i = 0; i < started; i++) {
+        struct rusage ru;
+        wait4(stages[i].pid, NULL, 0, &ru);
+        stage_end(&stages[i], &ru);
+    }
+    free(stages);
 
-	return 1;
+	return status;
 }
 // ===============================================================
 
 
-void shell()
+/**
+ * @brief 
+ * Read and run commands until "exit" or the end of the input
+ * @param input Terminal (stdin), script file or -c string
+ * @param interactive Print the prompt and job notifications
+ */
+void shell(FILE *input, bool interactive)
 {
+	static struct arena arena;
+
+	shell_interactive = interactive;
 	while (1) {
-		printf(">>> $ ");
-		char *buffer = read_line();
-		if (buffer == NULL)
+		// Everything parsed from the previous line goes away in one step
+		arena_reset(&arena);
+		if (interactive)
+			printf(">>> $ ");
+		char *buffer = read_line(&arena, input);
+		if (buffer == NULL) {
+			if (feof(input) || ferror(input))
+				break;
 			continue;
+		}
 
-		struct cmd *cmd = split_line(buffer);
+		struct cmd *cmd = split_line(buffer, &arena);
 		
 		int status = -1;
 		// only a single command
 		struct cmd_node *temp = cmd->head;
+
+		// "time" prefixes the whole pipeline, like the sh keyword
+		bool timed = false;
+		if (temp->args[0] && strcmp(temp->args[0], "time") == 0) {
+			timed = true;
+			temp->args++;
+			temp->length--;
+		}
+		// "a |", "| b" and "a | | b" have a stage without a command
+		bool empty_stage = false;
+		for (struct cmd_node *q = temp; temp->next != NULL && q != NULL; q = q->next)
+			if (q->args[0] == NULL)
+				empty_stage = true;
+		if (empty_stage) {
+			fprintf(stderr, "syntax error near unexpected token `|'\n");
+			continue;
+		}
+		if (temp->args[0] == NULL) {
+			if (timed) {
+				stats_begin();
+				time_report();
+			}
+			continue;
+		}
+		stats_begin();
 		
-		if(temp->next == NULL){
+		if (cmd->background) {
+			// Even a single built-in runs in a child when it goes to the background
+			status = fork_cmd_node(cmd);
+		}
+		else if(temp->next == NULL){
 			status = searchBuiltInCommand(temp);
 			if (status != -1){
-				int in = dup(STDIN_FILENO), out = dup(STDOUT_FILENO);
-				if( in == -1 | out == -1)
-					perror("dup");
-				redirection(temp);
-				status = execBuiltInCommand(status,temp);
-
-				// recover shell stdin and stdout
-				if (temp->in_file)  dup2(in, 0);
-				if (temp->out_file){
-					dup2(out, 1);
-				}
-				close(in);
-				close(out);
+				status = run_builtin(status, temp);
 			}
 			else{
 				//external command
@@ -221,18 +382,16 @@ void shell()
 			
 			status = fork_cmd_node(cmd);
 		}
-		// free space
-		while (cmd->head) {
-			
-			struct cmd_node *temp = cmd->head;
-      		cmd->head = cmd->head->next;
-			free(temp->args);
-   	    	free(temp);
-   		}
-		free(cmd);
-		free(buffer);
-		
+		if (timed)
+			time_report();
+
+		// Collect background jobs that finished meanwhile
+		job_reap(false, interactive);
+
 		if (status == 0)
 			break;
 	}
+	// A script is done when its background jobs are
+	job_wait_all();
+	arena_free(&arena);
 }
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/stats.h"
+
+bool stats_enabled = false;
+
+static struct stats_entry table[STATS_MAX_COMMANDS];
+static int table_count;
+
+// Stages finished since stats_begin(), what "time" reports
+static struct stage *last;
+static int last_count, last_size;
+static struct timespec command_start;
+
+static double timeval_sec(struct timeval tv)
+{
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static double elapsed_since(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/**
+ * @brief Begin measuring a stage
+ *
+ * @param s Stage
+ * @param pid Child pid, 0 for a built-in in the shell process
+ * @param name Command name (args[0]), copied
+ */
+void stage_start(struct stage *s, pid_t pid, const char *name)
+{
+	memset(s, 0, sizeof(*s));
+	s->pid = pid;
+	snprintf(s->name, sizeof(s->name), "%s", name);
+	clock_gettime(CLOCK_MONOTONIC, &s->start);
+}
+
+static void stats_add(const struct stage *s)
+{
+	struct stats_entry *e = NULL;
+	for (int i = 0; i < table_count; ++i) {
+		if (strcmp(table[i].name, s->name) == 0) {
+			e = &table[i];
+			break;
+		}
+	}
+	if (e == NULL) {
+		if (table_count == STATS_MAX_COMMANDS)
+			return;
+		e = &table[table_count++];
+		memset(e, 0, sizeof(*e));
+		snprintf(e->name, sizeof(e->name), "%s", s->name);
+	}
+	e->runs++;
+	e->wall += s->wall;
+	e->user += s->user;
+	e->sys += s->sys;
+	if (s->maxrss > e->maxrss)
+		e->maxrss = s->maxrss;
+	e->nvcsw += s->nvcsw;
+	e->nivcsw += s->nivcsw;
+}
+
+/**
+ * @brief Finish a stage with the resource usage of its process
+ *
+ * @param s Stage started with stage_start()
+ * @param ru Usage returned by wait4() (or a delta for built-ins)
+ */
+void stage_end(struct stage *s, const struct rusage *ru)
+{
+	s->wall = elapsed_since(&s->start);
+	s->user = timeval_sec(ru->ru_utime);
+	s->sys = timeval_sec(ru->ru_stime);
+	s->maxrss = ru->ru_maxrss;
+	s->nvcsw = ru->ru_nvcsw;
+	s->nivcsw = ru->ru_nivcsw;
+
+	if (last_count == last_size) {
+		last_size = last_size ? 2 * last_size : 8;
+		last = (struct stage *)realloc(last, last_size * sizeof(struct stage));
+	}
+	last[last_count++] = *s;
+	if (stats_enabled)
+		stats_add(s);
+}
+
+/**
+ * @brief Finish a built-in that ran in the shell process
+ *
+ * @param s Stage started with stage_start(s, 0, name)
+ * @param before getrusage(RUSAGE_SELF) taken when the built-in started
+ */
+void stage_end_self(struct stage *s, const struct rusage *before)
+{
+	struct rusage now, delta;
+	getrusage(RUSAGE_SELF, &now);
+
+	delta = now;
+	timersub(&now.ru_utime, &before->ru_utime, &delta.ru_utime);
+	timersub(&now.ru_stime, &before->ru_stime, &delta.ru_stime);
+	delta.ru_nvcsw = now.ru_nvcsw - before->ru_nvcsw;
+	delta.ru_nivcsw = now.ru_nivcsw - before->ru_nivcsw;
+	stage_end(s, &delta);
+}
+
+/**
+ * @brief Start a new command, forget the stages of the previous one
+ */
+void stats_begin()
+{
+	last_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &command_start);
+}
+
+/**
+ * @brief Print the cost of the command since stats_begin(), like "time"
+ * A pipeline also gets one line per stage.
+ */
+void time_report()
+{
+	double user = 0, sys = 0;
+	for (int i = 0; i < last_count; ++i) {
+		user += last[i].user;
+		sys += last[i].sys;
+	}
+	double real = elapsed_since(&command_start);
+
+	if (last_count > 1) {
+		for (int i = 0; i < last_count; ++i)
+			fprintf(stderr, "%-12s real %.3fs user %.3fs sys %.3fs maxrss %ldKB csw %ld/%ld\n",
+					last[i].name, last[i].wall, last[i].user, last[i].sys,
+					last[i].maxrss, last[i].nvcsw, last[i].nivcsw);
+	}
+	fprintf(stderr, "\nreal\t%dm%.3fs\nuser\t%dm%.3fs\nsys\t%dm%.3fs\n",
+			(int)real / 60, real - 60 * ((int)real / 60),
+			(int)user / 60, user - 60 * ((int)user / 60),
+			(int)sys / 60, sys - 60 * ((int)sys / 60));
+}
+
+static int by_wall(const void *a, const void *b)
+{
+	double d = ((const struct stats_entry *)b)->wall - ((const struct stats_entry *)a)->wall;
+	return (d > 0) - (d < 0);
+}
+
+/**
+ * @brief Print the per-command table, most expensive (wall time) first
+ *
+ * @param names Only these commands, all of them if NULL or empty
+ */
+void stats_print(char **names)
+{
+	struct stats_entry sorted[STATS_MAX_COMMANDS];
+	memcpy(sorted, table, table_count * sizeof(struct stats_entry));
+	qsort(sorted, table_count, sizeof(struct stats_entry), by_wall);
+
+	printf("%-16s %6s %10s %10s %10s %10s %10s %10s\n",
+		   "command", "runs", "wall(s)", "user(s)", "sys(s)", "maxrss(KB)", "vcsw", "ivcsw");
+	for (int i = 0; i < table_count; ++i) {
+		bool wanted = (names == NULL || names[0] == NULL);
+		for (int k = 0; !wanted && names[k]; ++k)
+			wanted = (strcmp(names[k], sorted[i].name) == 0);
+		if (!wanted)
+			continue;
+		printf("%-16s %6ld %10.3f %10.3f %10.3f %10ld %10ld %10ld\n",
+			   sorted[i].name, sorted[i].runs, sorted[i].wall, sorted[i].user,
+			   sorted[i].sys, sorted[i].maxrss, sorted[i].nvcsw, sorted[i].nivcsw);
+	}
+}
+
+/**
+ * @brief Empty the per-command table
+ */
+void stats_reset()
+{
+	table_count = 0;
+}
@@ -3,14 +3,38 @@
 #include <stdlib.h>
 
 volatile int a = 0;
+
+#ifndef SPIN_KIND
 pthread_spinlock_t lock;
 
+void spin_lock() {
+    pthread_spin_lock(&lock);
+}
+
+void spin_unlock() {
+    pthread_spin_unlock(&lock);
+}
+#else
+// make judge LOCK=TTAS|TICKET|MCS|TAS: a lock of common/spinlock.h instead
+#include "../../common/spinlock.h"
+
+spinlock_t lock = SPINLOCK_INIT(SPIN_KIND);
+
+void spin_lock() {
+    spinlock_acquire(&lock);
+}
+
+void spin_unlock() {
+    spinlock_release(&lock);
+}
+#endif
+
 void *thread(void *arg) {
     /*YOUR CODE HERE*/
     for(int i=0; i<10000; i++) {
-        pthread_spin_lock(&lock);
+        spin_lock();
         a = a + 1;
-        pthread_spin_unlock(&lock);
+        spin_unlock();
     }
     /****************/              
     return NULL;
@@ -21,12 +45,16 @@ int main() {
     fptr = fopen("1.txt", "a");
     pthread_t t1, t2;
 
+#ifndef SPIN_KIND
     pthread_spin_init(&lock, 0);
+#endif
     pthread_create(&t1, NULL, thread, NULL);
     pthread_create(&t2, NULL, thread, NULL);
     pthread_join(t1, NULL);
     pthread_join(t2, NULL);
+#ifndef SPIN_KIND
     pthread_spin_destroy(&lock);
+#endif
 
     fprintf(fptr, "%d ", a);
     fclose(fptr);
@@ -9,9 +9,11 @@
 #define UNLOCK 1
 
 volatile int a = 0;
-volatile int lock = UNLOCK;
 pthread_mutex_t mutex;
 
+#ifndef SPIN_KIND
+volatile int lock = UNLOCK;
+
 void spin_lock() {
     asm volatile(
         "loop:\n\t"
@@ -38,6 +40,20 @@ void spin_unlock() {
         : "eax", "memory"
     );
 }
+#else
+// make judge LOCK=TTAS|TICKET|MCS|TAS: a lock of common/spinlock.h instead
+#include "../../common/spinlock.h"
+
+spinlock_t lock = SPINLOCK_INIT(SPIN_KIND);
+
+void spin_lock() {
+    spinlock_acquire(&lock);
+}
+
+void spin_unlock() {
+    spinlock_release(&lock);
+}
+#endif
 
 
 void *thread(void *arg) {
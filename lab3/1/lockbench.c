@@ -0,0 +1,333 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "../common/spinlock.h"
+
+/*
+    Lock contention benchmark for the lab3 counters.
+
+    Every thread repeats one operation until the run time is over:
+    acquire, a = a + 1, cs rounds of busy work, release. For "atomic"
+    the whole operation is one atomic_fetch_add plus the busy work, for
+    "sharded" every thread counts into its own cache line and the counts
+    are summed at the end, the two lock-free ways of keeping a counter.
+    The final count is checked against the number of operations.
+
+    Every sample-th acquire is timed with CLOCK_MONOTONIC; the report
+    has operations per second over all threads and percentiles of the
+    acquire latency (time until the lock is held, not the hold time).
+
+    ./lockbench [-t 1,2,4] [-c 0,50] [-k mutex,spin,...] [-d ms] [-s n] [-P]
+    -t thread counts (default 1, 2, 4, ... up to the online CPUs)
+    -c busy-work rounds inside the critical section (default 0,50)
+    -k kinds: mutex spin asm tas ttas ticket mcs atomic sharded (default all)
+    -d milliseconds per measurement (default 200)
+    -s time every n-th acquire (default 16)
+    -P do not pin thread w to CPU w % CPUs
+*/
+
+#define MAX_THREADS 256
+#define MAX_LIST 32
+#define MAX_SAMPLES (1 << 16)           // per thread
+
+enum { K_MUTEX, K_SPIN, K_ASM, K_TAS, K_TTAS, K_TICKET, K_MCS, K_ATOMIC, K_SHARDED, K_COUNT };
+
+static const char *kind_names[K_COUNT] = {
+    "mutex", "spin", "asm", "tas", "ttas", "ticket", "mcs", "atomic", "sharded",
+};
+
+typedef struct {
+    long count;
+    char pad[SPIN_CACHE_LINE - sizeof(long)];
+} __attribute__((aligned(SPIN_CACHE_LINE))) shard_t;
+
+typedef struct {
+    int id;
+    long ops;
+    int nsamples;
+    long *samples;
+    pthread_t tid;
+} worker_t;
+
+static int kind, cs_rounds, sample_every = 16, ncpus;
+static bool pin = true;
+static atomic_int ready, go, stop;
+
+static volatile long a;
+static atomic_long atomic_a;
+static shard_t shards[MAX_THREADS];
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_spinlock_t spin;
+static volatile int asm_lock = 1;       // 1_2.c: 1 is UNLOCK
+static spinlock_t lock;
+
+// The exercise lock of 1_2.c, with local labels so it can be inlined
+static inline void asm_spin_lock(void){
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile(
+        "1:\n\t"
+        "mov $0, %%eax\n\t"
+        "xchg %%eax, %[lock]\n\t"
+        "cmp $1, %%eax\n\t"
+        "js 1b\n\t"
+        :
+        : [lock] "m" (asm_lock)
+        : "eax", "memory"
+    );
+#else
+    while (__atomic_exchange_n(&asm_lock, 0, __ATOMIC_ACQUIRE) != 1)
+        ;
+#endif
+}
+
+static inline void asm_spin_unlock(void){
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile(
+        "mov $1, %%eax\n\t"
+        "xchg %%eax, %[lock]\n\t"
+        :
+        : [lock] "m" (asm_lock)
+        : "eax", "memory"
+    );
+#else
+    __atomic_store_n(&asm_lock, 1, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static inline void acquire(void){
+    switch (kind) {
+    case K_MUTEX: pthread_mutex_lock(&mutex); break;
+    case K_SPIN: pthread_spin_lock(&spin); break;
+    case K_ASM: asm_spin_lock(); break;
+    default: spinlock_acquire(&lock); break;
+    }
+}
+
+static inline void release(void){
+    switch (kind) {
+    case K_MUTEX: pthread_mutex_unlock(&mutex); break;
+    case K_SPIN: pthread_spin_unlock(&spin); break;
+    case K_ASM: asm_spin_unlock(); break;
+    default: spinlock_release(&lock); break;
+    }
+}
+
+static inline void busy_work(void){
+    for (volatile int i = 0; i < cs_rounds; i++)
+        ;
+}
+
+static void *worker(void *arg){
+    worker_t *w = arg;
+    long ops = 0;
+
+    if (pin && ncpus > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->id % ncpus, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    atomic_fetch_add(&ready, 1);
+    while (!atomic_load_explicit(&go, memory_order_acquire))
+        cpu_relax();
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        bool timed = ops % sample_every == 0 && w->nsamples < MAX_SAMPLES;
+        long t0 = timed ? now_ns() : 0;
+
+        if (kind == K_ATOMIC) {
+            atomic_fetch_add_explicit(&atomic_a, 1, memory_order_relaxed);
+            if (timed)
+                w->samples[w->nsamples++] = now_ns() - t0;
+            busy_work();
+        } else if (kind == K_SHARDED) {
+            shards[w->id].count++;
+            if (timed)
+                w->samples[w->nsamples++] = now_ns() - t0;
+            busy_work();
+        } else {
+            acquire();
+            if (timed)
+                w->samples[w->nsamples++] = now_ns() - t0;
+            a = a + 1;
+            busy_work();
+            release();
+        }
+        ops++;
+    }
+    w->ops = ops;
+    return NULL;
+}
+
+static int cmp_long(const void *x, const void *y){
+    long a = *(const long *)x, b = *(const long *)y;
+    return (a > b) - (a < b);
+}
+
+static long percentile(const long *sorted, long n, double p){
+    if (n == 0)
+        return 0;
+    long i = (long)(p * (n - 1));
+    return sorted[i];
+}
+
+// One measurement; returns false if the counter does not match the operations
+static bool run(int threads, int duration_ms){
+    static worker_t workers[MAX_THREADS];
+    long total = 0, nsamples = 0, count = 0;
+
+    a = 0;
+    atomic_store(&atomic_a, 0);
+    memset(shards, 0, sizeof(shards));
+    pthread_spin_init(&spin, PTHREAD_PROCESS_PRIVATE);
+    spinlock_init(&lock, kind == K_TTAS ? SPIN_TTAS : kind == K_TICKET ? SPIN_TICKET :
+                         kind == K_MCS ? SPIN_MCS : SPIN_TAS);
+    atomic_store(&ready, 0);
+    atomic_store(&go, 0);
+    atomic_store(&stop, 0);
+
+    for (int t = 0; t < threads; t++) {
+        workers[t] = (worker_t){ .id = t, .samples = malloc(MAX_SAMPLES * sizeof(long)) };
+        if (workers[t].samples == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        pthread_create(&workers[t].tid, NULL, worker, &workers[t]);
+    }
+    while (atomic_load(&ready) < threads)
+        sched_yield();
+
+    long start = now_ns();
+    atomic_store_explicit(&go, 1, memory_order_release);
+    struct timespec d = { duration_ms / 1000, (duration_ms % 1000) * 1000000L };
+    nanosleep(&d, NULL);
+    atomic_store(&stop, 1);
+    for (int t = 0; t < threads; t++)
+        pthread_join(workers[t].tid, NULL);
+    double seconds = (now_ns() - start) / 1e9;
+    pthread_spin_destroy(&spin);
+
+    for (int t = 0; t < threads; t++) {
+        total += workers[t].ops;
+        nsamples += workers[t].nsamples;
+    }
+    long *all = malloc((nsamples + 1) * sizeof(long));
+    for (int t = 0, off = 0; t < threads; t++) {
+        memcpy(all + off, workers[t].samples, workers[t].nsamples * sizeof(long));
+        off += workers[t].nsamples;
+        free(workers[t].samples);
+    }
+    qsort(all, nsamples, sizeof(long), cmp_long);
+
+    if (kind == K_ATOMIC)
+        count = atomic_load(&atomic_a);
+    else if (kind == K_SHARDED)
+        for (int t = 0; t < threads; t++)
+            count += shards[t].count;
+    else
+        count = a;
+
+    printf("%-8s %7d %6d %14.0f %8ld %8ld %8ld %8ld %10ld%s\n",
+           kind_names[kind], threads, cs_rounds, total / seconds,
+           percentile(all, nsamples, 0.50), percentile(all, nsamples, 0.90),
+           percentile(all, nsamples, 0.99), percentile(all, nsamples, 0.999),
+           nsamples ? all[nsamples - 1] : 0, count == total ? "" : "  COUNT MISMATCH");
+    free(all);
+    return count == total;
+}
+
+// "1,2,4" -> {1, 2, 4}, returns how many
+static int parse_list(char *s, int *out){
+    int n = 0;
+    for (char *tok = strtok(s, ","); tok && n < MAX_LIST; tok = strtok(NULL, ","))
+        out[n++] = atoi(tok);
+    return n;
+}
+
+int main(int argc, char *argv[]){
+    int threads[MAX_LIST], nthreads = 0;
+    int cs[MAX_LIST] = { 0, 50 }, ncs = 2;
+    int kinds[K_COUNT], nkinds = 0;
+    int duration_ms = 200;
+    int opt;
+    bool ok = true;
+
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "t:c:k:d:s:P")) != -1) {
+        switch (opt) {
+        case 't':
+            nthreads = parse_list(optarg, threads);
+            break;
+        case 'c':
+            ncs = parse_list(optarg, cs);
+            break;
+        case 'k':
+            for (char *tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                int k;
+                for (k = 0; k < K_COUNT && strcmp(tok, kind_names[k]) != 0; k++)
+                    ;
+                if (k == K_COUNT) {
+                    fprintf(stderr, "%s: unknown kind %s\n", argv[0], tok);
+                    return 1;
+                }
+                if (nkinds < K_COUNT)
+                    kinds[nkinds++] = k;
+            }
+            break;
+        case 'd':
+            duration_ms = atoi(optarg);
+            break;
+        case 's':
+            sample_every = atoi(optarg);
+            break;
+        case 'P':
+            pin = false;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t 1,2,4] [-c 0,50] [-k mutex,spin,...] [-d ms] [-s n] [-P]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nthreads == 0) {
+        for (int t = 1; t < ncpus && nthreads < MAX_LIST - 1; t *= 2)
+            threads[nthreads++] = t;
+        threads[nthreads++] = ncpus > 0 ? ncpus : 1;
+    }
+    if (nkinds == 0)
+        for (int k = 0; k < K_COUNT; k++)
+            kinds[nkinds++] = k;
+    if (sample_every < 1)
+        sample_every = 1;
+    if (duration_ms < 1)
+        duration_ms = 1;
+
+    printf("%-8s %7s %6s %14s %8s %8s %8s %8s %10s\n",
+           "kind", "threads", "cs", "ops/s", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns");
+    for (int k = 0; k < nkinds; k++) {
+        kind = kinds[k];
+        for (int c = 0; c < ncs; c++) {
+            cs_rounds = cs[c];
+            for (int t = 0; t < nthreads; t++) {
+                if (threads[t] < 1 || threads[t] > MAX_THREADS) {
+                    fprintf(stderr, "%s: thread count must be 1..%d\n", argv[0], MAX_THREADS);
+                    return 1;
+                }
+                ok &= run(threads[t], duration_ms);
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -3,6 +3,11 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "../common/matmul.h"
+#include "../common/matio.h"
+#include "../common/gemm_simd.h"
 
 #define matrix_row_x 1234
 #define matrix_col_x 250
@@ -10,115 +15,190 @@
 #define matrix_row_y 250
 #define matrix_col_y 4
 
+#define THREAD_NUMBER 2  // default, ./2.out -t <threads> overrides it
+
+// How thread partials are merged into z, -r on the command line
+#define REDUCE_LOCK 0       // one global spinlock, one row per lock hold
+#define REDUCE_STRIPED 1    // REDUCE_STRIPES locks, row i under lock i % REDUCE_STRIPES
+#define REDUCE_ATOMIC 2     // lock-free atomic add per element
+#define REDUCE_PRIVATE 3    // barrier, then each thread sums its share of rows over all partials
+
+#define REDUCE_STRIPES 16
+
+static const char *reduce_names[] = { "lock", "striped", "atomic", "private" };
+
+// One cache line per lock so neighbouring stripes do not false-share
+typedef struct {
+    pthread_spinlock_t lock;
+    char pad[MATMUL_ALIGN - sizeof(pthread_spinlock_t)];
+} __attribute__((aligned(MATMUL_ALIGN))) stripe_t;
+
 pthread_spinlock_t lock;
-FILE *fptr1;
-FILE *fptr2;
+stripe_t stripes[REDUCE_STRIPES];
+pthread_barrier_t barrier;
 FILE *fptr3;
-int **x;
-int **y;
-int **z;
-
-// Put file data intp x array
-void data_processing(void){
-    int tmp;
-    fscanf(fptr1, "%d", &tmp);
-    fscanf(fptr1, "%d", &tmp);
-    for(int i=0; i<matrix_row_x; i++){
-        for(int j=0; j<matrix_col_x; j++){
-            if (fscanf(fptr1, "%d", &x[i][j])!=1){
-                printf("Error reading from file");
-                return;
-            }
-        }
-    }
+matrix_t x;
+matrix_t y;
+matrix_t z;
+int x_mapped, y_mapped;   // matrix_open() results: binary inputs are used in place
+matrix_t *partials;     // one per thread, matrix_alloc() pads each to whole cache lines
+int thread_number = THREAD_NUMBER;
+int reduce = REDUCE_PRIVATE;
+matmul_block_fn block;
 
-    fscanf(fptr2, "%d", &tmp);
-    fscanf(fptr2, "%d", &tmp);
-     for(int i=0; i<matrix_row_y; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            if (fscanf(fptr2, "%d", &y[i][j])!=1){
-                printf("Error reading from file");
-                return;
-            }
-        }
-    }   
+// Load m1.txt into x and m2.txt into y (text or binary, see matio.h)
+int data_processing(int threads){
+    if ((x_mapped = matrix_open("m1.txt", &x, threads)) < 0 ||
+        (y_mapped = matrix_open("m2.txt", &y, threads)) < 0)
+        return -1;
+    if (x.rows != matrix_row_x || x.cols != matrix_col_x ||
+        y.rows != matrix_row_y || y.cols != matrix_col_y) {
+        fprintf(stderr, "Unexpected matrix sizes %dx%d and %dx%d\n", x.rows, x.cols, y.rows, y.cols);
+        return -1;
+    }
+    return 0;
 }
 
-void *thread1(void *arg){
+/*
+    Thread w multiplies its slice k in [w*K/T, (w+1)*K/T) of the shared
+    dimension into its private partial matrix (the SIMD kernel of
+    gemm_simd.h), then merges it into z the way reduce says.
+*/
+void *thread(void *arg){
+    int w = (int)(long)arg;
+    int k0 = (long)matrix_row_y * w / thread_number;
+    int k1 = (long)matrix_row_y * (w + 1) / thread_number;
+    matrix_t *partial = &partials[w];
 
     /*YOUR CODE HERE*/
-    for(int i=0; i<matrix_row_x; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            int temp = 0; // 使用區域變數暫存結果
-            for(int k=0; k<matrix_row_y/2; k++){
-                temp += x[i][k] * y[k][j];
-            }
-            
-            // 計算完該區段後，上鎖並更新全域變數 z[i][j]
+    block(&x, &y, partial, 0, matrix_row_x, 0, matrix_col_y, k0, k1, MATMUL_TILE_K);
+
+    // Start at a different row in every thread so they do not queue on the same lock
+    int first = (long)matrix_row_x * w / thread_number;
+    switch (reduce) {
+    case REDUCE_LOCK:
+        for(int n=0; n<matrix_row_x; n++){
+            int i = (first + n) % matrix_row_x;
             pthread_spin_lock(&lock);
-            z[i][j] += temp;
+            for(int j=0; j<matrix_col_y; j++)
+                MAT(&z, i, j) += MAT(partial, i, j);
             pthread_spin_unlock(&lock);
-        }      
+        }
+        break;
+    case REDUCE_STRIPED:
+        for(int n=0; n<matrix_row_x; n++){
+            int i = (first + n) % matrix_row_x;
+            pthread_spinlock_t *l = &stripes[i % REDUCE_STRIPES].lock;
+            pthread_spin_lock(l);
+            for(int j=0; j<matrix_col_y; j++)
+                MAT(&z, i, j) += MAT(partial, i, j);
+            pthread_spin_unlock(l);
+        }
+        break;
+    case REDUCE_ATOMIC:
+        for(int n=0; n<matrix_row_x; n++){
+            int i = (first + n) % matrix_row_x;
+            for(int j=0; j<matrix_col_y; j++)
+                atomic_fetch_add_explicit((atomic_int *)&MAT(&z, i, j), MAT(partial, i, j),
+                                          memory_order_relaxed);
+        }
+        break;
+    case REDUCE_PRIVATE: {
+        // Every partial is complete once all threads pass the barrier; z rows
+        // [first, last) belong to this thread alone, so no locks at all
+        int last = (long)matrix_row_x * (w + 1) / thread_number;
+        pthread_barrier_wait(&barrier);
+        for(int t=0; t<thread_number; t++){
+            for(int i=first; i<last; i++){
+                for(int j=0; j<matrix_col_y; j++)
+                    MAT(&z, i, j) += MAT(&partials[t], i, j);
+            }
+        }
+        break;
+    }
     }
     /****************/
     return NULL;
 }
 
-void *thread2(void *arg) {
+/*
+    ./2.out [-t threads] [-r lock|striped|atomic|private] [-v]
+    -v prints the time of the multiply and merge phase to stderr.
+*/
+int main(int argc, char *argv[]) {
+    bool verbose = false;
+    int opt;
 
-    /*YOUR CODE HERE*/
-    for(int i=0; i<matrix_row_x; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            int temp = 0; // 使用區域變數暫存結果
-            for(int k=matrix_row_y/2; k<matrix_row_y; k++){
-                temp += x[i][k] * y[k][j];
-            }     
-            
-            // 計算完該區段後，上鎖並更新全域變數 z[i][j]
-            pthread_spin_lock(&lock);
-            z[i][j] += temp;
-            pthread_spin_unlock(&lock);
+    while ((opt = getopt(argc, argv, "t:r:v")) != -1) {
+        switch (opt) {
+        case 't':
+            thread_number = atoi(optarg);
+            break;
+        case 'r':
+            for (reduce = 0; reduce < 4 && strcmp(optarg, reduce_names[reduce]) != 0; reduce++)
+                ;
+            if (reduce == 4) {
+                fprintf(stderr, "%s: unknown reduction %s\n", argv[0], optarg);
+                return 1;
+            }
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t threads] [-r lock|striped|atomic|private] [-v]\n", argv[0]);
+            return 1;
         }
-    } 
-    /****************/
-    return NULL;
-}
-
-int main() {
-    x = malloc(sizeof(int*)*matrix_row_x);
-    for(int i=0; i<matrix_row_x; i++){
-        x[i] = malloc(sizeof(int)*matrix_col_x);
     }
-    y = malloc(sizeof(int*)*matrix_row_y);
-    for(int i=0; i<matrix_row_y; i++){
-        y[i] = malloc(sizeof(int)*matrix_col_y);
+    if (thread_number < 1)
+        thread_number = 1;
+    block = gemm_select();
+
+    if (data_processing(thread_number) < 0)
+        return 1;
+    if (matrix_alloc(&z, matrix_row_x, matrix_col_y) < 0) {
+        perror("matrix_alloc");
+        return 1;
     }
-    z = malloc(sizeof(int*)*matrix_row_x);
-    for(int i=0; i<matrix_row_x; i++){
-        z[i] = malloc(sizeof(int)*matrix_col_y);
+    partials = calloc(thread_number, sizeof(matrix_t));
+    for(int w=0; w<thread_number; w++){
+        if (matrix_alloc(&partials[w], matrix_row_x, matrix_col_y) < 0) {
+            perror("matrix_alloc");
+            return 1;
+        }
     }
-    fptr1 = fopen("m1.txt", "r");
-    fptr2 = fopen("m2.txt", "r");
     fptr3 = fopen("2.txt", "a");
-    pthread_t t1, t2;
-    data_processing();
-    fprintf(fptr3, "%d %d\n", matrix_row_x, matrix_col_y);
+    pthread_t tids[thread_number];
 
     pthread_spin_init(&lock, 0);
-    pthread_create(&t1, NULL, thread1, NULL);
-    pthread_create(&t2, NULL, thread2, NULL);
-    pthread_join(t1, NULL);
-    pthread_join(t2, NULL);
+    for(int s=0; s<REDUCE_STRIPES; s++)
+        pthread_spin_init(&stripes[s].lock, 0);
+    pthread_barrier_init(&barrier, NULL, thread_number);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int w=0; w<thread_number; w++)
+        pthread_create(&tids[w], NULL, thread, (void *)(long)w);
+    for(int w=0; w<thread_number; w++)
+        pthread_join(tids[w], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (verbose)
+        fprintf(stderr, "%s %d threads: %.3f ms\n", reduce_names[reduce], thread_number,
+                (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+
+    pthread_barrier_destroy(&barrier);
+    for(int s=0; s<REDUCE_STRIPES; s++)
+        pthread_spin_destroy(&stripes[s].lock);
     pthread_spin_destroy(&lock);
 
     //Write output matrix into file.
-    for(int i=0; i<matrix_row_x; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            fprintf(fptr3, "%d ", z[i][j]);
-            if(j==matrix_col_y-1) fprintf(fptr3, "\n");   
-        }
-    }
-    fclose(fptr1);
-    fclose(fptr2);
+    if (matrix_write_text(fptr3, &z, thread_number) < 0)
+        perror("2.txt");
     fclose(fptr3);
-}
\ No newline at end of file
+    for(int w=0; w<thread_number; w++)
+        matrix_free(&partials[w]);
+    free(partials);
+    matrix_close(&x, x_mapped);
+    matrix_close(&y, y_mapped);
+    matrix_free(&z);
+}
@@ -6,6 +6,9 @@
 #include <fcntl.h>
 #include <stdbool.h>
 #include "3_2_Config.h"
+#include "../../common/matmul.h"
+#include "../../common/matio.h"
+#include "../../common/gemm_simd.h"
 
 #define matrix_row_x 1234
 #define matrix_col_x 250
@@ -13,63 +16,33 @@
 #define matrix_row_y 250
 #define matrix_col_y 1234
 
-FILE *fptr1;
-FILE *fptr2;
-FILE *fptr3;
-FILE *fptr4;
-FILE *fptr5;
-int **x;
-int **y;
-int **z;
-pid_t tid1, tid2;
+#ifndef THREAD_SCHEDULE
+#define THREAD_SCHEDULE MATMUL_STATIC
+#endif
 
-// Put file data intp x array
-void data_processing(void){
-    int tmp;
-    fscanf(fptr1, "%d", &tmp);
-    fscanf(fptr1, "%d", &tmp);
-    for(int i=0; i<matrix_row_x; i++){
-        for(int j=0; j<matrix_col_x; j++){
-            if (fscanf(fptr1, "%d", &x[i][j])!=1){
-                printf("Error reading from file");
-                return;
-            }
-        }
+FILE *fptr3;
+matrix_t x;
+matrix_t y;
+matrix_t z;
+int x_mapped, y_mapped;   // matrix_open() results: binary inputs are used in place
+
+// Load m1.txt into x and m2.txt into y (text or binary, see matio.h)
+int data_processing(int threads){
+    if ((x_mapped = matrix_open("m1.txt", &x, threads)) < 0 ||
+        (y_mapped = matrix_open("m2.txt", &y, threads)) < 0)
+        return -1;
+    if (x.rows != matrix_row_x || x.cols != matrix_col_x ||
+        y.rows != matrix_row_y || y.cols != matrix_col_y) {
+        fprintf(stderr, "Unexpected matrix sizes %dx%d and %dx%d\n", x.rows, x.cols, y.rows, y.cols);
+        return -1;
     }
-
-    fscanf(fptr2, "%d", &tmp);
-    fscanf(fptr2, "%d", &tmp);
-     for(int i=0; i<matrix_row_y; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            if (fscanf(fptr2, "%d", &y[i][j])!=1){
-                printf("Error reading from file");
-                return;
-            }
-        }
-    }   
+    return 0;
 }
 
-void *thread1(void *arg){
-    char data[30];
-    sprintf(data, "%s", "Thread 1 says hello!");
-
-#if (THREAD_NUMBER == 1)
-    for(int i=0; i<matrix_row_x; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            for(int k=0; k<matrix_row_y; k++){
-                z[i][j] += x[i][k] * y[k][j];
-            }      
-        }
-    }
-#elif (THREAD_NUMBER == 2)
-    for(int i=0; i<matrix_row_x/2; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            for(int k=0; k<matrix_row_y; k++){
-                z[i][j] += x[i][k] * y[k][j];
-            }      
-        }
-    }
-#endif
+// Runs on every matmul worker once its tiles are done
+void thread_done(int worker, void *arg){
+    char data[40];
+    snprintf(data, sizeof(data), "Thread %d says hello!", worker + 1);
 
     /*YOUR CODE HERE*/
     /* Hint: Write data into proc file.*/
@@ -80,81 +53,39 @@ void *thread1(void *arg){
     }
     /****************/ 
 
+    // The proc file reports the reading thread, so each worker opens its own
     char buffer[50]; 
-    while (fgets(buffer, sizeof(buffer), fptr4) != NULL){
+    FILE *fptr = fopen("/proc/Mythread_info", "r");
+    if (fptr == NULL)
+        return;
+    while (fgets(buffer, sizeof(buffer), fptr) != NULL){
         printf("%s", buffer);
     }
+    fclose(fptr);
 }
 
-
-#if (THREAD_NUMBER == 2)
-void *thread2(void *arg){
-    char data[30];
-    sprintf(data, "%s", "Thread 2 says hello!");
-    for(int i=matrix_row_x/2; i<matrix_row_x; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            for(int k=0; k<matrix_row_y; k++){
-                z[i][j] += x[i][k] * y[k][j];
-            }     
-        }
-    }
-    
-    /*YOUR CODE HERE*/
-    /* Hint: Write data into proc file.*/
-    int fd = open("/proc/Mythread_info", O_WRONLY);
-    if (fd >= 0) {
-        write(fd, data, strlen(data));
-        close(fd);
-    }
-    /****************/   
-
-    char buffer[50]; 
-    while (fgets(buffer, sizeof(buffer), fptr5) != NULL){
-        printf("%s", buffer);
-    } 
-}
-#endif
-
 int main(){
-    char buffer[50];
-    x = malloc(sizeof(int*)*matrix_row_x);
-    for(int i=0; i<matrix_row_x; i++){
-        x[i] = malloc(sizeof(int)*matrix_col_x);
-    }
-    y = malloc(sizeof(int*)*matrix_row_y);
-    for(int i=0; i<matrix_row_y; i++){
-        y[i] = malloc(sizeof(int)*matrix_col_y);
+    if (data_processing(THREAD_NUMBER) < 0)
+        return 1;
+    if (matrix_alloc(&z, matrix_row_x, matrix_col_y) < 0) {
+        perror("matrix_alloc");
+        return 1;
     }
-    z = malloc(sizeof(int*)*matrix_row_x);
-    for(int i=0; i<matrix_row_x; i++){
-        z[i] = malloc(sizeof(int)*matrix_col_y);
-    }
-    fptr1 = fopen("m1.txt", "r");
-    fptr2 = fopen("m2.txt", "r");
     fptr3 = fopen("3_2.txt", "a");
-    fptr4 = fopen("/proc/Mythread_info", "r");
-    fptr5 = fopen("/proc/Mythread_info", "r");
-
-    pthread_t t1, t2;
-    data_processing();
-    fprintf(fptr3, "%d %d\n", matrix_row_x, matrix_col_y);
 
-    pthread_create(&t1, NULL, thread1, NULL);
-#if (THREAD_NUMBER==2)
-    pthread_create(&t2, NULL, thread2, NULL);
-#endif
-    pthread_join(t1, NULL);
-    pthread_join(t2, NULL);
-
-    for(int i=0; i<matrix_row_x; i++){
-        for(int j=0; j<matrix_col_y; j++){
-            fprintf(fptr3, "%d ", z[i][j]);
-            if(j==matrix_col_y-1) fprintf(fptr3, "\n");   
-        }
-    }
-    fclose(fptr1);
-    fclose(fptr2);
+    // THREAD_NUMBER workers share the output tiles (3_2_Config.h, see the Makefile)
+    matmul_config_t cfg;
+    matmul_default_config(&cfg);
+    cfg.threads = THREAD_NUMBER;
+    cfg.schedule = THREAD_SCHEDULE;
+    cfg.thread_done = thread_done;
+    cfg.block = gemm_select();  // widest SIMD kernel the CPU has, GEMM_ISA overrides
+    matmul(&x, &y, &z, &cfg);
+
+    if (matrix_write_text(fptr3, &z, THREAD_NUMBER) < 0)
+        perror("3_2.txt");
     fclose(fptr3);
-    fclose(fptr4);
-    fclose(fptr5);
+    matrix_close(&x, x_mapped);
+    matrix_close(&y, y_mapped);
+    matrix_free(&z);
 }
@@ -3,74 +3,484 @@
 #include <linux/init.h>
 #include <linux/printk.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/uaccess.h>
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/hrtimer.h>
+#include <linux/pid.h>
+#include <linux/pid_namespace.h>
+#include <linux/mutex.h>
+#include <linux/version.h>
 #include <asm/current.h>
+#include "Mythread_ring.h"
+
+/*
+ * /proc/Mythread_info   write: store a message for the calling thread
+ *                       read:  that message plus the caller's PID, TID,
+ *                              CPU time, context switches and CPU
+ * /proc/Mythread_all    read:  one line per thread that wrote, with the
+ *                              scheduling snapshot taken at its last write
+ *                       write: forget every record
+ *
+ * Records live in a hash table keyed by TID. Readers walk it under RCU
+ * only; a write allocates a new record and swaps it in under the lock of
+ * its bucket, so only threads hashing to the same bucket ever contend,
+ * and the old record is freed after a grace period. A record also keeps
+ * the task's start_time: a new thread that reuses a TID starts over
+ * instead of inheriting the dead one's counts. When MAX_RECORDS are in
+ * use, the records of threads that have exited are dropped first.
+ *
+ * /proc/Mythread_ring   mmap-able ring of timing samples with poll(), see
+ *                       Mythread_ring.h; fed by every Mythread_info write
+ *                       and optionally by a timer sampling one process
+ */
 
 #define procfs_name "Mythread_info"
-#define BUFSIZE  1024
-char buf[BUFSIZE]; //kernel buffer
-static char stored_data[256]; // Store the written string
-static int data_len = 0;
+#define procfs_all_name "Mythread_all"
+#define MSG_SIZE 256
+#define RECORD_BITS 8
+#define RECORD_BUCKETS (1 << RECORD_BITS)
+#define MAX_RECORDS 4096
+
+struct thread_record {
+    struct hlist_node node;
+    struct rcu_head rcu;
+    unsigned int bucket;
+    pid_t pid;
+    pid_t tgid;
+    u64 start_time;             // task->start_time, tells a reused TID apart
+    char comm[TASK_COMM_LEN];
+    char msg[MSG_SIZE];
+    u64 utime;                  // ns, at the last write
+    u64 stime;
+    unsigned long nvcsw;
+    unsigned long nivcsw;
+    int cpu;
+    u64 stamp;                  // ktime_get_ns() of the last write
+    unsigned long writes;
+};
+
+struct record_bucket {
+    struct hlist_head head;
+    spinlock_t lock;            // writers only
+} ____cacheline_aligned_in_smp;
+
+static struct record_bucket buckets[RECORD_BUCKETS];
+static atomic_t record_count = ATOMIC_INIT(0);
+
+static struct thread_record *record_find(unsigned int bucket, pid_t pid){
+    struct thread_record *r;
+
+    hlist_for_each_entry_rcu(r, &buckets[bucket].head, node,
+                             lockdep_is_held(&buckets[bucket].lock)) {
+        if (r->pid == pid)
+            return r;
+    }
+    return NULL;
+}
+
+// The record was written by a thread that has exited (its TID may be in use again)
+static bool record_stale(const struct thread_record *r){
+    struct task_struct *t;
+    bool stale;
+
+    rcu_read_lock();
+    t = pid_task(find_pid_ns(r->pid, &init_pid_ns), PIDTYPE_PID);
+    stale = !t || t->start_time != r->start_time;
+    rcu_read_unlock();
+    return stale;
+}
+
+// Drop every record, or only those of threads that have exited
+static void records_drop(bool stale_only){
+    for (int b = 0; b < RECORD_BUCKETS; b++) {
+        struct thread_record *r;
+        struct hlist_node *tmp;
+
+        spin_lock(&buckets[b].lock);
+        hlist_for_each_entry_safe(r, tmp, &buckets[b].head, node) {
+            if (stale_only && !record_stale(r))
+                continue;
+            hlist_del_rcu(&r->node);
+            atomic_dec(&record_count);
+            kfree_rcu(r, rcu);
+        }
+        spin_unlock(&buckets[b].lock);
+    }
+}
+
+static struct mythread_ring_header *ring;      // vmalloc_user(), mapped by readers
+static struct mythread_sample *ring_samples;
+static DEFINE_SPINLOCK(ring_lock);              // producers: writers and the timer
+static DECLARE_WAIT_QUEUE_HEAD(ring_wait);
+
+static struct hrtimer ring_timer;
+static DEFINE_MUTEX(ring_config);              // serialises timer (re)configuration
+static struct pid *sample_pid;
+static ktime_t sample_period;
+
+// Call with ring_lock held; the reader owns tail, so it is re-checked every time
+static void ring_produce(struct task_struct *t, u32 source, u64 now){
+    u64 head = ring->head;
+    u64 tail = smp_load_acquire(&ring->tail);
+    struct mythread_sample *s;
+
+    if (head - tail >= MYTHREAD_RING_SAMPLES) {
+        ring->lost++;
+        return;
+    }
+    s = &ring_samples[head & (MYTHREAD_RING_SAMPLES - 1)];
+    s->time_ns = now;
+    s->utime_ns = t->utime;
+    s->stime_ns = t->stime;
+    s->nvcsw = t->nvcsw;
+    s->nivcsw = t->nivcsw;
+    s->tid = t->pid;
+    s->tgid = t->tgid;
+    s->cpu = task_cpu(t);
+    s->source = source;
+    smp_store_release(&ring->head, head + 1);
+}
+
+static void ring_wake(void){
+    if (wq_has_sleeper(&ring_wait))
+        wake_up_interruptible(&ring_wait);
+}
+
+static enum hrtimer_restart ring_tick(struct hrtimer *timer){
+    struct task_struct *leader, *t;
+    u64 now = ktime_get_ns();
+    unsigned long flags;
+
+    rcu_read_lock();
+    leader = pid_task(sample_pid, PIDTYPE_TGID);
+    if (!leader) {
+        rcu_read_unlock();
+        return HRTIMER_NORESTART;   // the process is gone
+    }
+    spin_lock_irqsave(&ring_lock, flags);
+    for_each_thread(leader, t)
+        ring_produce(t, MYTHREAD_SAMPLE_TIMER, now);
+    spin_unlock_irqrestore(&ring_lock, flags);
+    rcu_read_unlock();
+
+    ring_wake();
+    hrtimer_forward_now(timer, sample_period);
+    return HRTIMER_RESTART;
+}
+
+// Stop sampling, then sample tgid every period_us if tgid > 0
+static int ring_configure(pid_t tgid, unsigned int period_us){
+    struct pid *pid = NULL;
+
+    if (tgid > 0) {
+        pid = find_get_pid(tgid);
+        if (!pid)
+            return -ESRCH;
+    }
+    mutex_lock(&ring_config);
+    hrtimer_cancel(&ring_timer);
+    put_pid(sample_pid);
+    sample_pid = pid;
+    if (pid) {
+        if (period_us < MYTHREAD_RING_MIN_PERIOD_US)
+            period_us = MYTHREAD_RING_MIN_PERIOD_US;
+        sample_period = ns_to_ktime((u64)period_us * NSEC_PER_USEC);
+        hrtimer_start(&ring_timer, sample_period, HRTIMER_MODE_REL);
+    }
+    mutex_unlock(&ring_config);
+    return 0;
+}
 
 static ssize_t Mywrite(struct file *fileptr, const char __user *ubuf, size_t buffer_len, loff_t *offset){
     /*Your code here*/
-    if (buffer_len >= sizeof(stored_data))
-        buffer_len = sizeof(stored_data) - 1;
-    
-    if (copy_from_user(stored_data, ubuf, buffer_len))
+    unsigned int bucket = hash_32(current->pid, RECORD_BITS);
+    struct record_bucket *b = &buckets[bucket];
+    struct thread_record *r, *old;
+    size_t len = buffer_len;
+
+    if (len >= MSG_SIZE)
+        len = MSG_SIZE - 1;
+
+    r = kzalloc(sizeof(*r), GFP_KERNEL);
+    if (!r)
+        return -ENOMEM;
+    if (copy_from_user(r->msg, ubuf, len)) {
+        kfree(r);
         return -EFAULT;
-    
-    stored_data[buffer_len] = '\0';
-    data_len = buffer_len;
-    
+    }
+    r->msg[len] = '\0';
     // Remove newline if present
-    if (data_len > 0 && stored_data[data_len - 1] == '\n') {
-        stored_data[data_len - 1] = '\0';
-        data_len--;
+    if (len > 0 && r->msg[len - 1] == '\n')
+        r->msg[len - 1] = '\0';
+
+    r->bucket = bucket;
+    r->pid = current->pid;
+    r->tgid = current->tgid;
+    r->start_time = current->start_time;
+    get_task_comm(r->comm, current);
+    r->utime = current->utime;
+    r->stime = current->stime;
+    r->nvcsw = current->nvcsw;
+    r->nivcsw = current->nivcsw;
+    r->cpu = raw_smp_processor_id();
+    r->stamp = ktime_get_ns();
+    r->writes = 1;
+
+    // A full table first makes room by dropping the records of exited threads
+    if (atomic_read(&record_count) >= MAX_RECORDS)
+        records_drop(true);
+
+    spin_lock(&b->lock);
+    old = record_find(bucket, r->pid);
+    if (old) {
+        if (old->start_time == r->start_time)
+            r->writes = old->writes + 1;
+        hlist_replace_rcu(&old->node, &r->node);
+    } else if (atomic_inc_return(&record_count) > MAX_RECORDS) {
+        atomic_dec(&record_count);
+        spin_unlock(&b->lock);
+        kfree(r);
+        return -ENOSPC;
+    } else {
+        hlist_add_head_rcu(&r->node, &b->head);
     }
-    
+    spin_unlock(&b->lock);
+
+    if (old)
+        kfree_rcu(old, rcu);
+
+    spin_lock_irq(&ring_lock);
+    ring_produce(current, MYTHREAD_SAMPLE_WRITE, r->stamp);
+    spin_unlock_irq(&ring_lock);
+    ring_wake();
     return buffer_len;
     /****************/
 }
 
-
-static ssize_t Myread(struct file *fileptr, char __user *ubuf, size_t buffer_len, loff_t *offset){
+static int Myshow(struct seq_file *m, void *v){
     /*Your code here*/
-    int len = 0;
-    
-    if (*offset > 0)
-        return 0;
-    
+    struct thread_record *r;
+
     // Display the string written by the thread
-    if (data_len > 0) {
-        len += sprintf(buf + len, "String: %s\n", stored_data);
-    }
-    
+    rcu_read_lock();
+    r = record_find(hash_32(current->pid, RECORD_BITS), current->pid);
+    if (r && r->start_time == current->start_time && r->msg[0])
+        seq_printf(m, "String: %s\n", r->msg);
+    rcu_read_unlock();
+
     // Display thread info
-    len += sprintf(buf + len, "PID: %d\n", current->tgid);
-    len += sprintf(buf + len, "TID: %d\n", current->pid);
-    len += sprintf(buf + len, "Time (ms): %llu\n", current->utime / 100 / 1000);
-    
-    if (copy_to_user(ubuf, buf, len))
-        return -EFAULT;
-    
-    *offset = len;
-    return len;
+    seq_printf(m, "PID: %d\n", current->tgid);
+    seq_printf(m, "TID: %d\n", current->pid);
+    seq_printf(m, "Time (ms): %llu\n", current->utime / 100 / 1000);
+    seq_printf(m, "System time (ms): %llu\n", div_u64(current->stime, NSEC_PER_MSEC));
+    seq_printf(m, "Context switches: %lu voluntary, %lu involuntary\n",
+               current->nvcsw, current->nivcsw);
+    seq_printf(m, "CPU: %d\n", raw_smp_processor_id());
+    return 0;
     /****************/
 }
 
+static int Myopen(struct inode *inode, struct file *file){
+    return single_open(file, Myshow, NULL);
+}
+
+// Record number pos - 1 in bucket order (pos 0 is the header)
+static struct thread_record *record_at(loff_t pos){
+    struct thread_record *r;
+
+    for (int b = 0; b < RECORD_BUCKETS; b++) {
+        hlist_for_each_entry_rcu(r, &buckets[b].head, node) {
+            if (--pos == 0)
+                return r;
+        }
+    }
+    return NULL;
+}
+
+static struct thread_record *record_after(struct thread_record *r){
+    struct hlist_node *n = rcu_dereference(hlist_next_rcu(&r->node));
+
+    for (unsigned int b = r->bucket + 1; !n && b < RECORD_BUCKETS; b++)
+        n = rcu_dereference(hlist_first_rcu(&buckets[b].head));
+    return n ? hlist_entry(n, struct thread_record, node) : NULL;
+}
+
+static void *all_start(struct seq_file *m, loff_t *pos)
+    __acquires(RCU)
+{
+    rcu_read_lock();
+    return *pos == 0 ? SEQ_START_TOKEN : record_at(*pos);
+}
+
+static void *all_next(struct seq_file *m, void *v, loff_t *pos){
+    (*pos)++;
+    if (v == SEQ_START_TOKEN)
+        return record_at(1);
+    return record_after(v);
+}
+
+static void all_stop(struct seq_file *m, void *v)
+    __releases(RCU)
+{
+    rcu_read_unlock();
+}
+
+static int all_show(struct seq_file *m, void *v){
+    struct thread_record *r = v;
+
+    if (v == SEQ_START_TOKEN) {
+        seq_puts(m, "TID\tPID\tCPU\tUTIME_MS\tSTIME_MS\tNVCSW\tNIVCSW\tWRITES\tAGE_MS\tCOMM\tSTRING\n");
+        return 0;
+    }
+    seq_printf(m, "%d\t%d\t%d\t%llu\t%llu\t%lu\t%lu\t%lu\t%llu\t%s\t%s\n",
+               r->pid, r->tgid, r->cpu,
+               div_u64(r->utime, NSEC_PER_MSEC), div_u64(r->stime, NSEC_PER_MSEC),
+               r->nvcsw, r->nivcsw, r->writes,
+               div_u64(ktime_get_ns() - r->stamp, NSEC_PER_MSEC), r->comm, r->msg);
+    return 0;
+}
+
+static const struct seq_operations all_seq_ops = {
+    .start = all_start,
+    .next = all_next,
+    .stop = all_stop,
+    .show = all_show,
+};
+
+static int all_open(struct inode *inode, struct file *file){
+    return seq_open(file, &all_seq_ops);
+}
+
+static ssize_t all_write(struct file *fileptr, const char __user *ubuf, size_t buffer_len, loff_t *offset){
+    records_drop(false);
+    return buffer_len;
+}
+
+// A mapping outlives the open file: keep the module (and the ring) until it is gone
+static void ring_vm_open(struct vm_area_struct *vma){
+    __module_get(THIS_MODULE);
+}
+
+static void ring_vm_close(struct vm_area_struct *vma){
+    module_put(THIS_MODULE);
+}
+
+static const struct vm_operations_struct ring_vm_ops = {
+    .open = ring_vm_open,
+    .close = ring_vm_close,
+};
+
+static int ring_mmap(struct file *file, struct vm_area_struct *vma){
+    int err = remap_vmalloc_range(vma, ring, vma->vm_pgoff);
+
+    if (err)
+        return err;
+    vma->vm_ops = &ring_vm_ops;
+    ring_vm_open(vma);
+    return 0;
+}
+
+static __poll_t ring_poll(struct file *file, poll_table *wait){
+    poll_wait(file, &ring_wait, wait);
+    return smp_load_acquire(&ring->head) != READ_ONCE(ring->tail) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+// "<pid> <period_us>" starts periodic sampling of pid's threads, "0" stops it
+static ssize_t ring_write(struct file *fileptr, const char __user *ubuf, size_t buffer_len, loff_t *offset){
+    char kbuf[32];
+    size_t len = min(buffer_len, sizeof(kbuf) - 1);
+    unsigned int period_us = 1000;
+    int tgid, err;
+
+    if (copy_from_user(kbuf, ubuf, len))
+        return -EFAULT;
+    kbuf[len] = '\0';
+    if (sscanf(kbuf, "%d %u", &tgid, &period_us) < 1)
+        return -EINVAL;
+    err = ring_configure(tgid, period_us);
+    return err ? err : buffer_len;
+}
+
 static struct proc_ops Myops = {
-    .proc_read = Myread,
+    .proc_open = Myopen,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
     .proc_write = Mywrite,
 };
 
+static struct proc_ops Allops = {
+    .proc_open = all_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = seq_release,
+    .proc_write = all_write,
+};
+
+static struct proc_ops Ringops = {
+    .proc_mmap = ring_mmap,
+    .proc_poll = ring_poll,
+    .proc_write = ring_write,
+    .proc_lseek = noop_llseek,
+};
+
 static int My_Kernel_Init(void){
-    proc_create(procfs_name, 0644, NULL, &Myops);   
+    for (int b = 0; b < RECORD_BUCKETS; b++) {
+        INIT_HLIST_HEAD(&buckets[b].head);
+        spin_lock_init(&buckets[b].lock);
+    }
+
+    ring = vmalloc_user(PAGE_ALIGN(MYTHREAD_RING_BYTES));
+    if (!ring)
+        return -ENOMEM;
+    ring->capacity = MYTHREAD_RING_SAMPLES;
+    ring->sample_size = sizeof(struct mythread_sample);
+    ring_samples = (struct mythread_sample *)((char *)ring + MYTHREAD_RING_HEADER);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&ring_timer, ring_tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+    hrtimer_init(&ring_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    ring_timer.function = ring_tick;
+#endif
+
+    if (!proc_create(procfs_name, 0644, NULL, &Myops))
+        goto fail;
+    if (!proc_create(procfs_all_name, 0644, NULL, &Allops))
+        goto fail_all;
+    if (!proc_create(MYTHREAD_RING_NAME, 0644, NULL, &Ringops))
+        goto fail_ring;
     pr_info("My kernel says Hi");
     return 0;
+
+fail_ring:
+    remove_proc_entry(procfs_all_name, NULL);
+fail_all:
+    remove_proc_entry(procfs_name, NULL);
+fail:
+    vfree(ring);
+    return -ENOMEM;
 }
 
 static void My_Kernel_Exit(void){
+    remove_proc_entry(MYTHREAD_RING_NAME, NULL);
+    remove_proc_entry(procfs_all_name, NULL);
     remove_proc_entry(procfs_name, NULL);
+    ring_configure(0, 0);
+    vfree(ring);
+    records_drop(false);
+    rcu_barrier();      // the kfree_rcu() callbacks must run before the module text goes
     pr_info("My kernel says GOODBYE");
 }
 
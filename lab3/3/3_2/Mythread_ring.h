@@ -0,0 +1,54 @@
+#ifndef MYTHREAD_RING_H
+#define MYTHREAD_RING_H
+
+#include <linux/types.h>
+
+/*
+ * Layout of /proc/Mythread_ring, shared by My_Kernel.c and its readers.
+ *
+ * mmap() MYTHREAD_RING_BYTES of the file (MAP_SHARED, read-write): one
+ * header page, then MYTHREAD_RING_SAMPLES sample slots. The module
+ * writes sample head % MYTHREAD_RING_SAMPLES and then publishes head
+ * with a release store. The reader consumes up to head and releases
+ * slots by storing tail; nothing on that path is a syscall. When the
+ * ring is full new samples are dropped and counted in lost. poll()
+ * reports POLLIN while head != tail.
+ *
+ * Samples come from every write to /proc/Mythread_info and, after
+ * writing "<pid> <period_us>" to /proc/Mythread_ring, from a timer that
+ * samples every thread of pid each period ("0" stops it).
+ */
+
+#define MYTHREAD_RING_NAME "Mythread_ring"
+#define MYTHREAD_RING_SAMPLES 4096          // power of two
+#define MYTHREAD_RING_HEADER 4096
+#define MYTHREAD_RING_BYTES (MYTHREAD_RING_HEADER + MYTHREAD_RING_SAMPLES * sizeof(struct mythread_sample))
+#define MYTHREAD_RING_MIN_PERIOD_US 10
+
+#define MYTHREAD_SAMPLE_WRITE 1     // the thread wrote to Mythread_info
+#define MYTHREAD_SAMPLE_TIMER 2     // periodic sample
+
+struct mythread_sample {
+    __u64 time_ns;          // ktime_get_ns()
+    __u64 utime_ns;
+    __u64 stime_ns;
+    __u64 nvcsw;
+    __u64 nivcsw;
+    __s32 tid;
+    __s32 tgid;
+    __s32 cpu;
+    __u32 source;           // MYTHREAD_SAMPLE_*
+    __u64 reserved;
+};
+
+struct mythread_ring_header {
+    __u64 head;             // written by the module
+    __u64 lost;
+    __u32 capacity;         // MYTHREAD_RING_SAMPLES
+    __u32 sample_size;      // sizeof(struct mythread_sample)
+    __u8 pad0[40];
+    __u64 tail;             // written by the reader, own cache line
+    __u8 pad1[MYTHREAD_RING_HEADER - 72];
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include "Mythread_ring.h"
+
+/*
+    Consume /proc/Mythread_ring without a syscall per sample.
+
+    ./ring_reader [-p pid] [-i period_us] [-n samples]
+    -p  also sample every thread of pid each period (default 1000 us)
+    -n  stop after this many samples (default: until pid exits or ^C)
+*/
+int main(int argc, char *argv[]){
+    int pid = 0, period_us = 1000, opt;
+    long limit = -1, seen = 0;
+
+    while ((opt = getopt(argc, argv, "p:i:n:")) != -1) {
+        switch (opt) {
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'i':
+            period_us = atoi(optarg);
+            break;
+        case 'n':
+            limit = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p pid] [-i period_us] [-n samples]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int fd = open("/proc/" MYTHREAD_RING_NAME, O_RDWR);
+    if (fd < 0) {
+        perror("/proc/" MYTHREAD_RING_NAME);
+        return 1;
+    }
+    struct mythread_ring_header *h = mmap(NULL, MYTHREAD_RING_BYTES, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const struct mythread_sample *samples =
+        (const struct mythread_sample *)((char *)h + MYTHREAD_RING_HEADER);
+    if (h->capacity != MYTHREAD_RING_SAMPLES || h->sample_size != sizeof(struct mythread_sample)) {
+        fprintf(stderr, "ring layout does not match Mythread_ring.h\n");
+        return 1;
+    }
+    if (pid > 0 && dprintf(fd, "%d %d", pid, period_us) < 0) {
+        perror("start sampling");
+        return 1;
+    }
+
+    printf("TIME_NS\tTID\tPID\tCPU\tUTIME_NS\tSTIME_NS\tNVCSW\tNIVCSW\tSOURCE\n");
+    __u64 tail = h->tail;
+    while (limit < 0 || seen < limit) {
+        __u64 head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            // Empty: sleep in poll() until the module produces, stop when the sampled process is gone
+            struct pollfd p = { .fd = fd, .events = POLLIN };
+            if (poll(&p, 1, 1000) == 0 && pid > 0 && kill(pid, 0) < 0)
+                break;
+            continue;
+        }
+        for (; tail != head && (limit < 0 || seen < limit); tail++, seen++) {
+            const struct mythread_sample *s = &samples[tail & (MYTHREAD_RING_SAMPLES - 1)];
+            printf("%llu\t%d\t%d\t%d\t%llu\t%llu\t%llu\t%llu\t%s\n",
+                   (unsigned long long)s->time_ns, s->tid, s->tgid, s->cpu,
+                   (unsigned long long)s->utime_ns, (unsigned long long)s->stime_ns,
+                   (unsigned long long)s->nvcsw, (unsigned long long)s->nivcsw,
+                   s->source == MYTHREAD_SAMPLE_TIMER ? "timer" : "write");
+        }
+        // Hand the slots back only after they were read
+        __atomic_store_n(&h->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (pid > 0)
+        dprintf(fd, "0");
+    fprintf(stderr, "%ld samples, %llu lost\n", seen, (unsigned long long)h->lost);
+    munmap(h, MYTHREAD_RING_BYTES);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,266 @@
+#ifndef GEMM_SIMD_H
+#define GEMM_SIMD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matmul.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define GEMM_NEON 1
+#endif
+
+/*
+    SIMD 32-bit integer GEMM for the matmul engine (cfg.block = gemm_block).
+
+    For every tile_k slice of a tile, x is packed into slivers of GEMM_MR
+    rows (k-major: the MR values of one k are adjacent) and y into panels
+    of nr columns (the nr values of one k are adjacent, zero padded at the
+    right edge). The micro-kernel then keeps an MR x nr block of z in
+    vector registers for the whole slice: per k it loads nr values of the
+    y panel, broadcasts each of the MR x values and multiply-adds. No
+    pointer chasing and only unit-stride loads, whatever the shapes.
+
+    The kernel is picked at runtime from what CPUID reports: AVX-512F (nr
+    32), AVX2 (16), SSE4.1 (8) on x86, NEON (8) on AArch64, else portable
+    C. GEMM_ISA=none|scalar|sse4.1|avx2|avx512|neon in the environment
+    forces one (if the CPU has it), "none" keeps the unpacked matmul_block.
+    Products wrap modulo 2^32 exactly like the scalar int code.
+*/
+
+#define GEMM_MR 4
+#define GEMM_MAX_NR 32
+
+typedef void (*gemm_kernel_fn)(int kc, const int *xp, const int *yp, int *c, int ldc);
+
+typedef struct {
+    const char *name;
+    int nr;                 // panel width, a multiple of the vector width
+    gemm_kernel_fn kernel;  // c[MR x nr] (row stride ldc) += xp sliver * yp panel
+} gemm_isa_t;
+
+static void gemm_kernel_scalar(int kc, const int *xp, const int *yp, int *c, int ldc){
+    int acc[GEMM_MR][4] = {{0}};
+
+    for (int k = 0; k < kc; k++, xp += GEMM_MR, yp += 4)
+        for (int r = 0; r < GEMM_MR; r++)
+            for (int j = 0; j < 4; j++)
+                acc[r][j] += xp[r] * yp[j];
+    for (int r = 0; r < GEMM_MR; r++)
+        for (int j = 0; j < 4; j++)
+            c[r * ldc + j] += acc[r][j];
+}
+
+#ifdef GEMM_X86
+__attribute__((target("sse4.1")))
+static void gemm_kernel_sse41(int kc, const int *xp, const int *yp, int *c, int ldc){
+    __m128i acc[GEMM_MR][2];
+
+    for (int r = 0; r < GEMM_MR; r++)
+        acc[r][0] = acc[r][1] = _mm_setzero_si128();
+    for (int k = 0; k < kc; k++, xp += GEMM_MR, yp += 8) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)yp);
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(yp + 4));
+        for (int r = 0; r < GEMM_MR; r++) {
+            __m128i a = _mm_set1_epi32(xp[r]);
+            acc[r][0] = _mm_add_epi32(acc[r][0], _mm_mullo_epi32(a, b0));
+            acc[r][1] = _mm_add_epi32(acc[r][1], _mm_mullo_epi32(a, b1));
+        }
+    }
+    for (int r = 0; r < GEMM_MR; r++) {
+        __m128i *row = (__m128i *)(c + r * ldc);
+        _mm_storeu_si128(row, _mm_add_epi32(_mm_loadu_si128(row), acc[r][0]));
+        _mm_storeu_si128(row + 1, _mm_add_epi32(_mm_loadu_si128(row + 1), acc[r][1]));
+    }
+}
+
+__attribute__((target("avx2")))
+static void gemm_kernel_avx2(int kc, const int *xp, const int *yp, int *c, int ldc){
+    __m256i acc[GEMM_MR][2];
+
+    for (int r = 0; r < GEMM_MR; r++)
+        acc[r][0] = acc[r][1] = _mm256_setzero_si256();
+    for (int k = 0; k < kc; k++, xp += GEMM_MR, yp += 16) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)yp);
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(yp + 8));
+        for (int r = 0; r < GEMM_MR; r++) {
+            __m256i a = _mm256_set1_epi32(xp[r]);
+            acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_mullo_epi32(a, b0));
+            acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_mullo_epi32(a, b1));
+        }
+    }
+    for (int r = 0; r < GEMM_MR; r++) {
+        __m256i *row = (__m256i *)(c + r * ldc);
+        _mm256_storeu_si256(row, _mm256_add_epi32(_mm256_loadu_si256(row), acc[r][0]));
+        _mm256_storeu_si256(row + 1, _mm256_add_epi32(_mm256_loadu_si256(row + 1), acc[r][1]));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void gemm_kernel_avx512(int kc, const int *xp, const int *yp, int *c, int ldc){
+    __m512i acc[GEMM_MR][2];
+
+    for (int r = 0; r < GEMM_MR; r++)
+        acc[r][0] = acc[r][1] = _mm512_setzero_si512();
+    for (int k = 0; k < kc; k++, xp += GEMM_MR, yp += 32) {
+        __m512i b0 = _mm512_loadu_si512(yp);
+        __m512i b1 = _mm512_loadu_si512(yp + 16);
+        for (int r = 0; r < GEMM_MR; r++) {
+            __m512i a = _mm512_set1_epi32(xp[r]);
+            acc[r][0] = _mm512_add_epi32(acc[r][0], _mm512_mullo_epi32(a, b0));
+            acc[r][1] = _mm512_add_epi32(acc[r][1], _mm512_mullo_epi32(a, b1));
+        }
+    }
+    for (int r = 0; r < GEMM_MR; r++) {
+        int *row = c + r * ldc;
+        _mm512_storeu_si512(row, _mm512_add_epi32(_mm512_loadu_si512(row), acc[r][0]));
+        _mm512_storeu_si512(row + 16, _mm512_add_epi32(_mm512_loadu_si512(row + 16), acc[r][1]));
+    }
+}
+#endif
+
+#ifdef GEMM_NEON
+static void gemm_kernel_neon(int kc, const int *xp, const int *yp, int *c, int ldc){
+    int32x4_t acc[GEMM_MR][2];
+
+    for (int r = 0; r < GEMM_MR; r++)
+        acc[r][0] = acc[r][1] = vdupq_n_s32(0);
+    for (int k = 0; k < kc; k++, xp += GEMM_MR, yp += 8) {
+        int32x4_t b0 = vld1q_s32(yp);
+        int32x4_t b1 = vld1q_s32(yp + 4);
+        for (int r = 0; r < GEMM_MR; r++) {
+            acc[r][0] = vmlaq_n_s32(acc[r][0], b0, xp[r]);
+            acc[r][1] = vmlaq_n_s32(acc[r][1], b1, xp[r]);
+        }
+    }
+    for (int r = 0; r < GEMM_MR; r++) {
+        int *row = c + r * ldc;
+        vst1q_s32(row, vaddq_s32(vld1q_s32(row), acc[r][0]));
+        vst1q_s32(row + 4, vaddq_s32(vld1q_s32(row + 4), acc[r][1]));
+    }
+}
+#endif
+
+static const gemm_isa_t gemm_isas[] = {
+#ifdef GEMM_X86
+    { "avx512", 32, gemm_kernel_avx512 },
+    { "avx2", 16, gemm_kernel_avx2 },
+    { "sse4.1", 8, gemm_kernel_sse41 },
+#endif
+#ifdef GEMM_NEON
+    { "neon", 8, gemm_kernel_neon },
+#endif
+    { "scalar", 4, gemm_kernel_scalar },
+};
+#define GEMM_ISA_COUNT ((int)(sizeof(gemm_isas) / sizeof(gemm_isas[0])))
+
+static const gemm_isa_t *gemm_active = &gemm_isas[GEMM_ISA_COUNT - 1];
+
+static inline int gemm_isa_supported(const gemm_isa_t *isa){
+#ifdef GEMM_X86
+    __builtin_cpu_init();
+    if (strcmp(isa->name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+    if (strcmp(isa->name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(isa->name, "sse4.1") == 0)
+        return __builtin_cpu_supports("sse4.1");
+#endif
+    return 1;
+}
+
+/*
+    z[i0:i1, j0:j1] += x[i0:i1, k0:k1] * y[k0:k1, j0:j1] through the packed
+    micro-kernel of gemm_active. Same contract as matmul_block().
+*/
+static inline void gemm_block(const matrix_t *x, const matrix_t *y, matrix_t *z,
+                              int i0, int i1, int j0, int j1, int k0, int k1, int tile_k){
+    const gemm_isa_t *isa = gemm_active;
+    const int nr = isa->nr;
+    int m = i1 - i0, n = j1 - j0;
+    int mpad = (m + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+    int npad = (n + nr - 1) / nr * nr;
+    int kmax = tile_k < k1 - k0 ? tile_k : k1 - k0;
+    int *xpack = malloc(sizeof(int) * ((size_t)mpad * kmax + (size_t)npad * kmax));
+    int *ypack = xpack + (size_t)mpad * kmax;
+    int edge[GEMM_MR * GEMM_MAX_NR];
+
+    if (xpack == NULL) {
+        matmul_block(x, y, z, i0, i1, j0, j1, k0, k1, tile_k);
+        return;
+    }
+
+    for (int kk = k0; kk < k1; kk += tile_k) {
+        int kc = kk + tile_k < k1 ? tile_k : k1 - kk;
+
+        // y[kk:kk+kc, j0:j1] -> panels of nr columns, k-major inside a panel
+        for (int p = 0; p < npad; p += nr) {
+            int *dst = ypack + (size_t)p * kc;
+            int cols = n - p < nr ? n - p : nr;
+            for (int k = 0; k < kc; k++, dst += nr) {
+                memcpy(dst, &MAT(y, kk + k, j0 + p), cols * sizeof(int));
+                memset(dst + cols, 0, (nr - cols) * sizeof(int));
+            }
+        }
+        // x[i0:i1, kk:kk+kc] -> slivers of MR rows, k-major inside a sliver
+        for (int s = 0; s < mpad; s += GEMM_MR) {
+            int *dst = xpack + (size_t)s * kc;
+            for (int k = 0; k < kc; k++)
+                for (int r = 0; r < GEMM_MR; r++)
+                    *dst++ = (s + r < m) ? MAT(x, i0 + s + r, kk + k) : 0;
+        }
+
+        for (int s = 0; s < mpad; s += GEMM_MR) {
+            const int *xs = xpack + (size_t)s * kc;
+            int rows = m - s < GEMM_MR ? m - s : GEMM_MR;
+            for (int p = 0; p < npad; p += nr) {
+                const int *yp = ypack + (size_t)p * kc;
+                int cols = n - p < nr ? n - p : nr;
+                if (rows == GEMM_MR && cols == nr) {
+                    isa->kernel(kc, xs, yp, &MAT(z, i0 + s, j0 + p), z->cols);
+                    continue;
+                }
+                // Ragged edge: run the kernel on a scratch block, add the valid part
+                memset(edge, 0, sizeof(edge));
+                isa->kernel(kc, xs, yp, edge, nr);
+                for (int r = 0; r < rows; r++)
+                    for (int j = 0; j < cols; j++)
+                        MAT(z, i0 + s + r, j0 + p + j) += edge[r * nr + j];
+            }
+        }
+    }
+    free(xpack);
+}
+
+/*
+    Choose the kernel: the GEMM_ISA environment variable if set and
+    supported, else the widest one the CPU has. Returns the block function
+    for matmul_config_t.block (matmul_block for GEMM_ISA=none).
+*/
+static inline matmul_block_fn gemm_select(void){
+    const char *want = getenv("GEMM_ISA");
+    int i;
+
+    if (want && strcmp(want, "none") == 0)
+        return matmul_block;
+    if (want) {
+        for (i = 0; i < GEMM_ISA_COUNT && strcmp(want, gemm_isas[i].name) != 0; i++)
+            ;
+        if (i < GEMM_ISA_COUNT && gemm_isa_supported(&gemm_isas[i])) {
+            gemm_active = &gemm_isas[i];
+            return gemm_block;
+        }
+        fprintf(stderr, "gemm: %s is %s, using the best supported kernel\n",
+                want, i < GEMM_ISA_COUNT ? "not supported by this CPU" : "unknown");
+    }
+    for (i = 0; !gemm_isa_supported(&gemm_isas[i]); i++)
+        ;   // the last entry (scalar) is always supported
+    gemm_active = &gemm_isas[i];
+    return gemm_block;
+}
+
+#endif
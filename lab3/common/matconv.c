@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "matio.h"
+
+/*
+    matconv in out      text -> binary or binary -> text, whichever in is
+    matconv -t in out   always write text
+    matconv -b in out   always write binary
+*/
+int main(int argc, char *argv[]){
+    int to = 0;     // 't', 'b' or 0 for the other format
+    int opt;
+    matrix_t m;
+
+    while ((opt = getopt(argc, argv, "tb")) != -1) {
+        switch (opt) {
+        case 't':
+        case 'b':
+            to = opt;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t | -b] in out\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-t | -b] in out\n", argv[0]);
+        return 1;
+    }
+    const char *in = argv[optind], *out = argv[optind + 1];
+
+    if (to == 0) {
+        FILE *f = fopen(in, "rb");
+        char magic[4] = {0};
+        if (f == NULL) {
+            perror(in);
+            return 1;
+        }
+        to = fread(magic, 1, 4, f) == 4 && memcmp(magic, MATIO_MAGIC, 4) == 0 ? 't' : 'b';
+        fclose(f);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (matrix_load(in, &m, cpus > 0 ? (int)cpus : 1) < 0)
+        return 1;
+
+    int r = 0;
+    if (to == 'b') {
+        r = matrix_write_binary(out, &m);
+    } else {
+        FILE *f = fopen(out, "w");
+        if (f == NULL || matrix_write_text(f, &m, cpus > 0 ? (int)cpus : 1) < 0 || fclose(f) != 0) {
+            perror(out);
+            r = -1;
+        }
+    }
+    matrix_free(&m);
+    return r < 0 ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+#ifndef MATMUL_H
+#define MATMUL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+    Integer matrix multiplication engine for lab3, z += x * y.
+
+    Matrices are contiguous row-major, so rows are adjacent in memory and
+    a whole matrix is one allocation. The output is cut into tile_i x
+    tile_j tiles which are handed out to the worker threads, statically
+    (thread w gets the w-th contiguous share) or dynamically (threads pull
+    the next tile from a shared atomic counter until none are left).
+
+    Inside a tile the k dimension is blocked by tile_k and the loops run in
+    i-k-j order: x[i][k] stays in a register while row k of y and row i of
+    z are streamed sequentially, which the compiler turns into SIMD code.
+    The defaults keep a tile_k x tile_j panel of y (64 KiB) in L2 and the
+    z row segment plus one y row in L1.
+*/
+
+#define MATMUL_STATIC 0
+#define MATMUL_DYNAMIC 1
+
+#define MATMUL_TILE_I 32
+#define MATMUL_TILE_J 256
+#define MATMUL_TILE_K 64
+#define MATMUL_ALIGN 64
+
+typedef struct {
+    int rows;
+    int cols;
+    int *data;      // rows * cols, row-major
+} matrix_t;
+
+#define MAT(m, i, j) ((m)->data[(size_t)(i) * (m)->cols + (j)])
+
+static inline void matmul_block(const matrix_t *x, const matrix_t *y, matrix_t *z,
+                                int i0, int i1, int j0, int j1, int k0, int k1, int tile_k);
+
+typedef void (*matmul_block_fn)(const matrix_t *x, const matrix_t *y, matrix_t *z,
+                                int i0, int i1, int j0, int j1, int k0, int k1, int tile_k);
+
+typedef struct {
+    int threads;
+    int schedule;   // MATMUL_STATIC or MATMUL_DYNAMIC
+    int tile_i;
+    int tile_j;
+    int tile_k;
+    // Computes one tile, matmul_block or a drop-in like gemm_block (gemm_simd.h)
+    matmul_block_fn block;
+    // Optional, called by every worker after its last tile (e.g. per-thread reporting)
+    void (*thread_done)(int worker, void *arg);
+    void *arg;
+} matmul_config_t;
+
+// Zero-filled, cache-line aligned; returns -1 when out of memory
+static inline int matrix_alloc(matrix_t *m, int rows, int cols){
+    size_t bytes = (size_t)rows * cols * sizeof(int);
+
+    bytes = (bytes + MATMUL_ALIGN - 1) & ~(size_t)(MATMUL_ALIGN - 1);
+    m->rows = rows;
+    m->cols = cols;
+    m->data = aligned_alloc(MATMUL_ALIGN, bytes ? bytes : MATMUL_ALIGN);
+    if (m->data == NULL)
+        return -1;
+    memset(m->data, 0, bytes);
+    return 0;
+}
+
+static inline void matrix_free(matrix_t *m){
+    free(m->data);
+    m->data = NULL;
+}
+
+static inline void matmul_default_config(matmul_config_t *cfg){
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    cfg->threads = cpus > 0 ? (int)cpus : 1;
+    cfg->schedule = MATMUL_STATIC;
+    cfg->tile_i = MATMUL_TILE_I;
+    cfg->tile_j = MATMUL_TILE_J;
+    cfg->tile_k = MATMUL_TILE_K;
+    cfg->block = matmul_block;
+    cfg->thread_done = NULL;
+    cfg->arg = NULL;
+}
+
+/*
+    z[i0:i1, j0:j1] += x[i0:i1, k0:k1] * y[k0:k1, j0:j1], single threaded.
+    Also the building block for callers that split k themselves.
+*/
+static inline void matmul_block(const matrix_t *x, const matrix_t *y, matrix_t *z,
+                                int i0, int i1, int j0, int j1, int k0, int k1, int tile_k){
+    for (int kk = k0; kk < k1; kk += tile_k) {
+        int kend = kk + tile_k < k1 ? kk + tile_k : k1;
+        for (int i = i0; i < i1; i++) {
+            int *restrict zr = &MAT(z, i, 0);
+            const int *xr = &MAT(x, i, 0);
+            for (int k = kk; k < kend; k++) {
+                const int xik = xr[k];
+                const int *restrict yr = &MAT(y, k, 0);
+                for (int j = j0; j < j1; j++)
+                    zr[j] += xik * yr[j];
+            }
+        }
+    }
+}
+
+typedef struct {
+    const matrix_t *x, *y;
+    matrix_t *z;
+    const matmul_config_t *cfg;
+    int worker;
+    int tiles_i, tiles_j;
+    atomic_int *next;       // dynamic schedule: next tile to hand out
+} matmul_task_t;
+
+static inline void matmul_tile(const matmul_task_t *task, int tile){
+    const matmul_config_t *cfg = task->cfg;
+    int ti = tile / task->tiles_j, tj = tile % task->tiles_j;
+    int i0 = ti * cfg->tile_i, j0 = tj * cfg->tile_j;
+    int i1 = i0 + cfg->tile_i < task->z->rows ? i0 + cfg->tile_i : task->z->rows;
+    int j1 = j0 + cfg->tile_j < task->z->cols ? j0 + cfg->tile_j : task->z->cols;
+
+    cfg->block(task->x, task->y, task->z, i0, i1, j0, j1, 0, task->x->cols, cfg->tile_k);
+}
+
+static inline void *matmul_worker(void *arg){
+    matmul_task_t *task = arg;
+    const matmul_config_t *cfg = task->cfg;
+    int tiles = task->tiles_i * task->tiles_j;
+
+    if (cfg->schedule == MATMUL_DYNAMIC) {
+        int tile;
+        while ((tile = atomic_fetch_add_explicit(task->next, 1, memory_order_relaxed)) < tiles)
+            matmul_tile(task, tile);
+    } else {
+        // Contiguous share: neighbouring tiles reuse the same rows of x
+        long first = (long)tiles * task->worker / cfg->threads;
+        long last = (long)tiles * (task->worker + 1) / cfg->threads;
+        for (long tile = first; tile < last; tile++)
+            matmul_tile(task, tile);
+    }
+
+    if (cfg->thread_done)
+        cfg->thread_done(task->worker, cfg->arg);
+    return NULL;
+}
+
+/*
+    z += x * y with cfg->threads worker threads, the caller only waits.
+    Returns 0, or -1 if the shapes do not match.
+*/
+static inline int matmul(const matrix_t *x, const matrix_t *y, matrix_t *z, const matmul_config_t *cfg){
+    if (x->cols != y->rows || z->rows != x->rows || z->cols != y->cols) {
+        fprintf(stderr, "matmul: shape mismatch %dx%d * %dx%d -> %dx%d\n",
+                x->rows, x->cols, y->rows, y->cols, z->rows, z->cols);
+        return -1;
+    }
+
+    int threads = cfg->threads > 0 ? cfg->threads : 1;
+    matmul_config_t run = *cfg;
+    run.threads = threads;
+
+    atomic_int next = 0;
+    matmul_task_t tasks[threads];
+    pthread_t tids[threads];
+    for (int w = 0; w < threads; w++) {
+        tasks[w] = (matmul_task_t){
+            .x = x, .y = y, .z = z, .cfg = &run, .worker = w,
+            .tiles_i = (z->rows + run.tile_i - 1) / run.tile_i,
+            .tiles_j = (z->cols + run.tile_j - 1) / run.tile_j,
+            .next = &next,
+        };
+    }
+
+    for (int w = 0; w < threads; w++)
+        pthread_create(&tids[w], NULL, matmul_worker, &tasks[w]);
+    for (int w = 0; w < threads; w++)
+        pthread_join(tids[w], NULL);
+    return 0;
+}
+
+#endif
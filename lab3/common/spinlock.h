@@ -0,0 +1,186 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+/*
+    Busy-waiting locks for lab3, all behind spinlock_acquire/release:
+
+    SPIN_TAS     exchange until it returns "free", the lab's xchg loop;
+                 every waiter writes the line all the time
+    SPIN_TTAS    test-and-test-and-set: wait with plain loads (the line
+                 stays shared in every waiter's cache) and only exchange
+                 when it looks free, backing off exponentially on failure
+    SPIN_TICKET  take a ticket, wait until it is served: FIFO, so no
+                 thread starves, but all waiters still poll one line
+    SPIN_MCS     queue lock: every waiter spins on its own node and the
+                 holder hands over directly to the next one, FIFO and one
+                 cache-line transfer per hand-over however many wait
+
+    A zeroed spinlock_t is an unlocked lock, SPINLOCK_INIT(kind) sets the
+    kind statically. MCS nodes come from a small per-thread pool, so one
+    thread can hold up to SPIN_MCS_NODES MCS locks at a time, released in
+    any order.
+*/
+
+#define SPIN_TAS 0
+#define SPIN_TTAS 1
+#define SPIN_TICKET 2
+#define SPIN_MCS 3
+
+#define SPIN_BACKOFF_MIN 4
+#define SPIN_BACKOFF_MAX 1024
+#define SPIN_MCS_NODES 8
+#define SPIN_CACHE_LINE 64
+
+typedef struct spin_node {
+    _Atomic(struct spin_node *) next;
+    atomic_int waiting;
+    int busy;                   // taken from the owner's pool
+} __attribute__((aligned(SPIN_CACHE_LINE))) spin_node_t;
+
+typedef struct {
+    int kind;
+    atomic_int held;                    // TAS, TTAS
+    atomic_uint next_ticket;            // TICKET
+    atomic_uint now_serving;
+    _Atomic(spin_node_t *) tail;        // MCS
+    spin_node_t *owner;                 // MCS node of the holder
+} __attribute__((aligned(SPIN_CACHE_LINE))) spinlock_t;
+
+#define SPINLOCK_INIT(k) { .kind = (k) }
+
+static _Thread_local spin_node_t spin_nodes[SPIN_MCS_NODES];
+
+static inline void cpu_relax(void){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+static inline const char *spin_kind_name(int kind){
+    static const char *names[] = { "tas", "ttas", "ticket", "mcs" };
+    return kind >= SPIN_TAS && kind <= SPIN_MCS ? names[kind] : "?";
+}
+
+static inline void spinlock_init(spinlock_t *l, int kind){
+    *l = (spinlock_t)SPINLOCK_INIT(kind);
+}
+
+static inline void tas_lock(spinlock_t *l){
+    while (atomic_exchange_explicit(&l->held, 1, memory_order_acquire))
+        ;
+}
+
+static inline void ttas_lock(spinlock_t *l){
+    unsigned int backoff = SPIN_BACKOFF_MIN;
+
+    while (1) {
+        while (atomic_load_explicit(&l->held, memory_order_relaxed))
+            cpu_relax();
+        if (!atomic_exchange_explicit(&l->held, 1, memory_order_acquire))
+            return;
+        // Lost the race: let the winner run before trying again
+        for (unsigned int i = 0; i < backoff; i++)
+            cpu_relax();
+        if (backoff < SPIN_BACKOFF_MAX)
+            backoff *= 2;
+    }
+}
+
+static inline void ticket_lock(spinlock_t *l){
+    unsigned int ticket = atomic_fetch_add_explicit(&l->next_ticket, 1, memory_order_relaxed);
+
+    while (atomic_load_explicit(&l->now_serving, memory_order_acquire) != ticket)
+        cpu_relax();
+}
+
+static inline void ticket_unlock(spinlock_t *l){
+    // Only the holder writes now_serving
+    unsigned int served = atomic_load_explicit(&l->now_serving, memory_order_relaxed);
+    atomic_store_explicit(&l->now_serving, served + 1, memory_order_release);
+}
+
+static inline void mcs_lock(spinlock_t *l){
+    spin_node_t *node = NULL;
+
+    for (int i = 0; i < SPIN_MCS_NODES; i++) {
+        if (!spin_nodes[i].busy) {
+            node = &spin_nodes[i];
+            break;
+        }
+    }
+    if (node == NULL) {
+        fprintf(stderr, "spinlock: more than %d MCS locks held by one thread\n", SPIN_MCS_NODES);
+        abort();
+    }
+    node->busy = 1;
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->waiting, 1, memory_order_relaxed);
+
+    spin_node_t *prev = atomic_exchange_explicit(&l->tail, node, memory_order_acq_rel);
+    if (prev) {
+        atomic_store_explicit(&prev->next, node, memory_order_release);
+        while (atomic_load_explicit(&node->waiting, memory_order_acquire))
+            cpu_relax();
+    }
+    l->owner = node;
+}
+
+static inline void mcs_unlock(spinlock_t *l){
+    spin_node_t *node = l->owner;
+    spin_node_t *next = atomic_load_explicit(&node->next, memory_order_acquire);
+
+    if (next == NULL) {
+        spin_node_t *expected = node;
+        if (atomic_compare_exchange_strong_explicit(&l->tail, &expected, NULL,
+                                                    memory_order_release, memory_order_relaxed)) {
+            node->busy = 0;
+            return;
+        }
+        // A waiter swapped itself in but has not linked to us yet
+        while ((next = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL)
+            cpu_relax();
+    }
+    atomic_store_explicit(&next->waiting, 0, memory_order_release);
+    node->busy = 0;
+}
+
+static inline void spinlock_acquire(spinlock_t *l){
+    switch (l->kind) {
+    case SPIN_TTAS:
+        ttas_lock(l);
+        break;
+    case SPIN_TICKET:
+        ticket_lock(l);
+        break;
+    case SPIN_MCS:
+        mcs_lock(l);
+        break;
+    default:
+        tas_lock(l);
+        break;
+    }
+}
+
+static inline void spinlock_release(spinlock_t *l){
+    switch (l->kind) {
+    case SPIN_TICKET:
+        ticket_unlock(l);
+        break;
+    case SPIN_MCS:
+        mcs_unlock(l);
+        break;
+    default:
+        atomic_store_explicit(&l->held, 0, memory_order_release);
+        break;
+    }
+}
+
+#endif
@@ -1,7 +1,177 @@
 #include <linux/fs.h>
 #include <linux/string.h>
 #include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/stringhash.h>
 #include "osfs.h"
+#include "osfs_trace.h"
+
+/*
+ * 目錄索引: 每個 superblock 一張雜湊表，以 (目錄 Inode, 檔名雜湊) 為鍵，
+ * 記錄每個目錄項目所在的實體區塊與位移。每次建立檔案都會加入，從備份裝置掛載時
+ * 由 osfs_dir_index_load 重建，所以它永遠是完整的：
+ * 查不到就代表檔案不存在，lookup 與 create 都不必掃描目錄。
+ * 每個 bucket 用 hlist_bl 的 bit spinlock 保護。
+ */
+struct osfs_dir_hash_entry {
+    struct hlist_bl_node node;
+    uint32_t dir_ino;
+    uint32_t hash;          // full_name_hash() of the name
+    uint32_t phys_block;    // Directory block that holds the record
+    uint32_t offset;        // Byte offset of the record in that block
+};
+
+#define OSFS_DIR_HASH_MIN_BITS 6
+#define OSFS_DIR_HASH_MAX_BITS 20
+
+static struct hlist_bl_head *osfs_dir_bucket(struct osfs_sb_info *sb_info, uint32_t dir_ino, uint32_t hash)
+{
+    return &sb_info->dir_hash[hash_32(hash ^ (dir_ino * GOLDEN_RATIO_32), sb_info->dir_hash_bits)];
+}
+
+// 把一筆目錄項目加入索引 (h 由呼叫者配置)
+static void osfs_dir_index_insert(struct osfs_sb_info *sb_info, struct osfs_dir_hash_entry *h,
+                                  uint32_t dir_ino, uint32_t hash, uint32_t phys_block, uint32_t offset)
+{
+    struct hlist_bl_head *head = osfs_dir_bucket(sb_info, dir_ino, hash);
+
+    h->dir_ino = dir_ino;
+    h->hash = hash;
+    h->phys_block = phys_block;
+    h->offset = offset;
+    hlist_bl_lock(head);
+    hlist_bl_add_head(&h->node, head);
+    hlist_bl_unlock(head);
+}
+
+/**
+ * 函式: osfs_dir_index_init
+ * 描述: 建立目錄索引，bucket 數量跟著 Inode 數量 (每個 Inode 最多被一個目錄項目指到)。
+ */
+int osfs_dir_index_init(struct osfs_sb_info *sb_info)
+{
+    sb_info->dir_hash_bits = clamp_t(uint32_t, order_base_2(sb_info->inode_count),
+                                     OSFS_DIR_HASH_MIN_BITS, OSFS_DIR_HASH_MAX_BITS);
+    sb_info->dir_hash = kvcalloc(1U << sb_info->dir_hash_bits, sizeof(struct hlist_bl_head), GFP_KERNEL_ACCOUNT);
+    return sb_info->dir_hash ? 0 : -ENOMEM;
+}
+
+/**
+ * 函式: osfs_dir_index_destroy
+ * 描述: 卸載時釋放整個目錄索引。
+ */
+void osfs_dir_index_destroy(struct osfs_sb_info *sb_info)
+{
+    struct osfs_dir_hash_entry *h;
+    struct hlist_bl_node *pos, *tmp;
+    uint32_t i;
+
+    if (!sb_info->dir_hash)
+        return;
+    for (i = 0; i < (1U << sb_info->dir_hash_bits); i++)
+        hlist_bl_for_each_entry_safe(h, pos, tmp, &sb_info->dir_hash[i], node)
+            kfree(h);
+    kvfree(sb_info->dir_hash);
+    sb_info->dir_hash = NULL;
+}
+
+// 把一個目錄既有的所有紀錄加入索引
+static int osfs_dir_index_scan(struct inode *dir)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = dir->i_private;
+    sector_t block, nblocks = osfs_inode->i_size >> sb_info->block_size_bits;
+    struct osfs_dir_hash_entry *h;
+    struct osfs_dir_entry *de;
+    uint32_t phys_block, offset;
+    void *base;
+
+    for (block = 0; block < nblocks; block++) {
+        if (osfs_get_block(dir, block, &phys_block, 0) || phys_block == 0)
+            continue;
+        base = osfs_block_addr(sb_info, phys_block);
+
+        for (offset = 0; offset < sb_info->block_size; offset += de->rec_len) {
+            de = base + offset;
+            // 從備份裝置讀回來的紀錄不能超出區塊，名字也要放得進紀錄裡
+            if (sb_info->block_size - offset < OSFS_DIR_REC_LEN(0) ||
+                de->rec_len < OSFS_DIR_REC_LEN(0) || de->rec_len & 3 ||
+                de->rec_len > sb_info->block_size - offset ||
+                (de->inode_no && (de->rec_len < OSFS_DIR_REC_LEN(de->name_len) ||
+                                  de->inode_no >= sb_info->inode_count))) {
+                pr_err("osfs_dir_index_scan: Corrupted directory block %llu of inode %lu\n",
+                       (unsigned long long)block, dir->i_ino);
+                return -EIO;
+            }
+            if (!de->inode_no)
+                continue;
+            h = kmalloc(sizeof(*h), GFP_KERNEL_ACCOUNT);
+            if (!h)
+                return -ENOMEM;
+            osfs_dir_index_insert(sb_info, h, dir->i_ino, full_name_hash(NULL, de->name, de->name_len),
+                                  phys_block, offset);
+        }
+    }
+    return 0;
+}
+
+/**
+ * 函式: osfs_dir_index_load
+ * 描述: 從備份裝置載入的 volume 沒有目錄索引，掛載時走過每個目錄重建。
+ */
+int osfs_dir_index_load(struct super_block *sb)
+{
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
+    struct osfs_inode *osfs_inode;
+    struct inode *dir;
+    uint32_t ino;
+    int ret;
+
+    for (ino = ROOT_INODE; ino < sb_info->inode_count; ino++) {
+        osfs_inode = osfs_get_osfs_inode(sb, ino);
+        if (!osfs_inode || !S_ISDIR(osfs_inode->i_mode) || !osfs_inode->i_links_count)
+            continue;
+        dir = osfs_iget(sb, ino);
+        if (IS_ERR(dir))
+            return PTR_ERR(dir);
+        ret = osfs_dir_index_scan(dir);
+        iput(dir);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+/**
+ * 函式: osfs_find_entry
+ * 描述: 透過目錄索引找出 dir 裡名為 name 的目錄項目，O(1)。
+ * 回傳: 目錄項目的指標，不存在時回傳 NULL。
+ */
+static struct osfs_dir_entry *osfs_find_entry(struct inode *dir, const char *name, size_t name_len,
+                                              uint32_t hash)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct hlist_bl_head *head = osfs_dir_bucket(sb_info, dir->i_ino, hash);
+    struct osfs_dir_entry *found = NULL;
+    struct osfs_dir_hash_entry *h;
+    struct hlist_bl_node *pos;
+
+    hlist_bl_lock(head);
+    hlist_bl_for_each_entry(h, pos, head, node) {
+        struct osfs_dir_entry *de;
+
+        if (h->dir_ino != dir->i_ino || h->hash != hash)
+            continue;
+        // 雜湊相同還要比對檔名
+        de = osfs_block_addr(sb_info, h->phys_block) + h->offset;
+        if (de->name_len == name_len && memcmp(de->name, name, name_len) == 0) {
+            found = de;
+            break;
+        }
+    }
+    hlist_bl_unlock(head);
+    return found;
+}
 
 /**
  * 函式: osfs_lookup
@@ -17,80 +187,82 @@
 static struct dentry *osfs_lookup(struct inode *dir, struct dentry *dentry, unsigned int flags)
 {
     struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
-    struct osfs_inode *parent_inode = dir->i_private;
-    void *dir_data_block;
-    struct osfs_dir_entry *dir_entries;
-    int dir_entry_count;
-    int i;
+    const struct qstr *qname = &dentry->d_name;
+    struct osfs_dir_entry *de;
     struct inode *inode = NULL;
 
-    pr_info("osfs_lookup: Looking up '%.*s' in inode %lu\n",
-            (int)dentry->d_name.len, dentry->d_name.name, dir->i_ino);
-
-    // 讀取父目錄的資料區塊
-    // 【Bonus 差異點】因為 i_block 變成了陣列 (支援多層索引)，
-    // 目錄通常只用第一個直接區塊，所以這裡用 parent_inode->i_block[0]
-    dir_data_block = sb_info->data_blocks + parent_inode->i_block[0] * BLOCK_SIZE;
-
-    // 計算目錄項目數量
-    dir_entry_count = parent_inode->i_size / sizeof(struct osfs_dir_entry);
-    dir_entries = (struct osfs_dir_entry *)dir_data_block;
-
-    // 遍歷目錄項目尋找檔名
-    for (i = 0; i < dir_entry_count; i++) {
-        if (strlen(dir_entries[i].filename) == dentry->d_name.len &&
-            strncmp(dir_entries[i].filename, dentry->d_name.name, dentry->d_name.len) == 0) {
-            // 找到了，取得 Inode
-            inode = osfs_iget(dir->i_sb, dir_entries[i].inode_no);
-            if (IS_ERR(inode)) {
-                pr_err("osfs_lookup: Error getting inode %u\n", dir_entries[i].inode_no);
-                return ERR_CAST(inode);
-            }
-            return d_splice_alias(inode, dentry);
+    // 每次 lookup 都會經過，用 dynamic debug 或 tracepoint (osfs_lookup) 觀察
+    pr_debug("osfs_lookup: Looking up '%.*s' in inode %lu\n",
+             (int)qname->len, qname->name, dir->i_ino);
+
+    if (qname->len > MAX_FILENAME_LEN)
+        return ERR_PTR(-ENAMETOOLONG);
+
+    // 透過目錄索引直接找到目錄項目，不必逐一比對
+    de = osfs_find_entry(dir, qname->name, qname->len, full_name_hash(NULL, qname->name, qname->len));
+    osfs_stat_add(sb_info, OSFS_STAT_LOOKUPS, 1);
+    trace_osfs_lookup(dir, qname->name, qname->len, de ? de->inode_no : 0);
+    if (de) {
+        osfs_stat_add(sb_info, OSFS_STAT_LOOKUP_HITS, 1);
+        // 找到了，取得 Inode
+        inode = osfs_iget(dir->i_sb, de->inode_no);
+        if (IS_ERR(inode)) {
+            pr_err("osfs_lookup: Error getting inode %u\n", de->inode_no);
+            return ERR_CAST(inode);
         }
     }
 
-    return NULL;
+    // 沒找到時 inode 為 NULL，建立 negative dentry
+    return d_splice_alias(inode, dentry);
 }
 
 /**
  * 函式: osfs_iterate
  * 描述: 遍歷目錄項目 (供 ls 使用)。
+ * ctx->pos 的 0 與 1 是 . 和 ..，之後為 2 + 目錄內的位元組位置。
  */
 static int osfs_iterate(struct file *filp, struct dir_context *ctx)
 {
     struct inode *inode = file_inode(filp);
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
     struct osfs_inode *osfs_inode = inode->i_private;
-    void *dir_data_block;
-    struct osfs_dir_entry *dir_entries;
-    int dir_entry_count;
-    int i;
+    struct osfs_dir_entry *de;
+    uint32_t phys_block, offset;
+    loff_t pos;
+    void *base;
 
     // 處理 . 和 ..
-    if (ctx->pos == 0) {
-        if (!dir_emit_dots(filp, ctx))
-            return 0;
-    }
-
-    // 【Bonus 差異點】使用 i_block[0] 存取目錄的第一個data block
-    dir_data_block = sb_info->data_blocks + osfs_inode->i_block[0] * BLOCK_SIZE;
-    dir_entry_count = osfs_inode->i_size / sizeof(struct osfs_dir_entry);
-    dir_entries = (struct osfs_dir_entry *)dir_data_block;
+    if (!dir_emit_dots(filp, ctx))
+        return 0;
 
-    /* 調整索引 (跳過 . 和 ..) */
-    i = ctx->pos - 2;
+    while ((pos = ctx->pos - 2) < osfs_inode->i_size) {
+        sector_t block = pos >> sb_info->block_size_bits;
 
-    for (; i < dir_entry_count; i++) {
-        struct osfs_dir_entry *entry = &dir_entries[i];
-        unsigned int type = DT_UNKNOWN;
-
-        if (!dir_emit(ctx, entry->filename, strlen(entry->filename), entry->inode_no, type)) {
-            pr_err("osfs_iterate: dir_emit failed for entry '%s'\n", entry->filename);
-            return -EINVAL;
+        offset = pos & (sb_info->block_size - 1);
+        if (osfs_get_block(inode, block, &phys_block, 0) || phys_block == 0) {
+            ctx->pos = 2 + ((loff_t)(block + 1) << sb_info->block_size_bits);
+            continue;
+        }
+        base = osfs_block_addr(sb_info, phys_block);
+
+        // 沿著 rec_len 走過這個 Block 的所有紀錄
+        while (offset < sb_info->block_size) {
+            de = base + offset;
+            // 從備份裝置讀回來的紀錄不能超出區塊，名字也要放得進紀錄裡
+            if (sb_info->block_size - offset < OSFS_DIR_REC_LEN(0) ||
+                de->rec_len < OSFS_DIR_REC_LEN(0) || de->rec_len & 3 ||
+                de->rec_len > sb_info->block_size - offset ||
+                (de->inode_no && (de->rec_len < OSFS_DIR_REC_LEN(de->name_len) ||
+                                  de->inode_no >= sb_info->inode_count))) {
+                pr_err("osfs_iterate: Corrupted directory block %llu of inode %lu\n",
+                       (unsigned long long)block, inode->i_ino);
+                return -EIO;
+            }
+            if (de->inode_no && !dir_emit(ctx, de->name, de->name_len, de->inode_no, de->file_type))
+                return 0;
+            offset += de->rec_len;
+            ctx->pos += de->rec_len;
         }
-
-        ctx->pos++;
     }
 
     return 0;
@@ -115,7 +287,7 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     }
 
     /* 檢查是否有空閒 Inode */
-    if (sb_info->nr_free_inodes == 0)
+    if (atomic_read(&sb_info->nr_free_inodes) == 0)
         return ERR_PTR(-ENOSPC);
 
     /* 分配 Inode 編號 */
@@ -144,6 +316,7 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     } else if (S_ISREG(mode)) {
         inode->i_op = &osfs_file_inode_operations;
         inode->i_fop = &osfs_file_operations;
+        inode->i_mapping->a_ops = &osfs_aops;
         set_nlink(inode, 1);
         inode->i_size = 0;
     } else if (S_ISLNK(mode)) {
@@ -167,17 +340,22 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     osfs_inode->i_uid = i_uid_read(inode);
     osfs_inode->i_gid = i_gid_read(inode);
     osfs_inode->i_size = inode->i_size;
+    osfs_inode->i_links_count = inode->i_nlink;
     osfs_inode->i_blocks = 0;
     osfs_inode->__i_atime = osfs_inode->__i_mtime = osfs_inode->__i_ctime = current_time(inode);
     
     // 【Bonus 差異點】清空整個 Block 索引陣列
     // 因為 Bonus 版支援多層索引，i_block 是陣列，必須全部清零
     memset(osfs_inode->i_block, 0, sizeof(osfs_inode->i_block));
+
+    // 一般檔案改用 Extent 映射 (目錄仍只用 i_block[0])
+    if (OSFS_DEFAULT_EXTENTS && S_ISREG(mode))
+        osfs_ext_init(osfs_inode);
     
     inode->i_private = osfs_inode;
 
-    /* 更新 Superblock 資訊 */
-    sb_info->nr_free_inodes--;
+    /* 加入 Inode 快取，之後 osfs_iget 會找到同一個 VFS Inode */
+    insert_inode_hash(inode);
 
     /* 標記 Inode 為 Dirty */
     mark_inode_dirty(inode);
@@ -185,59 +363,94 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     return inode;
 }
 
-static int osfs_add_dir_entry(struct inode *dir, uint32_t inode_no, const char *name, size_t name_len)
+// 在一個目錄 Block 裡找一筆後面還有 need 位元組空間的紀錄
+static struct osfs_dir_entry *osfs_dir_find_space(void *base, uint32_t block_size, uint32_t need)
+{
+    uint32_t offset = 0;
+
+    while (offset < block_size) {
+        struct osfs_dir_entry *de = base + offset;
+        uint32_t used = de->inode_no ? OSFS_DIR_REC_LEN(de->name_len) : 0;
+
+        if (de->rec_len < OSFS_DIR_REC_LEN(0))
+            return NULL;
+        if (de->rec_len - used >= need)
+            return de;
+        offset += de->rec_len;
+    }
+    return NULL;
+}
+
+/**
+ * 函式: osfs_add_dir_entry
+ * 描述: 在目錄中新增一筆目錄項目。
+ * 新項目只會放進最後一個 Block (切下某筆紀錄後面的空間)，最後一個 Block 滿了
+ * 就透過 osfs_get_block 接一個新的 Block，所以新增的成本與目錄大小無關。
+ */
+static int osfs_add_dir_entry(struct inode *dir, uint32_t inode_no, const char *name, size_t name_len,
+                              umode_t mode)
 {
     struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
     struct osfs_inode *parent_inode = dir->i_private;
-    void *dir_data_block;
-    struct osfs_dir_entry *dir_entries;
-    int dir_entry_count;
-    int i;
+    uint32_t need = OSFS_DIR_REC_LEN(name_len);
+    uint32_t hash = full_name_hash(NULL, name, name_len);
+    sector_t nblocks = parent_inode->i_size >> sb_info->block_size_bits;
+    struct osfs_dir_entry *de = NULL;
+    struct osfs_dir_hash_entry *h;
+    uint32_t phys_block;
+    void *base = NULL;
     int ret;
 
-    // 如果父目錄還沒有分配資料區塊，先分配一個 (針對剛建立的目錄)
-    // 【Bonus 差異點】使用 i_block[0]
-    if (parent_inode->i_blocks == 0) {
-        ret = osfs_alloc_data_block(sb_info, &parent_inode->i_block[0]);
+    // 檢查是否有重複檔名
+    if (osfs_find_entry(dir, name, name_len, hash)) {
+        pr_debug("osfs_add_dir_entry: File '%.*s' already exists\n", (int)name_len, name);
+        return -EEXIST;
+    }
+
+    // 先配置索引項目，後面就不會在改了目錄之後才失敗
+    h = kmalloc(sizeof(*h), GFP_KERNEL_ACCOUNT);
+    if (!h)
+        return -ENOMEM;
+
+    // 最後一個 Block 還有空間就放進去
+    if (nblocks > 0 && osfs_get_block(dir, nblocks - 1, &phys_block, 0) == 0 && phys_block != 0) {
+        base = osfs_block_addr(sb_info, phys_block);
+        de = osfs_dir_find_space(base, sb_info->block_size, need);
+    }
+
+    // 否則替目錄接一個新的 Block，整塊先是一筆空紀錄
+    if (!de) {
+        ret = osfs_get_block(dir, nblocks, &phys_block, 1);
         if (ret) {
             pr_err("osfs_add_dir_entry: Failed to allocate data block for directory\n");
+            kfree(h);
             return ret;
         }
-        parent_inode->i_blocks = 1;
-        // 清空新分配的區塊
-        dir_data_block = sb_info->data_blocks + parent_inode->i_block[0] * BLOCK_SIZE;
-        memset(dir_data_block, 0, BLOCK_SIZE);
+        base = osfs_block_addr(sb_info, phys_block);
+        de = base;
+        de->inode_no = 0;
+        de->rec_len = sb_info->block_size;
+        parent_inode->i_size += sb_info->block_size;
     }
 
-    // 讀取父目錄的資料區塊
-    // 【Bonus 差異點】使用 i_block[0]
-    dir_data_block = sb_info->data_blocks + parent_inode->i_block[0] * BLOCK_SIZE;
+    // 從使用中的紀錄後面切出新紀錄
+    if (de->inode_no) {
+        struct osfs_dir_entry *next = (void *)de + OSFS_DIR_REC_LEN(de->name_len);
 
-    // 計算目錄項目數量
-    dir_entry_count = parent_inode->i_size / sizeof(struct osfs_dir_entry);
-    if (dir_entry_count >= MAX_DIR_ENTRIES) {
-        pr_err("osfs_add_dir_entry: Parent directory is full\n");
-        return -ENOSPC;
-    }
-
-    dir_entries = (struct osfs_dir_entry *)dir_data_block;
-
-    // 檢查是否有重複檔名
-    for (i = 0; i < dir_entry_count; i++) {
-        if (strlen(dir_entries[i].filename) == name_len &&
-            strncmp(dir_entries[i].filename, name, name_len) == 0) {
-            pr_warn("osfs_add_dir_entry: File '%.*s' already exists\n", (int)name_len, name);
-            return -EEXIST;
-        }
+        next->rec_len = de->rec_len - OSFS_DIR_REC_LEN(de->name_len);
+        de->rec_len = OSFS_DIR_REC_LEN(de->name_len);
+        de = next;
     }
 
     // 新增目錄項目
-    strncpy(dir_entries[dir_entry_count].filename, name, name_len);
-    dir_entries[dir_entry_count].filename[name_len] = '\0';
-    dir_entries[dir_entry_count].inode_no = inode_no;
+    de->inode_no = inode_no;
+    de->name_len = name_len;
+    de->file_type = fs_umode_to_dtype(mode);
+    memcpy(de->name, name, name_len);
+    osfs_dirty_block(sb_info, phys_block, 1, true);
 
-    // 更新父目錄大小
-    parent_inode->i_size += sizeof(struct osfs_dir_entry);
+    // 加入目錄索引
+    osfs_dir_index_insert(sb_info, h, dir->i_ino, hash, phys_block, (void *)de - base);
 
     return 0;
 }
@@ -250,6 +463,7 @@ static int osfs_add_dir_entry(struct inode *dir, uint32_t inode_no, const char *
 static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry *dentry, umode_t mode, bool excl)
 {   
     // Step 1: 取得父目錄 Inode
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
     struct osfs_inode *parent_inode = dir->i_private;
     struct osfs_inode *osfs_inode;
     struct inode *inode;
@@ -261,23 +475,27 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
         return -ENAMETOOLONG;
     }
 
-    // Step 3: 建立新 Inode
+    // Step 3: 建立新 Inode (Inode、目錄與 Bitmap 在同一個 commit 裡一起寫回)
+    osfs_meta_begin(sb_info);
     inode = osfs_new_inode(dir, mode);
     if (IS_ERR(inode)) {
+        osfs_meta_end(sb_info);
         pr_err("osfs_create: Failed to create new inode\n");
         return PTR_ERR(inode);
     }
 
     osfs_inode = inode->i_private;
     if (!osfs_inode) {
+        osfs_meta_end(sb_info);
         pr_err("osfs_create: Failed to get osfs_inode for inode %lu\n", inode->i_ino);
         iput(inode);
         return -EIO;
     }
 
     // Step 4: 將新檔案加入父目錄
-    ret = osfs_add_dir_entry(dir, inode->i_ino, dentry->d_name.name, dentry->d_name.len);
+    ret = osfs_add_dir_entry(dir, inode->i_ino, dentry->d_name.name, dentry->d_name.len, mode);
     if (ret) {
+        osfs_meta_end(sb_info);
         pr_err("osfs_create: Failed to add directory entry\n");
         iput(inode);
         return ret;
@@ -288,12 +506,14 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
     inode_set_mtime_to_ts(dir, current_time(dir));
     inode_set_ctime_to_ts(dir, current_time(dir));
     mark_inode_dirty(dir);
+    osfs_meta_end(sb_info);
     
     // Step 6: 綁定 Dentry 與 Inode
     d_instantiate(dentry, inode);
 
-    pr_info("osfs_create: File '%.*s' created with inode %lu\n",
-            (int)dentry->d_name.len, dentry->d_name.name, inode->i_ino);
+    trace_osfs_create(dir, dentry->d_name.name, dentry->d_name.len, inode->i_ino);
+    pr_debug("osfs_create: File '%.*s' created with inode %lu\n",
+             (int)dentry->d_name.len, dentry->d_name.name, inode->i_ino);
 
     return 0;
 }
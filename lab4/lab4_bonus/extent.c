@@ -0,0 +1,437 @@
+#include <linux/fs.h>
+#include <linux/string.h>
+#include "osfs.h"
+
+/*
+ * Extent mapping for regular files.
+ *
+ * The root lives in the inode in place of i_block[]: a header and
+ * OSFS_INLINE_EXTENTS records sorted by ee_block. When they are used up
+ * the records move to a block and the root turns into an index one level
+ * up. Every node is a header and records; leaves (depth 0) hold extents,
+ * index nodes hold one record per child, keyed by the lowest logical
+ * block below it. A full node is split in half into its parent, a full
+ * root grows the tree by one level, up to OSFS_EXT_MAX_DEPTH. A file
+ * written sequentially on a free device needs one record, and one lookup
+ * per contiguous run instead of one table walk per block.
+ *
+ * Physical block 0 means "hole" to the callers, as with i_block[]: it is
+ * reserved at mount and never allocated.
+ */
+
+// Nodes from the root down to the leaf covering one logical block
+struct ext_path {
+    int depth;
+    struct osfs_extent_header *node[OSFS_EXT_MAX_DEPTH + 1];   // node[0] is the root
+    uint32_t block_no[OSFS_EXT_MAX_DEPTH + 1];                  // 0 for the root
+    int pos[OSFS_EXT_MAX_DEPTH + 1];                            // Record followed; -1 in a leaf: none
+};
+
+static struct osfs_extent *ext_records(struct osfs_extent_header *eh)
+{
+    return (struct osfs_extent *)(eh + 1);
+}
+
+/**
+ * Function: osfs_ext_init
+ * Description: Sets up an empty inline extent root.
+ */
+void osfs_ext_init(struct osfs_inode *osfs_inode)
+{
+    memset(osfs_inode->i_block, 0, sizeof(osfs_inode->i_block));
+    osfs_inode->i_eh.eh_magic = OSFS_EXT_MAGIC;
+    osfs_inode->i_eh.eh_max = OSFS_INLINE_EXTENTS;
+    osfs_inode->i_eh.eh_depth = 0;
+    osfs_inode->i_flags |= OSFS_EXTENTS_FL;
+}
+
+// Last record with ee_block <= block, -1 if there is none
+static int ext_search(struct osfs_extent_header *eh, sector_t block)
+{
+    struct osfs_extent *rec = ext_records(eh);
+    int lo = 0, hi = eh->eh_entries - 1, found = -1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (rec[mid].ee_block <= block) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+// Walk down to the leaf that covers block; left of every key means the first child
+static void ext_find_path(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode,
+                          sector_t block, struct ext_path *path)
+{
+    int l, i;
+
+    path->depth = osfs_inode->i_eh.eh_depth;
+    path->node[0] = &osfs_inode->i_eh;
+    path->block_no[0] = 0;
+    for (l = 0; l < path->depth; l++) {
+        i = ext_search(path->node[l], block);
+        if (i < 0)
+            i = 0;
+        path->pos[l] = i;
+        path->block_no[l + 1] = ext_records(path->node[l])[i].ee_start;
+        path->node[l + 1] = osfs_block_addr(sb_info, path->block_no[l + 1]);
+    }
+    path->pos[l] = ext_search(path->node[l], block);
+}
+
+// First logical block right of the leaf record the path ends at, (sector_t)-1 if none
+static sector_t ext_next_key(const struct ext_path *path)
+{
+    for (int l = path->depth; l >= 0; l--)
+        if (path->pos[l] + 1 < path->node[l]->eh_entries)
+            return ext_records(path->node[l])[path->pos[l] + 1].ee_block;
+    return (sector_t)-1;
+}
+
+// The index keys on the path are lower bounds of their subtrees
+static void ext_lower_keys(struct ext_path *path, uint32_t block)
+{
+    for (int l = 0; l < path->depth; l++) {
+        struct osfs_extent *key = &ext_records(path->node[l])[path->pos[l]];
+
+        if (block < key->ee_block)
+            key->ee_block = block;
+    }
+}
+
+// Tree blocks are journaled metadata; the root is part of the inode
+static void ext_dirty_path(struct osfs_sb_info *sb_info, const struct ext_path *path)
+{
+    for (int l = 1; l <= path->depth; l++)
+        osfs_dirty_block(sb_info, path->block_no[l], 1, true);
+}
+
+static void ext_insert_at(struct osfs_extent_header *eh, int pos, const struct osfs_extent *ext)
+{
+    struct osfs_extent *rec = ext_records(eh);
+
+    memmove(&rec[pos + 1], &rec[pos], (eh->eh_entries - pos) * sizeof(*rec));
+    rec[pos] = *ext;
+    eh->eh_entries++;
+}
+
+static int ext_new_node(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode, uint16_t depth,
+                        uint32_t *block_no, struct osfs_extent_header **node)
+{
+    int ret = osfs_alloc_data_block(sb_info, block_no);
+
+    if (ret)
+        return ret;
+    *node = osfs_block_addr(sb_info, *block_no);
+    memset(*node, 0, sb_info->block_size);
+    (*node)->eh_magic = OSFS_EXT_MAGIC;
+    (*node)->eh_max = OSFS_LEAF_EXTENTS(sb_info);
+    (*node)->eh_depth = depth;
+    osfs_inode->i_blocks++;
+    return 0;
+}
+
+// Move the full root's records into a new node and index that from the root
+static int ext_grow_root(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode)
+{
+    struct osfs_extent_header *root = &osfs_inode->i_eh, *node;
+    uint32_t node_no;
+    int ret;
+
+    if (root->eh_depth == OSFS_EXT_MAX_DEPTH) {
+        pr_err("osfs_ext_insert: Extent tree is full\n");
+        return -EFBIG;
+    }
+    ret = ext_new_node(sb_info, osfs_inode, root->eh_depth, &node_no, &node);
+    if (ret)
+        return ret;
+    memcpy(ext_records(node), ext_records(root), root->eh_entries * sizeof(struct osfs_extent));
+    node->eh_entries = root->eh_entries;
+    root->eh_depth++;
+    root->eh_entries = 1;
+    ext_records(root)[0] = (struct osfs_extent){
+        .ee_block = ext_records(node)[0].ee_block,
+        .ee_start = node_no,
+    };
+    osfs_dirty_block(sb_info, node_no, 1, true);
+    return 0;
+}
+
+// Split the full node at level l of the path in half; its parent has room
+static int ext_split(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode,
+                     const struct ext_path *path, int l)
+{
+    struct osfs_extent_header *node = path->node[l], *half;
+    int keep = node->eh_entries / 2;
+    uint32_t half_no;
+    int ret;
+
+    ret = ext_new_node(sb_info, osfs_inode, node->eh_depth, &half_no, &half);
+    if (ret)
+        return ret;
+    memcpy(ext_records(half), ext_records(node) + keep,
+           (node->eh_entries - keep) * sizeof(struct osfs_extent));
+    half->eh_entries = node->eh_entries - keep;
+    node->eh_entries = keep;
+    ext_insert_at(path->node[l - 1], path->pos[l - 1] + 1, &(struct osfs_extent){
+        .ee_block = ext_records(half)[0].ee_block,
+        .ee_start = half_no,
+    });
+    osfs_dirty_block(sb_info, half_no, 1, true);
+    osfs_dirty_block(sb_info, path->block_no[l], 1, true);
+    if (l - 1 > 0)
+        osfs_dirty_block(sb_info, path->block_no[l - 1], 1, true);
+    return 0;
+}
+
+/*
+ * Add a new extent. While its leaf is full, the lowest full node on the
+ * path whose parent has room is split (the root grows a level when all
+ * of them are full) and the path looked up again. Returns -EFBIG when
+ * the tree is OSFS_EXT_MAX_DEPTH deep and full.
+ */
+static int ext_insert(struct inode *inode, const struct osfs_extent *ext)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_extent_header *leaf;
+    struct ext_path path;
+    int l, ret;
+
+    for (;;) {
+        ext_find_path(sb_info, osfs_inode, ext->ee_block, &path);
+        leaf = path.node[path.depth];
+        if (leaf->eh_entries < leaf->eh_max)
+            break;
+        for (l = path.depth - 1; l >= 0 && path.node[l]->eh_entries == path.node[l]->eh_max; l--)
+            ;
+        ret = l < 0 ? ext_grow_root(sb_info, osfs_inode) : ext_split(sb_info, osfs_inode, &path, l + 1);
+        if (ret)
+            return ret;
+    }
+
+    ext_insert_at(leaf, path.pos[path.depth] + 1, ext);
+    ext_lower_keys(&path, ext->ee_block);
+    ext_dirty_path(sb_info, &path);
+    return 0;
+}
+
+/**
+ * Function: osfs_ext_map
+ * Description: Maps logical block `block` of an extent inode.
+ * Inputs:
+ *   - max_blocks: the caller wants at most this many blocks from `block`
+ *   - create: allocate what is not mapped yet
+ * Outputs:
+ *   - phys_block: physical block of `block`, 0 for a hole
+ *   - count: length of the contiguous run (mapped or hole) starting there
+ * Returns:
+ *   - 0, or a negative error code.
+ *
+ * Allocation asks for up to the whole hole in one run, aimed right
+ * behind the extent that ends before `block`, so sequential writes keep
+ * growing a single record. A hole that ends at the next extent is aimed
+ * right in front of it instead, and a run that lands there is merged into
+ * that record. Otherwise the run starts at the next free block and
+ * becomes a new extent.
+ */
+int osfs_ext_map(struct inode *inode, sector_t block, uint32_t max_blocks,
+                 uint32_t *phys_block, uint32_t *count, int create)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_extent_header *leaf;
+    struct osfs_extent *rec, *prev, *next_rec, ext;
+    struct ext_path path;
+    sector_t next;
+    uint32_t n, goal, start, len;
+    bool adjacent;
+    int i, ret;
+
+    *phys_block = 0;
+    *count = 0;
+    if (max_blocks == 0)
+        return 0;
+    if (block >= U32_MAX)
+        return -EFBIG;
+
+    osfs_stat_add(sb_info, OSFS_STAT_EXTENT_MAPS, 1);
+    ext_find_path(sb_info, osfs_inode, block, &path);
+    leaf = path.node[path.depth];
+    rec = ext_records(leaf);
+    i = path.pos[path.depth];
+    prev = i >= 0 ? &rec[i] : NULL;
+
+    if (prev && block < (sector_t)prev->ee_block + prev->ee_len) {
+        *phys_block = prev->ee_start + (block - prev->ee_block);
+        *count = min_t(uint32_t, max_blocks, prev->ee_block + prev->ee_len - block);
+        return 0;
+    }
+
+    // A hole, up to the next extent
+    next = ext_next_key(&path);
+    n = next - block < max_blocks ? next - block : max_blocks;
+
+    if (!create) {
+        *count = n;
+        return 0;
+    }
+
+    // Aim right behind the extent this block continues, or in front of the one the hole ends at
+    next_rec = i + 1 < leaf->eh_entries ? &rec[i + 1] : NULL;
+    adjacent = prev && (sector_t)prev->ee_block + prev->ee_len == block;
+    if (adjacent)
+        goal = prev->ee_start + prev->ee_len;
+    else if (next_rec && next_rec->ee_block == block + n && next_rec->ee_start > n)
+        goal = next_rec->ee_start - n;
+    else
+        goal = 0;
+    ret = osfs_inode_alloc_blocks(inode, goal, n, &start, &len);
+    if (ret)
+        return ret;
+    osfs_inode->i_blocks += len;
+
+    if (adjacent && start == prev->ee_start + prev->ee_len) {
+        prev->ee_len += len;
+        // Closing the gap to the next extent: merge the two records
+        if (next_rec && next_rec->ee_block == prev->ee_block + prev->ee_len &&
+            next_rec->ee_start == prev->ee_start + prev->ee_len) {
+            prev->ee_len += next_rec->ee_len;
+            memmove(next_rec, next_rec + 1, (leaf->eh_entries - i - 2) * sizeof(*rec));
+            leaf->eh_entries--;
+        }
+        ext_dirty_path(sb_info, &path);
+    } else if (next_rec && block + len == next_rec->ee_block && start + len == next_rec->ee_start) {
+        // Right in front of the next extent: it starts earlier now
+        next_rec->ee_block = block;
+        next_rec->ee_start = start;
+        next_rec->ee_len += len;
+        if (i < 0)
+            ext_lower_keys(&path, block);
+        ext_dirty_path(sb_info, &path);
+    } else {
+        ext = (struct osfs_extent){ .ee_block = block, .ee_start = start, .ee_len = len };
+        ret = ext_insert(inode, &ext);
+        if (ret) {
+            osfs_free_blocks(sb_info, start, len);
+            osfs_inode->i_blocks -= len;
+            return ret;
+        }
+    }
+    mark_inode_dirty(inode);
+
+    *phys_block = start;
+    *count = len;
+    return 0;
+}
+
+/*
+ * Release every block at or past logical block first below a node and
+ * return how many. Records are dropped from the end; the subtrees of an
+ * index hold ascending ranges, so the walk stops at the first child that
+ * keeps something. Recurses at most OSFS_EXT_MAX_DEPTH levels.
+ */
+static uint32_t ext_truncate_node(struct osfs_sb_info *sb_info, struct osfs_extent_header *eh,
+                                  uint32_t node_no, sector_t first)
+{
+    struct osfs_extent *rec = ext_records(eh), *last;
+    uint32_t freed = 0, keep;
+
+    while (eh->eh_entries > 0) {
+        last = &rec[eh->eh_entries - 1];
+        if (eh->eh_depth > 0) {
+            struct osfs_extent_header *child = osfs_block_addr(sb_info, last->ee_start);
+
+            freed += ext_truncate_node(sb_info, child, last->ee_start, first);
+            if (child->eh_entries > 0)
+                break;
+            osfs_free_data_block(sb_info, last->ee_start);
+            freed++;
+        } else if (last->ee_block < first) {
+            // The last extent ends past first: keep its front
+            if ((sector_t)last->ee_block + last->ee_len > first) {
+                keep = first - last->ee_block;
+                osfs_free_blocks(sb_info, last->ee_start + keep, last->ee_len - keep);
+                freed += last->ee_len - keep;
+                last->ee_len = keep;
+            }
+            break;
+        } else {
+            osfs_free_blocks(sb_info, last->ee_start, last->ee_len);
+            freed += last->ee_len;
+        }
+        eh->eh_entries--;
+    }
+    // A node left empty is freed by the caller and need not be logged
+    if (freed && node_no && eh->eh_entries > 0)
+        osfs_dirty_block(sb_info, node_no, 1, true);
+    return freed;
+}
+
+/**
+ * Function: osfs_ext_truncate
+ * Description: Releases the data and tree blocks of an extent inode from
+ * logical block first on; first = 0 empties the tree.
+ */
+void osfs_ext_truncate(struct inode *inode, sector_t first)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    osfs_inode->i_blocks -= ext_truncate_node(sb_info, &osfs_inode->i_eh, 0, first);
+    if (osfs_inode->i_eh.eh_entries == 0)
+        osfs_ext_init(osfs_inode);
+    mark_inode_dirty(inode);
+}
+
+/*
+ * A node read back from the backing store: its header, ascending
+ * records, non-overlapping extents, and children one level down,
+ * each inside the volume and allocated.
+ */
+static int ext_check_node(struct osfs_sb_info *sb_info, struct osfs_extent_header *eh,
+                          uint16_t max, uint16_t depth)
+{
+    struct osfs_extent *rec = ext_records(eh);
+    int i, ret;
+
+    if (eh->eh_magic != OSFS_EXT_MAGIC || eh->eh_max > max || eh->eh_entries > eh->eh_max ||
+        eh->eh_depth != depth)
+        return -EUCLEAN;
+    for (i = 0; i < eh->eh_entries; i++) {
+        if (i > 0 && rec[i].ee_block <= rec[i - 1].ee_block)
+            return -EUCLEAN;
+        if (depth > 0) {
+            if (!osfs_blocks_valid(sb_info, rec[i].ee_start, 1))
+                return -EUCLEAN;
+            ret = ext_check_node(sb_info, osfs_block_addr(sb_info, rec[i].ee_start),
+                                 OSFS_LEAF_EXTENTS(sb_info), depth - 1);
+            if (ret)
+                return ret;
+            continue;
+        }
+        if (rec[i].ee_len > U32_MAX - rec[i].ee_block ||
+            (i > 0 && rec[i].ee_block < rec[i - 1].ee_block + rec[i - 1].ee_len) ||
+            !osfs_blocks_valid(sb_info, rec[i].ee_start, rec[i].ee_len))
+            return -EUCLEAN;
+    }
+    return 0;
+}
+
+/**
+ * Function: osfs_ext_check
+ * Description: Checks the extent tree of an inode loaded from the
+ * backing store before anything follows its block numbers.
+ * Returns:
+ *   - 0, or -EUCLEAN.
+ */
+int osfs_ext_check(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode)
+{
+    if (osfs_inode->i_eh.eh_depth > OSFS_EXT_MAX_DEPTH)
+        return -EUCLEAN;
+    return ext_check_node(sb_info, &osfs_inode->i_eh, OSFS_INLINE_EXTENTS, osfs_inode->i_eh.eh_depth);
+}
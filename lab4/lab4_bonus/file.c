@@ -1,148 +1,532 @@
 #include <linux/fs.h>
-#include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/writeback.h>
+#include <linux/uio.h>
+#include <linux/version.h>
 #include "osfs.h"
 
+/*
+ * 一般檔案透過 page cache 讀寫：read_iter / write_iter / mmap / splice 都用
+ * VFS 的通用實作，osfs 只負責 folio 與資料區塊之間的搬移 (address_space_operations)。
+ * - read_folio / readahead: 把區塊複製進 folio，「洞」填 0
+ * - write_begin: 寫入前先替 folio 內的區塊分配空間，空間不足在 write() 就回報
+ * - writepages: 把 dirty folio 寫回區塊 (mmap 寫到「洞」時才在這裡分配)
+ * O_DIRECT 的讀寫略過 page cache，直接在 iov_iter 與資料區塊之間複製 (osfs_direct_read/write)。
+ */
+
+// write_begin / write_end 的參數在不同核心版本不一樣
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0)
+typedef const struct kiocb *osfs_wb_ctx_t;
+#else
+typedef struct file *osfs_wb_ctx_t;
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+typedef struct folio *osfs_wb_page_t;
+#define osfs_wb_folio(p) (p)
+#define osfs_wb_page(f) (f)
+#else
+typedef struct page *osfs_wb_page_t;
+#define osfs_wb_folio(p) page_folio(p)
+#define osfs_wb_page(f) (&(f)->page)
+#endif
+
 /**
- * 函式: osfs_read
- * 描述: 支援多層索引 (Multi-level Indexing) 的檔案讀取函式。
- * 這能夠處理跨越多個 Block 的大檔案讀取。
+ * 函式: osfs_folio_io
+ * 描述: 在 folio 與資料區塊之間複製 i_size 以內的區塊。
+ * 每次用 osfs_map_blocks 取得一整段實體連續的區塊。
+ * 輸入:
+ * - to_folio: true 讀進 folio (「洞」與 i_size 之後填 0)，false 寫回區塊
+ * - create: 1 代表替「洞」分配區塊 (寫回用)
+ * 回傳: 0 成功，寫回時分配失敗回傳負的錯誤碼。
  */
-static ssize_t osfs_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
+static int osfs_folio_io(struct inode *inode, struct folio *folio, bool to_folio, int create)
 {
-    struct inode *inode = file_inode(filp);
-    struct osfs_inode *osfs_inode = inode->i_private;
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
-    void *data_block;
-    ssize_t bytes_read = 0;
-    uint32_t phys_block;
-    loff_t offset;
-    size_t to_read;
+    loff_t pos = folio_pos(folio), isize = i_size_read(inode);
+    size_t size = folio_size(folio), off = 0, valid;
+    uint32_t phys_block, count, i;
     int ret;
 
-    // 檢查檔案是否為空 (沒有分配任何 Block)
-    if (osfs_inode->i_blocks == 0)
-        return 0;
+    valid = isize > pos ? min_t(loff_t, size, isize - pos) : 0;
+    while (off < valid) {
+        sector_t block = (pos + off) >> sb_info->block_size_bits;
+        uint32_t want = DIV_ROUND_UP(valid - off, sb_info->block_size);
 
-    // 檢查讀取位置是否超過檔案大小
-    if (*ppos >= osfs_inode->i_size)
-        return 0;
+        ret = osfs_map_blocks(inode, block, want, &phys_block, &count, create);
+        if (ret && !to_folio)
+            return ret;
+        if (ret || count == 0) {
+            // 讀取時查不到就當作「洞」
+            phys_block = 0;
+            count = 1;
+        }
+
+        for (i = 0; i < count && off < valid; i++, off += sb_info->block_size) {
+            void *kaddr;
 
-    // 調整讀取長度，避免讀超過檔案結尾
-    if (*ppos + len > osfs_inode->i_size)
-        len = osfs_inode->i_size - *ppos;
-
-    // --- 迴圈處理跨 Block 讀取 ---
-    while (len > 0) {
-        // 1. 計算目前的「邏輯」區塊編號 (例如：這是檔案的第幾個 Block)
-        sector_t block = *ppos / BLOCK_SIZE;
-        
-        // 2. 計算在該 Block 內的偏移量 (Offset)
-        offset = *ppos % BLOCK_SIZE;
-        
-        // 3. 計算這次迴圈能讀多少 (不能跨越 Block 邊界，取最小值)
-        to_read = min_t(size_t, len, BLOCK_SIZE - offset);
-
-        // 4. 呼叫核心函式取得「實體」區塊編號
-        // create=0 表示如果不存則不要建立 (讀取模式)
-        ret = osfs_get_block(inode, block, &phys_block, 0);
-        
-        if (ret || phys_block == 0) {
-            // 如果發生錯誤，或是 phys_block 為 0 (代表這是檔案的「洞」，沒資料)
-            // 填入 0 給使用者
-            if (clear_user(buf + bytes_read, to_read))
-                return bytes_read > 0 ? bytes_read : -EFAULT;
-        } else {
-            // 5. 計算實體記憶體位址並複製資料
-            data_block = sb_info->data_blocks + phys_block * BLOCK_SIZE + offset;
-            if (copy_to_user(buf + bytes_read, data_block, to_read))
-                return bytes_read > 0 ? bytes_read : -EFAULT;
+            if (phys_block == 0) {
+                if (to_folio)
+                    folio_zero_range(folio, off, sb_info->block_size);
+                continue;
+            }
+            // 一個區塊不會跨 Page，一次對應一個區塊
+            kaddr = kmap_local_folio(folio, off);
+            if (to_folio)
+                memcpy(kaddr, osfs_block_addr(sb_info, phys_block + i), sb_info->block_size);
+            else
+                memcpy(osfs_block_addr(sb_info, phys_block + i), kaddr, sb_info->block_size);
+            kunmap_local(kaddr);
         }
+        if (!to_folio && phys_block)
+            osfs_dirty_block(sb_info, phys_block, i, false);
+    }
+
+    // 檔案結尾之後 (包含最後一個區塊的尾巴) 一律是 0
+    if (to_folio && valid < size)
+        folio_zero_range(folio, valid, size - valid);
+    return 0;
+}
+
+/**
+ * 函式: osfs_read_folio
+ * 描述: page cache 缺頁時從資料區塊讀入一個 folio。
+ */
+static int osfs_read_folio(struct file *file, struct folio *folio)
+{
+    osfs_folio_io(folio->mapping->host, folio, true, 0);
+    folio_mark_uptodate(folio);
+    folio_unlock(folio);
+    return 0;
+}
 
-        // 6. 更新指標與計數器，準備讀下一個 Block
-        *ppos += to_read;
-        bytes_read += to_read;
-        len -= to_read;
+/**
+ * 函式: osfs_readahead
+ * 描述: 循序讀取時一次讀入多個 folio。
+ */
+static void osfs_readahead(struct readahead_control *rac)
+{
+    struct folio *folio;
+
+    while ((folio = readahead_folio(rac)) != NULL) {
+        osfs_folio_io(rac->mapping->host, folio, true, 0);
+        folio_mark_uptodate(folio);
+        folio_unlock(folio);
     }
+}
+
+/**
+ * 函式: osfs_truncate_failed_write
+ * 描述: 寫入失敗或只寫了一部分時，釋放 write_begin / 直接寫入在檔案結尾之後
+ * 分配的區塊，否則它們一直掛在 Inode 上，直到檔案被截短或刪除。呼叫者持有 i_rwsem。
+ */
+static void osfs_truncate_failed_write(struct inode *inode)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
 
-    return bytes_read;
+    down_write(&OSFS_I(inode)->map_lock);
+    osfs_meta_begin(sb_info);
+    osfs_truncate_blocks(inode, DIV_ROUND_UP(i_size_read(inode), sb_info->block_size));
+    osfs_meta_end(sb_info);
+    up_write(&OSFS_I(inode)->map_lock);
 }
 
 /**
- * 函式: osfs_write
- * 描述: 支援多層索引的檔案寫入函式。
- * 這能夠處理跨越多個 Block 的大檔案寫入，並自動分配所需的 Direct/Indirect Blocks。
+ * 函式: osfs_write_begin
+ * 描述: write() 寫入一個 folio 之前呼叫。
+ * 只寫一部分的 folio 先從區塊讀進來；接著替 folio 內到寫入結尾 (或檔案結尾)
+ * 為止的所有區塊分配空間，寫回時就不必再分配。
+ */
+static int osfs_write_begin(osfs_wb_ctx_t ctx, struct address_space *mapping, loff_t pos,
+                            unsigned len, osfs_wb_page_t *pagep, void **fsdata)
+{
+    struct inode *inode = mapping->host;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct folio *folio;
+    loff_t off, end;
+    uint32_t phys_block, count;
+    int ret = 0;
+
+    folio = __filemap_get_folio(mapping, pos >> PAGE_SHIFT, FGP_WRITEBEGIN, mapping_gfp_mask(mapping));
+    if (IS_ERR(folio))
+        return PTR_ERR(folio);
+
+    if (!folio_test_uptodate(folio) && len != folio_size(folio)) {
+        osfs_folio_io(inode, folio, true, 0);
+        folio_mark_uptodate(folio);
+    }
+
+    end = min_t(loff_t, max_t(loff_t, pos + len, i_size_read(inode)), folio_pos(folio) + folio_size(folio));
+    for (off = folio_pos(folio); off < end; off += (loff_t)count << sb_info->block_size_bits) {
+        ret = osfs_map_blocks(inode, off >> sb_info->block_size_bits,
+                              DIV_ROUND_UP(end - off, sb_info->block_size), &phys_block, &count, 1);
+        if (ret)
+            break;
+    }
+    if (ret) {
+        folio_unlock(folio);
+        folio_put(folio);
+        if (pos + len > i_size_read(inode))
+            osfs_truncate_failed_write(inode);
+        return ret;
+    }
+
+    *pagep = osfs_wb_page(folio);
+    return 0;
+}
+
+/**
+ * 函式: osfs_write_end
+ * 描述: 資料複製進 folio 之後呼叫，標記為 dirty 並更新檔案大小。
+ * 沒有全部複製時，新結尾之後由 write_begin 分配的區塊要釋放。
+ */
+static int osfs_write_end(osfs_wb_ctx_t ctx, struct address_space *mapping, loff_t pos,
+                          unsigned len, unsigned copied, osfs_wb_page_t page, void *fsdata)
+{
+    struct folio *folio = osfs_wb_folio(page);
+    struct inode *inode = mapping->host;
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    if (!folio_test_uptodate(folio)) {
+        // 整個 folio 都要覆寫卻只複製了一部分：當作沒寫，讓上層重試
+        if (copied < len) {
+            copied = 0;
+            goto out;
+        }
+        folio_mark_uptodate(folio);
+    }
+
+    // 如果寫入後檔案變大了，更新檔案大小
+    if (pos + copied > inode->i_size) {
+        i_size_write(inode, pos + copied);
+        osfs_inode->i_size = pos + copied;
+    }
+    folio_mark_dirty(folio);
+
+out:
+    folio_unlock(folio);
+    folio_put(folio);
+    if (pos + len > i_size_read(inode))
+        osfs_truncate_failed_write(inode);
+    return copied;
+}
+
+// 寫回一個 dirty folio (呼叫時 folio 已上鎖)
+static int osfs_write_folio(struct folio *folio, struct writeback_control *wbc, void *data)
+{
+    struct inode *inode = folio->mapping->host;
+    int ret;
+
+    folio_start_writeback(folio);
+    ret = osfs_folio_io(inode, folio, false, 1);
+    if (ret)
+        mapping_set_error(folio->mapping, ret);
+    folio_unlock(folio);
+    folio_end_writeback(folio);
+    return ret;
+}
+
+/**
+ * 函式: osfs_writepages
+ * 描述: 把 dirty folio 寫回資料區塊 (sync、fsync、回收記憶體時)。
+ */
+static int osfs_writepages(struct address_space *mapping, struct writeback_control *wbc)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+    struct folio *folio = NULL;
+    int error = 0;
+
+    while ((folio = writeback_iter(mapping, wbc, folio, &error)))
+        error = osfs_write_folio(folio, wbc, NULL);
+    return error;
+#else
+    return write_cache_pages(mapping, wbc, osfs_write_folio, NULL);
+#endif
+}
+
+/**
+ * 結構: osfs_aops
+ * 描述: 一般檔案 page cache 與資料區塊之間的操作。
+ */
+const struct address_space_operations osfs_aops = {
+    .read_folio = osfs_read_folio,
+    .readahead = osfs_readahead,
+    .write_begin = osfs_write_begin,
+    .write_end = osfs_write_end,
+    .writepages = osfs_writepages,
+    .dirty_folio = filemap_dirty_folio,
+};
+
+/**
+ * 函式: osfs_setattr
+ * 描述: 變更屬性；改變檔案大小時同步 page cache，並釋放新結尾之後的所有區塊。
+ * 截短時最後一塊在結尾之後的部分也在資料區塊裡清成 0，之後再把檔案變長，
+ * 那一段讀到的是 0 而不是舊資料。
  */
-static ssize_t osfs_write(struct file *filp, const char __user *buf, size_t len, loff_t *ppos)
+static int osfs_setattr(struct mnt_idmap *idmap, struct dentry *dentry, struct iattr *attr)
 {
-    struct inode *inode = file_inode(filp);
+    struct inode *inode = d_inode(dentry);
     struct osfs_inode *osfs_inode = inode->i_private;
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
-    void *data_block;
-    ssize_t bytes_written = 0;
-    uint32_t phys_block;
-    loff_t offset;
-    size_t to_write;
     int ret;
 
-    // --- 迴圈處理跨 Block 寫入 ---
-    while (len > 0) {
-        // 1. 計算邏輯區塊與偏移量
-        sector_t block = *ppos / BLOCK_SIZE;
-        offset = *ppos % BLOCK_SIZE;
-        // 計算這次能寫多少 (填滿目前的 Block 為止)
-        to_write = min_t(size_t, len, BLOCK_SIZE - offset);
-
-        // 2. 取得或分配實體區塊
-        // create=1 表示如果該區塊 (或中間的索引表) 不存在，請幫我建立！
-        ret = osfs_get_block(inode, block, &phys_block, 1);
-        if (ret) {
-            pr_err("osfs_write: Failed to get/allocate block %llu, error %d\n", 
-                   (unsigned long long)block, ret);
-            // 如果前面已經有寫入部分資料，則回傳成功寫入的位元組數，不回傳錯誤
-            if (bytes_written > 0)
-                break;
-            return ret;
+    ret = setattr_prepare(idmap, dentry, attr);
+    if (ret)
+        return ret;
+
+    if ((attr->ia_valid & ATTR_SIZE) && attr->ia_size != i_size_read(inode)) {
+        loff_t tail = attr->ia_size & (sb_info->block_size - 1);
+        bool shrink = attr->ia_size < i_size_read(inode);
+        uint32_t phys_block, count;
+        void *addr;
+
+        truncate_setsize(inode, attr->ia_size);
+        osfs_inode->i_size = attr->ia_size;
+
+        // truncate_setsize 只清了 page cache，資料區塊裡結尾之後的舊資料也要清掉
+        if (shrink && tail &&
+            !osfs_map_blocks(inode, attr->ia_size >> sb_info->block_size_bits, 1,
+                             &phys_block, &count, 0) &&
+            phys_block && (addr = osfs_block_addr(sb_info, phys_block))) {
+            memset(addr + tail, 0, sb_info->block_size - tail);
+            osfs_dirty_block(sb_info, phys_block, 1, false);
         }
 
-        // 防呆檢查
-        if (phys_block == 0) {
-            pr_err("osfs_write: Invalid physical block\n");
-            if (bytes_written > 0)
-                break;
-            return -EIO;
+        down_write(&OSFS_I(inode)->map_lock);
+        osfs_meta_begin(sb_info);
+        osfs_truncate_blocks(inode, DIV_ROUND_UP(attr->ia_size, sb_info->block_size));
+        osfs_meta_end(sb_info);
+        up_write(&OSFS_I(inode)->map_lock);
+    }
+
+    setattr_copy(idmap, inode, attr);
+    mark_inode_dirty(inode);
+    return 0;
+}
+
+/**
+ * 函式: osfs_copy_run
+ * 描述: 在 iov_iter 與一段實體連續的區塊之間複製 len 位元組，
+ * 從第 phys_block 塊開頭往後 offset 位元組的地方開始。
+ * 區塊只在同一個 Page 內記憶體連續，所以每個 Page 呼叫一次 copy_to_iter / copy_from_iter。
+ * 回傳: 實際複製的位元組數 (使用者緩衝區無效時會比 len 少)。
+ */
+static size_t osfs_copy_run(struct osfs_sb_info *sb_info, uint32_t phys_block, size_t offset,
+                            size_t len, struct iov_iter *iter, bool to_iter)
+{
+    size_t done = 0, copied;
+
+    while (done < len) {
+        uint32_t block = phys_block + ((offset + done) >> sb_info->block_size_bits);
+        size_t in_block = (offset + done) & (sb_info->block_size - 1);
+        size_t in_page = ((block % sb_info->blocks_per_page) << sb_info->block_size_bits) + in_block;
+        size_t chunk = min_t(size_t, len - done, PAGE_SIZE - in_page);
+        void *addr = osfs_block_addr(sb_info, block) + in_block;
+
+        if (to_iter)
+            copied = copy_to_iter(addr, chunk, iter);
+        else
+            copied = copy_from_iter(addr, chunk, iter);
+        done += copied;
+        if (copied < chunk)
+            break;
+    }
+    return done;
+}
+
+/**
+ * 函式: osfs_direct_read
+ * 描述: O_DIRECT 讀取。先把範圍內的 dirty page 寫回，
+ * 之後每段實體連續的區塊 (或「洞」) 只查一次 osfs_map_blocks、複製一次。
+ */
+static ssize_t osfs_direct_read(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct inode *inode = file_inode(iocb->ki_filp);
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    loff_t pos = iocb->ki_pos, isize;
+    size_t len, done = 0, n, copied;
+    uint32_t phys_block, count;
+    ssize_t ret = 0;
+
+    if (!iov_iter_count(to))
+        return 0;
+
+    inode_lock_shared(inode);
+    isize = i_size_read(inode);
+    if (pos >= isize)
+        goto out;
+    len = min_t(loff_t, iov_iter_count(to), isize - pos);
+
+    ret = filemap_write_and_wait_range(inode->i_mapping, pos, pos + len - 1);
+    if (ret)
+        goto out;
+
+    while (done < len) {
+        loff_t off = pos + done;
+        size_t in_block = off & (sb_info->block_size - 1);
+
+        ret = osfs_map_blocks(inode, off >> sb_info->block_size_bits,
+                              DIV_ROUND_UP(in_block + len - done, sb_info->block_size),
+                              &phys_block, &count, 0);
+        if (ret)
+            break;
+        if (count == 0) {
+            phys_block = 0;
+            count = 1;
         }
 
-        // 3. 將資料寫入實體 Block
-        data_block = sb_info->data_blocks + phys_block * BLOCK_SIZE + offset;
-        if (copy_from_user(data_block, buf + bytes_written, to_write)) {
-            pr_err("osfs_write: Failed to copy data from user space\n");
-            if (bytes_written > 0)
-                break;
-            return -EFAULT;
+        n = min_t(size_t, len - done, ((size_t)count << sb_info->block_size_bits) - in_block);
+        if (phys_block == 0)
+            copied = iov_iter_zero(n, to);
+        else
+            copied = osfs_copy_run(sb_info, phys_block, in_block, n, to, true);
+        done += copied;
+        if (copied < n) {
+            ret = -EFAULT;
+            break;
         }
+    }
 
-        // 4. 更新指標
-        *ppos += to_write;
-        bytes_written += to_write;
-        len -= to_write;
+    if (done) {
+        iocb->ki_pos += done;
+        file_accessed(iocb->ki_filp);
+        ret = done;
     }
+out:
+    inode_unlock_shared(inode);
+    return ret;
+}
 
-    // 5. 更新檔案 Metadata
-    // 如果寫入後檔案變大了，更新檔案大小
-    if (*ppos > osfs_inode->i_size) {
-        osfs_inode->i_size = *ppos;
-        inode->i_size = osfs_inode->i_size;
+/**
+ * 函式: osfs_direct_write
+ * 描述: O_DIRECT 寫入。起點與長度都對齊區塊時略過 page cache：
+ * 每段連續區塊只分配、查詢一次，用一次 copy_from_iter 寫進去 (跨 Page 時分開)，
+ * 檔案時間與大小在整次寫入只更新一次。沒有對齊時改走 page cache。
+ */
+static ssize_t osfs_direct_write(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct file *file = iocb->ki_filp;
+    struct inode *inode = file_inode(file);
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    size_t len, done = 0, n, copied;
+    uint32_t phys_block, count;
+    loff_t pos;
+    ssize_t ret;
+
+    inode_lock(inode);
+    ret = generic_write_checks(iocb, from);
+    if (ret <= 0)
+        goto out;
+    pos = iocb->ki_pos;
+    len = ret;
+
+    ret = file_remove_privs(file);
+    if (ret)
+        goto out;
+    ret = file_update_time(file);
+    if (ret)
+        goto out;
+
+    if ((pos | len) & (sb_info->block_size - 1)) {
+        iocb->ki_flags &= ~IOCB_DIRECT;
+        ret = generic_perform_write(iocb, from);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
+        if (ret > 0)
+            iocb->ki_pos += ret;
+#endif
+        goto out;
     }
 
-    // 更新時間
-    osfs_inode->__i_mtime = current_time(inode);
-    osfs_inode->__i_ctime = current_time(inode);
-    inode_set_mtime_to_ts(inode, osfs_inode->__i_mtime);
-    inode_set_ctime_to_ts(inode, osfs_inode->__i_ctime);
+    ret = filemap_write_and_wait_range(inode->i_mapping, pos, pos + len - 1);
+    if (ret)
+        goto out;
+    ret = invalidate_inode_pages2_range(inode->i_mapping, pos >> PAGE_SHIFT, (pos + len - 1) >> PAGE_SHIFT);
+    if (ret)
+        goto out;
 
-    mark_inode_dirty(inode);
+    while (done < len) {
+        ret = osfs_map_blocks(inode, (pos + done) >> sb_info->block_size_bits,
+                              (len - done) >> sb_info->block_size_bits, &phys_block, &count, 1);
+        if (ret)
+            break;
+
+        n = min_t(size_t, len - done, (size_t)count << sb_info->block_size_bits);
+        copied = osfs_copy_run(sb_info, phys_block, 0, n, from, false);
+        osfs_dirty_block(sb_info, phys_block, DIV_ROUND_UP(copied, sb_info->block_size), false);
+        done += copied;
+        if (copied < n) {
+            ret = -EFAULT;
+            break;
+        }
+    }
+
+    if (done) {
+        if (pos + done > i_size_read(inode)) {
+            i_size_write(inode, pos + done);
+            osfs_inode->i_size = pos + done;
+            mark_inode_dirty(inode);
+        }
+        iocb->ki_pos += done;
+        ret = done;
+    }
+    if (done < len && pos + len > i_size_read(inode))
+        osfs_truncate_failed_write(inode);
+out:
+    inode_unlock(inode);
+    if (ret > 0)
+        ret = generic_write_sync(iocb, ret);
+    return ret;
+}
 
-    return bytes_written;
+static ssize_t osfs_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct osfs_sb_info *sb_info = file_inode(iocb->ki_filp)->i_sb->s_fs_info;
+    ssize_t ret;
+
+    if (iocb->ki_flags & IOCB_DIRECT)
+        ret = osfs_direct_read(iocb, to);
+    else
+        ret = generic_file_read_iter(iocb, to);
+    if (ret > 0)
+        osfs_stat_add(sb_info, OSFS_STAT_BYTES_READ, ret);
+    return ret;
+}
+
+static ssize_t osfs_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct osfs_sb_info *sb_info = file_inode(iocb->ki_filp)->i_sb->s_fs_info;
+    ssize_t ret;
+
+    if (iocb->ki_flags & IOCB_DIRECT)
+        ret = osfs_direct_write(iocb, from);
+    else
+        ret = generic_file_write_iter(iocb, from);
+    if (ret > 0)
+        osfs_stat_add(sb_info, OSFS_STAT_BYTES_WRITTEN, ret);
+    return ret;
+}
+
+// 允許以 O_DIRECT 開啟 (沒有 a_ops->direct_IO，由 read_iter / write_iter 自己處理)
+static int osfs_file_open(struct inode *inode, struct file *filp)
+{
+    filp->f_mode |= FMODE_CAN_ODIRECT;
+    return generic_file_open(inode, filp);
+}
+
+/**
+ * 函式: osfs_fsync
+ * 描述: 把檔案寫回資料區塊之後，有備份裝置時再 commit 一次。
+ * commit 只寫 dirty 的區塊；同時進來的 fsync 依序 commit，後面的多半已經沒有東西要寫。
+ */
+static int osfs_fsync(struct file *file, loff_t start, loff_t end, int datasync)
+{
+    int ret = __generic_file_fsync(file, start, end, datasync);
+
+    if (!ret)
+        ret = osfs_commit(file_inode(file)->i_sb->s_fs_info);
+    return ret;
 }
 
 /**
@@ -150,15 +534,20 @@ static ssize_t osfs_write(struct file *filp, const char __user *buf, size_t len,
  * 描述: 定義一般檔案的操作。
  */
 const struct file_operations osfs_file_operations = {
-    .open = generic_file_open,
-    .read = osfs_read,
-    .write = osfs_write,
-    .llseek = default_llseek,
+    .open = osfs_file_open,
+    .read_iter = osfs_file_read_iter,
+    .write_iter = osfs_file_write_iter,
+    .mmap = generic_file_mmap,
+    .splice_read = filemap_splice_read,
+    .splice_write = iter_file_splice_write,
+    .fsync = osfs_fsync,
+    .llseek = generic_file_llseek,
 };
 
 /**
  * 結構: osfs_file_inode_operations
- * 描述: 定義 Inode 操作 (目前為空)。
+ * 描述: 定義 Inode 操作。
  */
 const struct inode_operations osfs_file_inode_operations = {
-};
\ No newline at end of file
+    .setattr = osfs_setattr,
+};
@@ -1,37 +1,108 @@
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/mm.h>
 #include "osfs.h"
+#include "osfs_trace.h"
 
 // --- 基礎函式 (與 Requirement 版本相同) ---
 
 /**
  * 函式: osfs_get_osfs_inode
- * 描述: 取得底層 OSFS Inode 指標。
+ * 描述: 取得底層 OSFS Inode 指標 (所在的 Group 還沒有 Inode 表時回傳 NULL)。
  */
 struct osfs_inode *osfs_get_osfs_inode(struct super_block *sb, uint32_t ino)
 {
     struct osfs_sb_info *sb_info = sb->s_fs_info;
+    struct osfs_inode *table;
 
     if (ino == 0 || ino >= sb_info->inode_count) 
         return NULL;
-    return &((struct osfs_inode *)(sb_info->inode_table))[ino];
+    table = READ_ONCE(sb_info->groups[ino / sb_info->inodes_per_group].inode_table);
+    if (!table)
+        return NULL;
+    return &table[ino % sb_info->inodes_per_group];
+}
+
+// 在 [goal, size) 找第一個 0 bit，找不到再找 [0, goal)；都沒有回傳 size
+// (看過的 bit 數計入 bitmap_bits_scanned)
+static unsigned long osfs_find_zero_bit(struct osfs_sb_info *sb_info, const unsigned long *bitmap,
+                                        unsigned long size, unsigned long goal)
+{
+    unsigned long bit;
+
+    if (goal >= size)
+        goal = 0;
+    bit = find_next_zero_bit(bitmap, size, goal);
+    if (bit < size) {
+        osfs_stat_add(sb_info, OSFS_STAT_BITMAP_SCANNED, bit - goal + 1);
+        return bit;
+    }
+    bit = find_next_zero_bit(bitmap, goal, 0);
+    if (bit < goal) {
+        osfs_stat_add(sb_info, OSFS_STAT_BITMAP_SCANNED, size - goal + bit + 1);
+        return bit;
+    }
+    osfs_stat_add(sb_info, OSFS_STAT_BITMAP_SCANNED, size);
+    return size;
+}
+
+// Group 的 Inode 表在第一次從這個 Group 分配 Inode 時才建立
+static int osfs_group_inode_table(struct osfs_group *group)
+{
+    struct osfs_inode *table;
+
+    if (READ_ONCE(group->inode_table))
+        return 0;
+    table = kvcalloc(group->nr_inodes, sizeof(*table), GFP_KERNEL_ACCOUNT);
+    if (!table)
+        return -ENOMEM;
+    if (cmpxchg(&group->inode_table, NULL, table) != NULL)
+        kvfree(table);
+    return 0;
 }
 
 /**
  * 函式: osfs_get_free_inode
- * 描述: 掃描 Bitmap 取得一個空閒的 Inode 編號。
+ * 描述: 從上次分配的位置 (inode_goal) 所在的 Group 開始，用 find_next_zero_bit
+ * 找空閒的 Inode 編號 (Next-fit)，這個 Group 滿了就換下一個。
+ * 每個 Group 的 Bitmap 與計數器由自己的鎖保護。
  */
 int osfs_get_free_inode(struct osfs_sb_info *sb_info)
 {
-    uint32_t ino;
+    uint32_t goal = READ_ONCE(sb_info->inode_goal);
+    uint32_t first = goal / sb_info->inodes_per_group;
+    uint32_t n, g, idx;
+    int ret;
 
-    for (ino = 1; ino < sb_info->inode_count; ino++) {
-        if (!test_bit(ino, sb_info->inode_bitmap)) {
-            set_bit(ino, sb_info->inode_bitmap);
-            sb_info->nr_free_inodes--;
-            return ino;
+    for (n = 0; n < sb_info->group_count; n++) {
+        struct osfs_group *group;
+
+        g = (first + n) % sb_info->group_count;
+        group = &sb_info->groups[g];
+        if (!READ_ONCE(group->nr_free_inodes))
+            continue;
+        ret = osfs_group_inode_table(group);
+        if (ret)
+            return ret;
+
+        spin_lock(&group->lock);
+        idx = osfs_find_zero_bit(sb_info, group->inode_bitmap, group->nr_inodes,
+                                 n == 0 ? goal % sb_info->inodes_per_group : 0);
+        if (idx < group->nr_inodes) {
+            __set_bit(idx, group->inode_bitmap);
+            group->nr_free_inodes--;
+            spin_unlock(&group->lock);
+            osfs_dirty_group(sb_info, g);
+
+            atomic_dec(&sb_info->nr_free_inodes);
+            osfs_stat_add(sb_info, OSFS_STAT_INODE_ALLOCS, 1);
+            idx += g * sb_info->inodes_per_group;
+            WRITE_ONCE(sb_info->inode_goal, idx + 1);
+            return idx;
         }
+        spin_unlock(&group->lock);
     }
+
     pr_err("osfs_get_free_inode: No free inode available\n");
     return -ENOSPC;
 }
@@ -39,6 +110,7 @@ int osfs_get_free_inode(struct osfs_sb_info *sb_info)
 /**
  * 函式: osfs_iget
  * 描述: 建立或讀取 VFS Inode，並掛載對應的操作函式。
+ * 同一個 Inode 只會有一個 VFS Inode (iget_locked)，所以所有開啟者共用同一份 page cache。
  */
 struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
 {
@@ -49,15 +121,16 @@ struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
     if (!osfs_inode)
         return ERR_PTR(-EFAULT);
 
-    inode = new_inode(sb);
+    inode = iget_locked(sb, ino);
     if (!inode)
         return ERR_PTR(-ENOMEM);
+    if (!(inode->i_state & I_NEW))
+        return inode;
 
-    inode->i_ino = ino;
-    inode->i_sb = sb;
     inode->i_mode = osfs_inode->i_mode;
     i_uid_write(inode, osfs_inode->i_uid);
     i_gid_write(inode, osfs_inode->i_gid);
+    set_nlink(inode, osfs_inode->i_links_count);
     
     inode_set_atime_to_ts(inode, osfs_inode->__i_atime);
     inode_set_mtime_to_ts(inode, osfs_inode->__i_mtime);
@@ -72,41 +145,202 @@ struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
     } else if (S_ISREG(inode->i_mode)) {
         inode->i_op = &osfs_file_inode_operations;
         inode->i_fop = &osfs_file_operations;
+        inode->i_mapping->a_ops = &osfs_aops;
     }
 
-    insert_inode_hash(inode);
+    unlock_new_inode(inode);
 
     return inode;
 }
 
+/**
+ * 函式: osfs_group_page_table
+ * 描述: 取得 Group 的 Page 表，第一次用到時才建立 (最後一個 Group 通常比較短，
+ * 表只涵蓋它自己的區塊)。
+ * 回傳: Page 表，配置失敗時回傳 NULL。
+ */
+void **osfs_group_page_table(struct osfs_sb_info *sb_info, struct osfs_group *group)
+{
+    void **table = READ_ONCE(group->data_pages), **old;
+
+    if (table)
+        return table;
+    table = kvcalloc(DIV_ROUND_UP(group->nr_blocks, sb_info->blocks_per_page),
+                     sizeof(void *), GFP_KERNEL_ACCOUNT);
+    if (!table)
+        return NULL;
+    old = cmpxchg(&group->data_pages, NULL, table);
+    if (old) {
+        kvfree(table);
+        return old;
+    }
+    return table;
+}
+
+// 分配到的區塊所在的 Page 還不存在時才配置 (清為 0)
+static int osfs_group_data_pages(struct osfs_sb_info *sb_info, struct osfs_group *group,
+                                 uint32_t idx, uint32_t count)
+{
+    uint32_t p, last = (idx + count - 1) / sb_info->blocks_per_page;
+    void **table = osfs_group_page_table(sb_info, group);
+
+    if (!table)
+        return -ENOMEM;
+    for (p = idx / sb_info->blocks_per_page; p <= last; p++) {
+        void *page;
+
+        if (READ_ONCE(table[p]))
+            continue;
+        page = (void *)get_zeroed_page(GFP_KERNEL_ACCOUNT);
+        if (!page)
+            return -ENOMEM;
+        if (cmpxchg(&table[p], NULL, page) != NULL)
+            free_page((unsigned long)page);
+    }
+    return 0;
+}
+
+/**
+ * 函式: osfs_alloc_blocks
+ * 描述: 分配一段連續的資料區塊。
+ * 從 goal 所在的 Group 開始，用 find_next_zero_bit 找第一個空閒區塊
+ * (到 Group 結尾再從 Group 開頭找)，再用 find_next_bit 把緊接在後的空閒區塊
+ * 一起拿走，最多 max_blocks 塊；這個 Group 滿了就換下一個，所以一次分配不會跨 Group。
+ * goal 為 0 或超出範圍代表沒有偏好，從上次分配結束的位置 (block_goal) 開始；
+ * 區塊 0 在掛載時就保留 (代表「洞」)，不會是有意義的 goal。
+ * 分配到的區塊一律清為 0：釋放後再分配的區塊裡還有前一個檔案的資料。
+ * 輸出:
+ * - start / count: 分配到的第一塊與塊數 (至少 1 塊)
+ * 回傳: 0 成功；沒有空閒區塊時回傳 -ENOSPC，配置 Page 失敗時回傳 -ENOMEM。
+ */
+int osfs_alloc_blocks(struct osfs_sb_info *sb_info, uint32_t goal, uint32_t max_blocks,
+                      uint32_t *start, uint32_t *count)
+{
+    uint32_t first, n, g;
+    unsigned long idx, end;
+    int ret;
+
+    if (goal == 0 || goal >= sb_info->block_count)
+        goal = READ_ONCE(sb_info->block_goal);
+    if (goal >= sb_info->block_count)
+        goal = 0;
+    first = goal / sb_info->blocks_per_group;
+
+    for (n = 0; n < sb_info->group_count; n++) {
+        struct osfs_group *group;
+
+        g = (first + n) % sb_info->group_count;
+        group = &sb_info->groups[g];
+        if (!READ_ONCE(group->nr_free_blocks))
+            continue;
+
+        spin_lock(&group->lock);
+        idx = osfs_find_zero_bit(sb_info, group->block_bitmap, group->nr_blocks,
+                                 n == 0 ? goal % sb_info->blocks_per_group : 0);
+        if (idx >= group->nr_blocks) {
+            spin_unlock(&group->lock);
+            continue;
+        }
+        max_blocks = clamp_t(uint32_t, max_blocks, 1, group->nr_blocks - idx);
+        end = find_next_bit(group->block_bitmap, idx + max_blocks, idx);
+        bitmap_set(group->block_bitmap, idx, end - idx);
+        group->nr_free_blocks -= end - idx;
+        spin_unlock(&group->lock);
+        atomic_sub(end - idx, &sb_info->nr_free_blocks);
+        osfs_dirty_group(sb_info, g);
+
+        *start = g * sb_info->blocks_per_group + idx;
+        *count = end - idx;
+        ret = osfs_group_data_pages(sb_info, group, idx, *count);
+        if (ret) {
+            osfs_free_blocks(sb_info, *start, *count);
+            return ret;
+        }
+        // 區塊只在同一個 Page 內連續，一次清一塊
+        for (end = 0; end < *count; end++)
+            memset(osfs_block_addr(sb_info, *start + end), 0, sb_info->block_size);
+        WRITE_ONCE(sb_info->block_goal, *start + *count);
+        osfs_stat_add(sb_info, OSFS_STAT_BLOCK_ALLOCS, 1);
+        osfs_stat_add(sb_info, OSFS_STAT_BLOCKS_ALLOCATED, *count);
+        trace_osfs_alloc_blocks(goal, max_blocks, *start, *count);
+        // 裝置上可能還是舊的內容，下次 commit 寫回 (記憶體中的內容才是對的)
+        osfs_dirty_block(sb_info, *start, *count, false);
+        return 0;
+    }
+
+    pr_err("osfs_alloc_blocks: No free data block available\n");
+    return -ENOSPC;
+}
+
 /**
  * 函式: osfs_alloc_data_block
- * 描述: 掃描 Bitmap 分配一個空閒的資料區塊。
+ * 描述: 分配一個資料區塊 (沒有偏好位置)。
  */
 int osfs_alloc_data_block(struct osfs_sb_info *sb_info, uint32_t *block_no)
 {
-    uint32_t i;
-
-    for (i = 0; i < sb_info->block_count; i++) {
-        if (!test_bit(i, sb_info->block_bitmap)) {
-            set_bit(i, sb_info->block_bitmap);
-            sb_info->nr_free_blocks--;
-            *block_no = i;
-            return 0;
+    uint32_t count;
+
+    return osfs_alloc_blocks(sb_info, 0, 1, block_no, &count);
+}
+
+/**
+ * 函式: osfs_inode_alloc_blocks
+ * 描述: 替檔案分配一段連續的資料區塊。goal 為 0 時使用 Inode 自己的提示
+ * (上次分配的下一塊)，讓同一個檔案的資料盡量連在一起。
+ */
+int osfs_inode_alloc_blocks(struct inode *inode, uint32_t goal, uint32_t max_blocks,
+                            uint32_t *start, uint32_t *count)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    int ret;
+
+    ret = osfs_alloc_blocks(inode->i_sb->s_fs_info, goal ? goal : osfs_inode->i_goal,
+                            max_blocks, start, count);
+    if (!ret)
+        osfs_inode->i_goal = *start + *count;
+    return ret;
+}
+
+/**
+ * 函式: osfs_free_blocks
+ * 描述: 釋放從 start 開始的 count 個資料區塊 (將 Bitmap 歸零)。
+ * Extent 可以延伸到下一個 Group，所以逐個 Group 處理。Page 留到卸載時才釋放。
+ * 有備份裝置時區塊先記在 pending_free，等 commit 把這個 Group 的 Bitmap
+ * 寫進 transaction 時才真正釋放 (見 journal.c)，在那之前不會被重新分配。
+ */
+void osfs_free_blocks(struct osfs_sb_info *sb_info, uint32_t start, uint32_t count)
+{
+    trace_osfs_free_blocks(start, count);
+    osfs_stat_add(sb_info, OSFS_STAT_BLOCKS_FREED, count);
+    while (count > 0) {
+        struct osfs_group *group = &sb_info->groups[start / sb_info->blocks_per_group];
+        uint32_t idx = start % sb_info->blocks_per_group;
+        uint32_t n = min(count, group->nr_blocks - idx);
+
+        spin_lock(&group->lock);
+        if (sb_info->bk) {
+            bitmap_set(group->pending_free, idx, n);
+        } else {
+            bitmap_clear(group->block_bitmap, idx, n);
+            group->nr_free_blocks += n;
         }
+        spin_unlock(&group->lock);
+        if (!sb_info->bk)
+            atomic_add(n, &sb_info->nr_free_blocks);
+        osfs_dirty_group(sb_info, start / sb_info->blocks_per_group);
+
+        start += n;
+        count -= n;
     }
-    pr_err("osfs_alloc_data_block: No free data block available\n");
-    return -ENOSPC;
 }
 
 /**
  * 函式: osfs_free_data_block
- * 描述: 釋放指定的資料區塊 (將 Bitmap 歸零)。
+ * 描述: 釋放指定的資料區塊。
  */
 void osfs_free_data_block(struct osfs_sb_info *sb_info, uint32_t block_no)
 {
-    clear_bit(block_no, sb_info->block_bitmap);
-    sb_info->nr_free_blocks++;
+    osfs_free_blocks(sb_info, block_no, 1);
 }
 
 // --- Bonus 核心函式 ---
@@ -128,15 +362,20 @@ int osfs_get_block(struct inode *inode, sector_t block, uint32_t *phys_block, in
     uint32_t *indirect_block;   // 指向一級間接表的指標
     uint32_t *dindirect_block;  // 指向二級間接表的指標
     uint32_t indirect_idx, dindirect_idx1, dindirect_idx2;
+    uint32_t count;
     int ret;
 
+    // Extent 模式的檔案改由 extent.c 處理
+    if (osfs_inode->i_flags & OSFS_EXTENTS_FL)
+        return osfs_ext_map(inode, block, 1, phys_block, &count, create);
+
     *phys_block = 0;
 
     // --- 1. 直接區塊範圍 (Direct blocks [0-11]) ---
     if (block < OSFS_N_DIRECT) {
         // 如果該位置是空的，且需要建立 (create=1)
         if (osfs_inode->i_block[block] == 0 && create) {
-            ret = osfs_alloc_data_block(sb_info, &osfs_inode->i_block[block]);
+            ret = osfs_inode_alloc_blocks(inode, 0, 1, &osfs_inode->i_block[block], &count);
             if (ret) {
                 pr_err("osfs_get_block: Failed to allocate direct block\n");
                 return ret;
@@ -153,37 +392,38 @@ int osfs_get_block(struct inode *inode, sector_t block, uint32_t *phys_block, in
     block -= OSFS_N_DIRECT;
 
     // --- 2. 一級間接區塊 (Indirect blocks [12]) ---
-    if (block < OSFS_ADDR_PER_BLOCK) {
+    if (block < OSFS_ADDR_PER_BLOCK(sb_info)) {
         // 2.1 檢查「索引表」是否存在，若無則分配
         if (osfs_inode->i_block[OSFS_N_DIRECT] == 0) {
             if (!create) return -ENOENT; // 讀取模式下若無索引表則回傳錯誤
             
             // 分配索引表 Block
-            ret = osfs_alloc_data_block(sb_info, &osfs_inode->i_block[OSFS_N_DIRECT]);
+            ret = osfs_inode_alloc_blocks(inode, 0, 1, &osfs_inode->i_block[OSFS_N_DIRECT], &count);
             if (ret) {
                 pr_err("osfs_get_block: Failed to allocate indirect block\n");
                 return ret;
             }
             // 清空新分配的索引表 (防止裡面有垃圾值)
-            indirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                         osfs_inode->i_block[OSFS_N_DIRECT] * BLOCK_SIZE);
-            memset(indirect_block, 0, BLOCK_SIZE);
+            indirect_block = (uint32_t *)osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT]);
+            memset(indirect_block, 0, sb_info->block_size);
+            osfs_dirty_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT], 1, true);
             osfs_inode->i_blocks++;
             mark_inode_dirty(inode);
         }
 
         // 取得索引表的記憶體位址
-        indirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                     osfs_inode->i_block[OSFS_N_DIRECT] * BLOCK_SIZE);
+        indirect_block = (uint32_t *)osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT]);
+        osfs_stat_add(sb_info, OSFS_STAT_INDEX_WALKS, 1);
         indirect_idx = block; // 在索引表中的 Index
 
         // 2.2 檢查索引表指向的「資料塊」是否存在，若無則分配
         if (indirect_block[indirect_idx] == 0 && create) {
-            ret = osfs_alloc_data_block(sb_info, &indirect_block[indirect_idx]);
+            ret = osfs_inode_alloc_blocks(inode, 0, 1, &indirect_block[indirect_idx], &count);
             if (ret) {
                 pr_err("osfs_get_block: Failed to allocate data block in indirect\n");
                 return ret;
             }
+            osfs_dirty_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT], 1, true);
             osfs_inode->i_blocks++;
             mark_inode_dirty(inode);
         }
@@ -192,61 +432,64 @@ int osfs_get_block(struct inode *inode, sector_t block, uint32_t *phys_block, in
     }
 
     // 扣除一級間接區塊能涵蓋的數量
-    block -= OSFS_ADDR_PER_BLOCK;
+    block -= OSFS_ADDR_PER_BLOCK(sb_info);
 
     // --- 3. 二級間接區塊 (Double indirect blocks [13]) ---
-    if (block < OSFS_ADDR_PER_BLOCK * OSFS_ADDR_PER_BLOCK) {
+    if (block < OSFS_ADDR_PER_BLOCK(sb_info) * OSFS_ADDR_PER_BLOCK(sb_info)) {
         // 3.1 檢查「第一層索引表」是否存在
         if (osfs_inode->i_block[OSFS_N_DIRECT + 1] == 0) {
             if (!create) return -ENOENT;
-            ret = osfs_alloc_data_block(sb_info, &osfs_inode->i_block[OSFS_N_DIRECT + 1]);
+            ret = osfs_inode_alloc_blocks(inode, 0, 1, &osfs_inode->i_block[OSFS_N_DIRECT + 1], &count);
             if (ret) {
                 pr_err("osfs_get_block: Failed to allocate double indirect block\n");
                 return ret;
             }
             // 清空第一層索引表
-            dindirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                          osfs_inode->i_block[OSFS_N_DIRECT + 1] * BLOCK_SIZE);
-            memset(dindirect_block, 0, BLOCK_SIZE);
+            dindirect_block = (uint32_t *)osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1]);
+            memset(dindirect_block, 0, sb_info->block_size);
+            osfs_dirty_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1], 1, true);
             osfs_inode->i_blocks++;
             mark_inode_dirty(inode);
         }
 
         // 取得第一層索引表位址
-        dindirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                      osfs_inode->i_block[OSFS_N_DIRECT + 1] * BLOCK_SIZE);
+        dindirect_block = (uint32_t *)osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1]);
+        osfs_stat_add(sb_info, OSFS_STAT_INDEX_WALKS, 1);
         
         // 計算兩層索引的 Index
-        dindirect_idx1 = block / OSFS_ADDR_PER_BLOCK; // 第一層 Index
-        dindirect_idx2 = block % OSFS_ADDR_PER_BLOCK; // 第二層 Index
+        dindirect_idx1 = block / OSFS_ADDR_PER_BLOCK(sb_info); // 第一層 Index
+        dindirect_idx2 = block % OSFS_ADDR_PER_BLOCK(sb_info); // 第二層 Index
 
         // 3.2 檢查「第二層索引表」是否存在
         if (dindirect_block[dindirect_idx1] == 0) {
             if (!create) return -ENOENT;
-            ret = osfs_alloc_data_block(sb_info, &dindirect_block[dindirect_idx1]);
+            ret = osfs_inode_alloc_blocks(inode, 0, 1, &dindirect_block[dindirect_idx1], &count);
             if (ret) {
                 pr_err("osfs_get_block: Failed to allocate indirect in double indirect\n");
                 return ret;
             }
             // 清空第二層索引表
-            indirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                         dindirect_block[dindirect_idx1] * BLOCK_SIZE);
-            memset(indirect_block, 0, BLOCK_SIZE);
+            indirect_block = (uint32_t *)osfs_block_addr(sb_info, dindirect_block[dindirect_idx1]);
+            memset(indirect_block, 0, sb_info->block_size);
+            // 新的第二層表與指向它的第一層表都要寫回
+            osfs_dirty_block(sb_info, dindirect_block[dindirect_idx1], 1, true);
+            osfs_dirty_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1], 1, true);
             osfs_inode->i_blocks++;
             mark_inode_dirty(inode);
         }
 
         // 取得第二層索引表位址
-        indirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                     dindirect_block[dindirect_idx1] * BLOCK_SIZE);
+        indirect_block = (uint32_t *)osfs_block_addr(sb_info, dindirect_block[dindirect_idx1]);
+        osfs_stat_add(sb_info, OSFS_STAT_INDEX_WALKS, 1);
 
         // 3.3 檢查「資料塊」是否存在
         if (indirect_block[dindirect_idx2] == 0 && create) {
-            ret = osfs_alloc_data_block(sb_info, &indirect_block[dindirect_idx2]);
+            ret = osfs_inode_alloc_blocks(inode, 0, 1, &indirect_block[dindirect_idx2], &count);
             if (ret) {
                 pr_err("osfs_get_block: Failed to allocate data block in double indirect\n");
                 return ret;
             }
+            osfs_dirty_block(sb_info, dindirect_block[dindirect_idx1], 1, true);
             osfs_inode->i_blocks++;
             mark_inode_dirty(inode);
         }
@@ -258,70 +501,291 @@ int osfs_get_block(struct inode *inode, sector_t block, uint32_t *phys_block, in
     return -EFBIG; // 檔案太大了 (File Too Big)
 }
 
+// 找出 block 所在的那張區塊表 (i_block[] 的直接區塊、一級間接表或二級的第二層表)，
+// idx 為 block 在表中的位置，limit 為表的大小，table_no 為表所在的區塊 (i_block[] 時為 0)；
+// 表還不存在時回傳 NULL
+static uint32_t *osfs_block_table(struct inode *inode, sector_t block, uint32_t *idx, uint32_t *limit,
+                                  uint32_t *table_no)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    uint32_t per_block = OSFS_ADDR_PER_BLOCK(sb_info);
+    uint32_t *table;
+
+    if (block < OSFS_N_DIRECT) {
+        *idx = block;
+        *limit = OSFS_N_DIRECT;
+        *table_no = 0;
+        return osfs_inode->i_block;
+    }
+    block -= OSFS_N_DIRECT;
+    *limit = per_block;
+
+    if (block < per_block) {
+        if (osfs_inode->i_block[OSFS_N_DIRECT] == 0)
+            return NULL;
+        *idx = block;
+        *table_no = osfs_inode->i_block[OSFS_N_DIRECT];
+        return osfs_block_addr(sb_info, *table_no);
+    }
+    block -= per_block;
+
+    if (block < per_block * per_block) {
+        if (osfs_inode->i_block[OSFS_N_DIRECT + 1] == 0)
+            return NULL;
+        table = osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1]);
+        if (table[block / per_block] == 0)
+            return NULL;
+        *idx = block % per_block;
+        *table_no = table[block / per_block];
+        return osfs_block_addr(sb_info, *table_no);
+    }
+    return NULL;
+}
+
+/**
+ * 函式: osfs_get_blocks
+ * 描述: 多層索引版本的 osfs_map_blocks。
+ * 第一塊走一次 osfs_get_block (需要時建立中間的索引表)，之後沿著同一張區塊表
+ * 往後看：實體區塊連續就併入同一段，「洞」則把連續的 0 併成一段。
+ * create = 1 時表中的「洞」以前一塊的下一塊為 goal 分配，通常仍然連續。
+ */
+static int osfs_get_blocks(struct inode *inode, sector_t block, uint32_t max_blocks,
+                           uint32_t *phys_block, uint32_t *count, int create)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    uint32_t *table, idx, limit, table_no, n, got, unused;
+    bool dirty = false;
+    int ret;
+
+    *count = 1;
+    ret = osfs_get_block(inode, block, phys_block, create);
+    if (ret == -ENOENT && !create) {
+        // 中間的索引表不存在：整段都是「洞」
+        *phys_block = 0;
+        return 0;
+    }
+    if (ret)
+        return ret;
+
+    table = osfs_block_table(inode, block, &idx, &limit, &table_no);
+    if (!table)
+        return 0;
+
+    for (n = 1; n < max_blocks && idx + n < limit; n++) {
+        got = table[idx + n];
+        if (*phys_block == 0) {
+            if (got != 0)
+                break;
+            continue;
+        }
+        if (got == 0 && create) {
+            if (osfs_inode_alloc_blocks(inode, *phys_block + n, 1, &got, &unused))
+                break;
+            table[idx + n] = got;
+            osfs_inode->i_blocks++;
+            dirty = true;
+        }
+        if (got != *phys_block + n)
+            break;
+    }
+    // 分配到的區塊不連續時它仍留在表中，只是不併入這一段
+    if (dirty) {
+        if (table_no)
+            osfs_dirty_block(inode->i_sb->s_fs_info, table_no, 1, true);
+        mark_inode_dirty(inode);
+    }
+    *count = n;
+    return 0;
+}
+
+/**
+ * 函式: osfs_map_blocks
+ * 描述: 一次映射一段連續的邏輯區塊。
+ * 輸出:
+ * - phys_block: 第一個區塊的實體區塊號碼 (0 代表「洞」)
+ * - count: 從 block 開始、實體上也連續的區塊數 (最多 max_blocks)
+ * Extent 檔案一次查詢就能拿到整段；多層索引的檔案沿著同一張區塊表合併。
+ * 一般檔案的資料都經過這裡，映射由 map_lock 保護。
+ */
+int osfs_map_blocks(struct inode *inode, sector_t block, uint32_t max_blocks,
+                    uint32_t *phys_block, uint32_t *count, int create)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct rw_semaphore *map_lock = &OSFS_I(inode)->map_lock;
+    int ret;
+
+    // 查詢可以同時進行；會分配區塊 (修改映射) 時獨佔，並讓 commit 等到修改完成
+    if (create) {
+        down_write(map_lock);
+        osfs_meta_begin(sb_info);
+    } else {
+        down_read(map_lock);
+    }
+
+    if (osfs_inode->i_flags & OSFS_EXTENTS_FL) {
+        ret = osfs_ext_map(inode, block, max_blocks, phys_block, count, create);
+    } else {
+        ret = osfs_get_blocks(inode, block, max_blocks, phys_block, count, create);
+    }
+    trace_osfs_map_blocks(inode, block, max_blocks, ret ? 0 : *phys_block, ret ? 0 : *count,
+                          create, ret);
+
+    if (create) {
+        osfs_meta_end(sb_info);
+        up_write(map_lock);
+    } else {
+        up_read(map_lock);
+    }
+    return ret;
+}
+
+// 釋放區塊表中 from 以後的區塊，回傳釋放的數量
+static uint32_t osfs_truncate_table(struct osfs_sb_info *sb_info, uint32_t *table, uint32_t from,
+                                    uint32_t limit)
+{
+    uint32_t freed = 0;
+
+    for (uint32_t i = from; i < limit; i++) {
+        if (table[i] != 0) {
+            osfs_free_data_block(sb_info, table[i]);
+            table[i] = 0;
+            freed++;
+        }
+    }
+    return freed;
+}
+
 /**
- * 函式: osfs_free_inode_blocks
- * 描述: 釋放一個 Inode 佔用的所有區塊 (包含直接、間接、雙重間接)。
- * 通常在刪除檔案時呼叫。
+ * 函式: osfs_truncate_blocks
+ * 描述: 釋放一個 Inode 從邏輯區塊 first 開始的所有區塊 (包含直接、間接、雙重間接)，
+ * first = 0 時全部釋放。整張落在 first 之後的索引表連同表本身一起釋放，
+ * 只截掉一部分的表標記為 dirty。呼叫者持有 map_lock 與 osfs_meta_begin。
  */
-void osfs_free_inode_blocks(struct inode *inode)
+void osfs_truncate_blocks(struct inode *inode, sector_t first)
 {
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
     struct osfs_inode *osfs_inode = inode->i_private;
-    uint32_t *indirect_block, *dindirect_block;
-    int i, j;
+    uint32_t per_block = OSFS_ADDR_PER_BLOCK(sb_info);
+    uint32_t *indirect_block, *dindirect_block, freed = 0, from, i;
+    sector_t rest;
 
     if (!osfs_inode)
         return;
 
-    // 1. 釋放直接區塊 (Direct Blocks)
-    for (i = 0; i < OSFS_N_DIRECT; i++) {
-        if (osfs_inode->i_block[i] != 0) {
-            osfs_free_data_block(sb_info, osfs_inode->i_block[i]);
-            osfs_inode->i_block[i] = 0;
-        }
+    if (osfs_inode->i_flags & OSFS_EXTENTS_FL) {
+        osfs_ext_truncate(inode, first);
+        return;
     }
 
-    // 2. 釋放一級間接區塊 (Indirect Blocks)
-    if (osfs_inode->i_block[OSFS_N_DIRECT] != 0) {
-        // 讀取索引表
-        indirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                     osfs_inode->i_block[OSFS_N_DIRECT] * BLOCK_SIZE);
-        // 遍歷索引表，釋放裡面指到的資料塊
-        for (i = 0; i < OSFS_ADDR_PER_BLOCK; i++) {
-            if (indirect_block[i] != 0) {
-                osfs_free_data_block(sb_info, indirect_block[i]);
-            }
+    // 1. 直接區塊 (Direct Blocks)
+    if (first < OSFS_N_DIRECT)
+        freed += osfs_truncate_table(sb_info, osfs_inode->i_block, first, OSFS_N_DIRECT);
+    rest = first > OSFS_N_DIRECT ? first - OSFS_N_DIRECT : 0;
+
+    // 2. 一級間接區塊 (Indirect Blocks)：從表頭開始截時連索引表一起釋放
+    if (osfs_inode->i_block[OSFS_N_DIRECT] != 0 && rest < per_block) {
+        indirect_block = (uint32_t *)osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT]);
+        freed += osfs_truncate_table(sb_info, indirect_block, rest, per_block);
+        if (rest == 0) {
+            osfs_free_data_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT]);
+            osfs_inode->i_block[OSFS_N_DIRECT] = 0;
+            freed++;
+        } else {
+            osfs_dirty_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT], 1, true);
         }
-        // 最後釋放索引表本身
-        osfs_free_data_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT]);
-        osfs_inode->i_block[OSFS_N_DIRECT] = 0;
     }
-
-    // 3. 釋放二級間接區塊 (Double Indirect Blocks)
-    if (osfs_inode->i_block[OSFS_N_DIRECT + 1] != 0) {
-        // 讀取第一層索引表
-        dindirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                      osfs_inode->i_block[OSFS_N_DIRECT + 1] * BLOCK_SIZE);
-        
-        for (i = 0; i < OSFS_ADDR_PER_BLOCK; i++) {
-            if (dindirect_block[i] != 0) {
-                // 讀取第二層索引表
-                indirect_block = (uint32_t *)(sb_info->data_blocks + 
-                                             dindirect_block[i] * BLOCK_SIZE);
-                // 釋放資料塊
-                for (j = 0; j < OSFS_ADDR_PER_BLOCK; j++) {
-                    if (indirect_block[j] != 0) {
-                        osfs_free_data_block(sb_info, indirect_block[j]);
-                    }
-                }
-                // 釋放第二層索引表本身
+    rest = rest > per_block ? rest - per_block : 0;
+
+    // 3. 二級間接區塊 (Double Indirect Blocks)：rest 所在的第二層表截掉後半，之後的整張釋放
+    if (osfs_inode->i_block[OSFS_N_DIRECT + 1] != 0 && rest < (sector_t)per_block * per_block) {
+        dindirect_block = (uint32_t *)osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1]);
+        for (i = rest / per_block; i < per_block; i++) {
+            if (dindirect_block[i] == 0)
+                continue;
+            from = i == rest / per_block ? rest % per_block : 0;
+            indirect_block = (uint32_t *)osfs_block_addr(sb_info, dindirect_block[i]);
+            freed += osfs_truncate_table(sb_info, indirect_block, from, per_block);
+            if (from == 0) {
                 osfs_free_data_block(sb_info, dindirect_block[i]);
+                dindirect_block[i] = 0;
+                freed++;
+            } else {
+                osfs_dirty_block(sb_info, dindirect_block[i], 1, true);
             }
         }
-        // 最後釋放第一層索引表本身
-        osfs_free_data_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1]);
-        osfs_inode->i_block[OSFS_N_DIRECT + 1] = 0;
+        if (rest == 0) {
+            osfs_free_data_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1]);
+            osfs_inode->i_block[OSFS_N_DIRECT + 1] = 0;
+            freed++;
+        } else {
+            osfs_dirty_block(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1], 1, true);
+        }
+    }
+
+    osfs_inode->i_blocks -= freed;
+    mark_inode_dirty(inode);
+}
+
+/**
+ * 函式: osfs_blocks_valid
+ * 描述: 從 start 開始的 count 個區塊都在 volume 之內並且已經分配
+ * (從備份裝置載入時只有已分配區塊所在的 Page 會被讀進來)。
+ */
+bool osfs_blocks_valid(struct osfs_sb_info *sb_info, uint32_t start, uint32_t count)
+{
+    if (start == 0 || start >= sb_info->block_count || count == 0 || count > sb_info->block_count - start)
+        return false;
+    while (count > 0) {
+        struct osfs_group *group = &sb_info->groups[start / sb_info->blocks_per_group];
+        uint32_t idx = start % sb_info->blocks_per_group;
+        uint32_t n = min(count, group->nr_blocks - idx);
+
+        if (find_next_zero_bit(group->block_bitmap, idx + n, idx) < idx + n)
+            return false;
+        start += n;
+        count -= n;
     }
+    return true;
+}
+
+// 區塊表中每個非 0 的項目都必須是有效的區塊
+static bool osfs_check_table(struct osfs_sb_info *sb_info, const uint32_t *table, uint32_t limit)
+{
+    for (uint32_t i = 0; i < limit; i++)
+        if (table[i] != 0 && !osfs_blocks_valid(sb_info, table[i], 1))
+            return false;
+    return true;
+}
 
-    osfs_inode->i_blocks = 0;
-}
\ No newline at end of file
+/**
+ * 函式: osfs_check_inode_blocks
+ * 描述: 檢查從備份裝置載入的 Inode 指到的所有區塊 (直接、間接、雙重間接或 extent 樹)，
+ * 在任何人跟著這些區塊號碼走之前擋下損壞或偽造的 volume。
+ * 回傳: 0，或 -EUCLEAN。
+ */
+int osfs_check_inode_blocks(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode)
+{
+    uint32_t per_block = OSFS_ADDR_PER_BLOCK(sb_info);
+    uint32_t *dindirect_block, i;
+
+    if (osfs_inode->i_flags & OSFS_EXTENTS_FL)
+        return osfs_ext_check(sb_info, osfs_inode);
+
+    if (!osfs_check_table(sb_info, osfs_inode->i_block, OSFS_N_BLOCKS))
+        return -EUCLEAN;
+    if (osfs_inode->i_block[OSFS_N_DIRECT] != 0 &&
+        !osfs_check_table(sb_info, osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT]), per_block))
+        return -EUCLEAN;
+    if (osfs_inode->i_block[OSFS_N_DIRECT + 1] != 0) {
+        dindirect_block = osfs_block_addr(sb_info, osfs_inode->i_block[OSFS_N_DIRECT + 1]);
+        if (!osfs_check_table(sb_info, dindirect_block, per_block))
+            return -EUCLEAN;
+        for (i = 0; i < per_block; i++)
+            if (dindirect_block[i] != 0 &&
+                !osfs_check_table(sb_info, osfs_block_addr(sb_info, dindirect_block[i]), per_block))
+                return -EUCLEAN;
+    }
+    return 0;
+}
@@ -0,0 +1,918 @@
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/uio.h>
+#include <linux/crc32.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/log2.h>
+#include <linux/writeback.h>
+#include "osfs.h"
+#include "osfs_trace.h"
+
+/*
+ * Optional backing store (mount -o backing=PATH, a regular file or a
+ * block device). The volume still runs from memory; this file keeps a
+ * copy of it on the device.
+ *
+ * Layout, in blocks of block_size:
+ *   0               struct osfs_disk_super
+ *   bitmap_start    per group: the block bitmap, then the inode bitmap
+ *   itable_start    per group: the inode table
+ *   s_journal_start s_journal_blocks blocks
+ *   s_data_start    data blocks 0..block_count-1
+ * Bitmaps and inode tables are stored in their in-memory format.
+ *
+ * Whatever is modified marks itself dirty (osfs_dirty_block and friends)
+ * and the first mark schedules a commit commit_interval later; sync_fs
+ * and fsync commit at once. A commit
+ *   0. writes the page cache back into the data blocks (osfs_commit),
+ *   1. writes dirty file data in place, adjacent blocks in one write,
+ *   2. copies dirty metadata (bitmaps, inode table blocks, directory,
+ *      index and extent tree blocks) into a transaction while
+ *      osfs_meta_begin() holds new metadata updates off, and writes the
+ *      file data dirtied since step 1 before letting them in again,
+ *   3. writes the transaction to the journal, then its commit record,
+ *   4. writes the metadata in place and advances s_sequence.
+ * Mount replays a transaction whose commit record is intact and whose id
+ * is still s_sequence, so the metadata on disk is always that of a
+ * finished commit. Data is ordered, not journaled: it reaches the device
+ * before the metadata that points to it. Blocks are zeroed when they are
+ * allocated, so a block whose data reaches it only after step 2 holds
+ * zeros on the device until the next commit, never old contents.
+ *
+ * Step 1 must not overwrite a block that the metadata on disk still
+ * gives to a file. So a freed block is only marked in pending_free and
+ * stays taken. The commit that stages its group's bitmap releases it
+ * (osfs_release_pending). Any new data in the block is then written by
+ * a later commit, after the transaction that freed it. The free counts
+ * (statfs) grow only at that point.
+ *
+ * A commit is one transaction, so the journal has to hold all the
+ * metadata it can find dirty. The bitmaps and inode tables of every group
+ * are always given room (osfs_backing_setup grows the journal of a new
+ * volume for that); what is left, meta_limit, bounds the dirty directory,
+ * index and extent blocks. Every update reserves OSFS_JOURNAL_OP_BLOCKS
+ * of it in osfs_meta_begin, and one that finds no room left commits first.
+ */
+
+#define OSFS_IO_BATCH 64    // Segments (at most a page each) per read or write
+
+/*
+ * Adjacent device blocks are gathered into one vfs_iter_write (or read);
+ * segments that are also adjacent in memory are merged.
+ */
+struct osfs_io_batch {
+    struct kvec vec[OSFS_IO_BATCH];
+    unsigned long nr;
+    uint64_t start;         // Device block of vec[0]
+    size_t len;
+    bool write;
+};
+
+static int osfs_bk_io(struct osfs_backing *bk, uint64_t dev_block, struct kvec *vec,
+                      unsigned long nr, size_t len, bool write)
+{
+    loff_t pos = dev_block << bk->block_size_bits;
+    struct iov_iter iter;
+    ssize_t ret;
+
+    if (write) {
+        iov_iter_kvec(&iter, ITER_SOURCE, vec, nr, len);
+        file_start_write(bk->file);
+        ret = vfs_iter_write(bk->file, &iter, &pos, 0);
+        file_end_write(bk->file);
+        if (ret >= 0 && (size_t)ret != len)
+            ret = -EIO;
+    } else {
+        // A short read is past the end of a sparse file: the buffer stays zero
+        iov_iter_kvec(&iter, ITER_DEST, vec, nr, len);
+        ret = vfs_iter_read(bk->file, &iter, &pos, 0);
+    }
+    return ret < 0 ? ret : 0;
+}
+
+static int osfs_batch_flush(struct osfs_backing *bk, struct osfs_io_batch *batch)
+{
+    int ret;
+
+    if (!batch->nr)
+        return 0;
+    ret = osfs_bk_io(bk, batch->start, batch->vec, batch->nr, batch->len, batch->write);
+    batch->nr = 0;
+    batch->len = 0;
+    return ret;
+}
+
+static int osfs_batch_add(struct osfs_backing *bk, struct osfs_io_batch *batch,
+                          uint64_t dev_block, void *addr, size_t len)
+{
+    struct kvec *last;
+    int ret;
+
+    if (batch->nr && dev_block != batch->start + (batch->len >> bk->block_size_bits)) {
+        ret = osfs_batch_flush(bk, batch);
+        if (ret)
+            return ret;
+    }
+    last = batch->nr ? &batch->vec[batch->nr - 1] : NULL;
+    if (last && last->iov_base + last->iov_len == addr) {
+        last->iov_len += len;
+    } else {
+        if (batch->nr == OSFS_IO_BATCH) {
+            ret = osfs_batch_flush(bk, batch);
+            if (ret)
+                return ret;
+        }
+        if (!batch->nr)
+            batch->start = dev_block;
+        batch->vec[batch->nr++] = (struct kvec){ .iov_base = addr, .iov_len = len };
+    }
+    batch->len += len;
+    return 0;
+}
+
+static int osfs_write_disk_super(struct osfs_backing *bk)
+{
+    struct kvec vec = { .iov_base = &bk->ds, .iov_len = sizeof(bk->ds) };
+
+    return osfs_bk_io(bk, 0, &vec, 1, sizeof(bk->ds), true);
+}
+
+static uint32_t *osfs_journal_tags(struct osfs_backing *bk)
+{
+    return (uint32_t *)((struct osfs_journal_header *)bk->jbuf + 1);
+}
+
+static void *osfs_journal_block(struct osfs_backing *bk, uint32_t n)
+{
+    return bk->jbuf + ((size_t)n << bk->block_size_bits);
+}
+
+// Logged block i (or the commit record after the last one) in jbuf
+static void *osfs_journal_slot(struct osfs_backing *bk, uint32_t i)
+{
+    return osfs_journal_block(bk, bk->desc_blocks + i);
+}
+
+// Blocks the descriptor of a transaction with n blocks takes on the device
+static uint32_t osfs_journal_desc_blocks(uint32_t block_size, uint32_t n)
+{
+    return DIV_ROUND_UP(sizeof(struct osfs_journal_header) + (size_t)n * sizeof(uint32_t), block_size);
+}
+
+/*
+ * Write the n blocks logged in jbuf to their place, then
+ * retire the transaction by advancing s_sequence. The next transaction
+ * flushes the device before its commit record, so the new s_sequence is
+ * durable before the journal can hold a record with that id.
+ */
+static int osfs_checkpoint(struct osfs_backing *bk, uint32_t n)
+{
+    struct osfs_io_batch batch = { .write = true };
+    uint32_t *tags = osfs_journal_tags(bk);
+    uint32_t i;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+        ret = osfs_batch_add(bk, &batch, tags[i], osfs_journal_slot(bk, i), bk->ds.s_block_size);
+        if (ret)
+            return ret;
+    }
+    ret = osfs_batch_flush(bk, &batch);
+    if (!ret)
+        ret = vfs_fsync(bk->file, 0);
+    if (ret)
+        return ret;
+
+    bk->ds.s_sequence++;
+    return osfs_write_disk_super(bk);
+}
+
+/*
+ * Log the n blocks staged in jbuf: descriptor and blocks, flush, commit
+ * record, flush. From then on a crash is repaired by the replay at mount.
+ * On the device the blocks follow the descriptor directly.
+ */
+static int osfs_journal_write(struct osfs_backing *bk, uint32_t n)
+{
+    struct osfs_journal_header *desc = bk->jbuf;
+    struct osfs_journal_header *commit = osfs_journal_slot(bk, n);
+    uint32_t block_size = bk->ds.s_block_size;
+    uint32_t d = osfs_journal_desc_blocks(block_size, n);
+    struct kvec vec[2];
+    int ret;
+
+    desc->h_magic = OSFS_JOURNAL_MAGIC;
+    desc->h_type = OSFS_JOURNAL_DESC;
+    desc->h_sequence = bk->ds.s_sequence;
+    desc->h_count = n;
+    desc->h_checksum = 0;
+
+    memset(commit, 0, block_size);
+    commit->h_magic = OSFS_JOURNAL_MAGIC;
+    commit->h_type = OSFS_JOURNAL_COMMIT;
+    commit->h_sequence = bk->ds.s_sequence;
+    commit->h_count = n;
+    commit->h_checksum = crc32_le(~0, osfs_journal_slot(bk, 0), (size_t)n * block_size);
+
+    vec[0] = (struct kvec){ .iov_base = bk->jbuf, .iov_len = (size_t)d * block_size };
+    vec[1] = (struct kvec){ .iov_base = osfs_journal_slot(bk, 0), .iov_len = (size_t)n * block_size };
+    ret = osfs_bk_io(bk, bk->ds.s_journal_start, vec, 2, (size_t)(d + n) * block_size, true);
+    if (!ret)
+        ret = vfs_fsync(bk->file, 0);
+    if (ret)
+        return ret;
+
+    vec[0] = (struct kvec){ .iov_base = commit, .iov_len = block_size };
+    ret = osfs_bk_io(bk, bk->ds.s_journal_start + d + n, vec, 1, block_size, true);
+    if (!ret)
+        ret = vfs_fsync(bk->file, 0);
+    if (ret)
+        return ret;
+
+    return osfs_checkpoint(bk, n);
+}
+
+// Copy len bytes of metadata into slot n of the transaction, padded with zeros
+static void osfs_journal_stage(struct osfs_backing *bk, uint32_t n, uint32_t dev_block,
+                               const void *src, size_t len)
+{
+    void *dst = osfs_journal_slot(bk, n);
+
+    memcpy(dst, src, len);
+    memset(dst + len, 0, bk->ds.s_block_size - len);
+    osfs_journal_tags(bk)[n] = dev_block;
+}
+
+// Blocks freed since the last staged bitmap become free in the one about to be staged
+static void osfs_release_pending(struct osfs_sb_info *sb_info, struct osfs_group *group)
+{
+    uint32_t n;
+
+    spin_lock(&group->lock);
+    n = bitmap_weight(group->pending_free, group->nr_blocks);
+    bitmap_andnot(group->block_bitmap, group->block_bitmap, group->pending_free, group->nr_blocks);
+    bitmap_zero(group->pending_free, group->nr_blocks);
+    group->nr_free_blocks += n;
+    spin_unlock(&group->lock);
+    atomic_add(n, &sb_info->nr_free_blocks);
+}
+
+// Write dirty file data in place; *written counts the blocks
+static int osfs_write_data(struct osfs_sb_info *sb_info, uint32_t *written)
+{
+    struct osfs_backing *bk = sb_info->bk;
+    struct osfs_io_batch batch = { .write = true };
+    uint32_t g;
+    unsigned long i;
+    int ret;
+
+    *written = 0;
+    for (g = 0; g < sb_info->group_count; g++) {
+        struct osfs_group *group = &sb_info->groups[g];
+        uint32_t first = g * sb_info->blocks_per_group;
+
+        if (!test_and_clear_bit(OSFS_GROUP_DATA_DIRTY, &group->dirty))
+            continue;
+        for_each_set_bit(i, group->dirty_data, group->nr_blocks) {
+            clear_bit(i, group->dirty_data);
+            ret = osfs_batch_add(bk, &batch, bk->ds.s_data_start + first + i,
+                                 osfs_block_addr(sb_info, first + i), sb_info->block_size);
+            if (ret)
+                return ret;
+            (*written)++;
+        }
+    }
+    return osfs_batch_flush(bk, &batch);
+}
+
+/*
+ * Stage dirty metadata, group by group. Metadata updates are held off
+ * meanwhile, so the copies are consistent. The reservations make all of
+ * it fit; should it not, the rest goes into a second transaction and the
+ * commit is not atomic. *staged is the number of staged blocks; *more
+ * is set when some are left.
+ *
+ * File data dirtied since osfs_write_data may sit in blocks that this
+ * transaction hands to a file (*late counts them). It is written before
+ * the lock lets new allocations in; later ones wait for the next commit.
+ * Returns:
+ *   - 0, or a negative error code from the device.
+ */
+static int osfs_journal_collect(struct osfs_sb_info *sb_info, uint32_t *staged, uint32_t *late,
+                                bool *more)
+{
+    struct osfs_backing *bk = sb_info->bk;
+    uint32_t block_size = sb_info->block_size, n = 0, meta = 0, g;
+    struct osfs_group *group;
+    unsigned long i;
+    int ret;
+
+    *more = false;
+    memset(bk->jbuf, 0, (size_t)bk->desc_blocks * block_size);
+    down_write(&bk->commit_lock);
+
+    for (g = 0; g < sb_info->group_count; g++) {
+        uint32_t first = g * sb_info->blocks_per_group;
+        uint32_t bitmap_dev = bk->bitmap_start + g * (1 + bk->ibitmap_blocks);
+
+        group = &sb_info->groups[g];
+        if (test_and_clear_bit(OSFS_GROUP_META_DIRTY, &group->dirty)) {
+            size_t table_size = (size_t)group->nr_inodes * sizeof(struct osfs_inode);
+
+            for_each_set_bit(i, group->dirty_meta, group->nr_blocks) {
+                if (n == bk->max_trans)
+                    goto full;
+                if (!test_and_clear_bit(i, group->dirty_meta))
+                    continue;
+                meta++;
+                osfs_journal_stage(bk, n++, bk->ds.s_data_start + first + i,
+                                   osfs_block_addr(sb_info, first + i), block_size);
+            }
+            for_each_set_bit(i, group->dirty_itable, bk->itable_blocks) {
+                size_t off = i << bk->block_size_bits;
+
+                if (n == bk->max_trans)
+                    goto full;
+                clear_bit(i, group->dirty_itable);
+                osfs_journal_stage(bk, n++, bk->itable_start + g * bk->itable_blocks + i,
+                                   (void *)group->inode_table + off, min_t(size_t, block_size, table_size - off));
+            }
+        }
+
+        if (test_and_clear_bit(OSFS_GROUP_BITMAPS_DIRTY, &group->dirty)) {
+            size_t ibitmap_size = BITS_TO_LONGS(group->nr_inodes) * sizeof(unsigned long);
+
+            if (n + 1 + bk->ibitmap_blocks > bk->max_trans) {
+                set_bit(OSFS_GROUP_BITMAPS_DIRTY, &group->dirty);
+                goto full;
+            }
+            osfs_release_pending(sb_info, group);
+            osfs_journal_stage(bk, n++, bitmap_dev, group->block_bitmap,
+                               BITS_TO_LONGS(group->nr_blocks) * sizeof(unsigned long));
+            for (i = 0; i < bk->ibitmap_blocks; i++) {
+                size_t off = i << bk->block_size_bits;
+
+                osfs_journal_stage(bk, n++, bitmap_dev + 1 + i, (void *)group->inode_bitmap + off,
+                                   off < ibitmap_size ? min_t(size_t, block_size, ibitmap_size - off) : 0);
+            }
+        }
+    }
+    goto out;
+
+full:
+    WARN_ON_ONCE(1);
+    set_bit(OSFS_GROUP_META_DIRTY, &group->dirty);
+    *more = true;
+out:
+    atomic_sub(meta, &bk->nr_dirty_meta);
+    *staged = n;
+    ret = osfs_write_data(sb_info, late);
+    up_write(&bk->commit_lock);
+    return ret;
+}
+
+/*
+ * Write dirty file data and log the dirty metadata, one commit at a time.
+ * Concurrent callers are serialized; the later ones usually find little
+ * or nothing left to do.
+ */
+static int osfs_commit_journal(struct osfs_sb_info *sb_info)
+{
+    struct osfs_backing *bk = sb_info->bk;
+    uint32_t written, late, n = 0, journaled = 0;
+    bool more = true, logged = false;
+    int ret;
+
+    mutex_lock(&bk->commit_mutex);
+    ret = osfs_write_data(sb_info, &written);
+    while (!ret && more) {
+        ret = osfs_journal_collect(sb_info, &n, &late, &more);
+        written += late;
+        if (ret || n == 0)
+            break;
+        ret = osfs_journal_write(bk, n);
+        journaled += n;
+        logged = true;
+    }
+    // Without a transaction the data still has to be flushed
+    if (!ret && !logged && written)
+        ret = vfs_fsync(bk->file, 0);
+    mutex_unlock(&bk->commit_mutex);
+
+    osfs_stat_add(sb_info, OSFS_STAT_COMMITS, 1);
+    osfs_stat_add(sb_info, OSFS_STAT_COMMIT_DATA_BLOCKS, written);
+    osfs_stat_add(sb_info, OSFS_STAT_COMMIT_JOURNAL_BLOCKS, journaled);
+    trace_osfs_commit(bk->path, written, journaled, ret);
+
+    if (ret)
+        pr_err("osfs_commit: Writing to %s failed (%d)\n", bk->path, ret);
+    return ret;
+}
+
+/**
+ * Function: osfs_commit
+ * Description: Writes everything dirty to the backing store and waits
+ * for it (sync_fs, fsync, the periodic commit). The page cache is written
+ * back into the data blocks first, so the data a commit logs metadata for
+ * reaches the device before that metadata. Mount, remount and unmount
+ * hold s_umount and have written the page cache back themselves.
+ * Returns:
+ *   - 0, or a negative error code from the device.
+ */
+int osfs_commit(struct osfs_sb_info *sb_info)
+{
+    struct osfs_backing *bk = sb_info->bk;
+
+    if (!bk)
+        return 0;
+    if (down_read_trylock(&bk->sb->s_umount)) {
+        sync_inodes_sb(bk->sb);
+        up_read(&bk->sb->s_umount);
+    }
+    return osfs_commit_journal(sb_info);
+}
+
+static void osfs_commit_worker(struct work_struct *work)
+{
+    struct osfs_backing *bk = container_of(to_delayed_work(work), struct osfs_backing, commit_work);
+
+    osfs_commit(bk->sb_info);
+}
+
+// The first change after a commit schedules the next one
+static void osfs_commit_kick(struct osfs_backing *bk)
+{
+    if (bk->commit_interval && !delayed_work_pending(&bk->commit_work))
+        queue_delayed_work(system_unbound_wq, &bk->commit_work, bk->commit_interval);
+}
+
+/**
+ * Function: osfs_commit_async
+ * Description: Starts a commit now without waiting for it.
+ */
+void osfs_commit_async(struct osfs_sb_info *sb_info)
+{
+    if (sb_info->bk)
+        mod_delayed_work(system_unbound_wq, &sb_info->bk->commit_work, 0);
+}
+
+/**
+ * Function: osfs_journal_reserve
+ * Description: Reserves room in the next transaction for one metadata
+ * update (osfs_meta_begin). Without room, the dirty metadata is committed
+ * first. Called with no commit_lock held.
+ */
+void osfs_journal_reserve(struct osfs_sb_info *sb_info)
+{
+    struct osfs_backing *bk = sb_info->bk;
+
+    while (atomic_add_return(OSFS_JOURNAL_OP_BLOCKS, &bk->meta_reserved) +
+           atomic_read(&bk->nr_dirty_meta) > bk->meta_limit) {
+        atomic_sub(OSFS_JOURNAL_OP_BLOCKS, &bk->meta_reserved);
+        // The commit failed and left the blocks dirty: go ahead rather than loop
+        if (osfs_commit_journal(sb_info)) {
+            atomic_add(OSFS_JOURNAL_OP_BLOCKS, &bk->meta_reserved);
+            return;
+        }
+    }
+}
+
+/**
+ * Function: osfs_dirty_block
+ * Description: Marks count data blocks from block_no for the next
+ * commit. meta: the blocks hold directory records, block indexes or
+ * extents and go through the journal (counted in nr_dirty_meta); file
+ * data is written in place.
+ */
+void osfs_dirty_block(struct osfs_sb_info *sb_info, uint32_t block_no, uint32_t count, bool meta)
+{
+    struct osfs_backing *bk = sb_info->bk;
+
+    if (!bk)
+        return;
+    while (count > 0) {
+        struct osfs_group *group = &sb_info->groups[block_no / sb_info->blocks_per_group];
+        uint32_t idx = block_no % sb_info->blocks_per_group;
+        uint32_t n = min(count, group->nr_blocks - idx), i;
+
+        for (i = 0; i < n; i++) {
+            if (!meta)
+                set_bit(idx + i, group->dirty_data);
+            else if (!test_and_set_bit(idx + i, group->dirty_meta))
+                atomic_inc(&bk->nr_dirty_meta);
+        }
+        // The block bits are visible before the group bit a commit clears first
+        smp_mb__before_atomic();
+        set_bit(meta ? OSFS_GROUP_META_DIRTY : OSFS_GROUP_DATA_DIRTY, &group->dirty);
+        block_no += n;
+        count -= n;
+    }
+    osfs_commit_kick(bk);
+}
+
+/**
+ * Function: osfs_dirty_inode_table
+ * Description: Marks the inode table block(s) holding inode ino.
+ */
+void osfs_dirty_inode_table(struct osfs_sb_info *sb_info, uint32_t ino)
+{
+    struct osfs_backing *bk = sb_info->bk;
+    struct osfs_group *group;
+    size_t off;
+
+    if (!bk)
+        return;
+    group = &sb_info->groups[ino / sb_info->inodes_per_group];
+    off = (size_t)(ino % sb_info->inodes_per_group) * sizeof(struct osfs_inode);
+    set_bit(off >> bk->block_size_bits, group->dirty_itable);
+    set_bit((off + sizeof(struct osfs_inode) - 1) >> bk->block_size_bits, group->dirty_itable);
+    smp_mb__before_atomic();
+    set_bit(OSFS_GROUP_META_DIRTY, &group->dirty);
+    osfs_commit_kick(bk);
+}
+
+/**
+ * Function: osfs_dirty_group
+ * Description: Marks the block and inode bitmaps of a group.
+ */
+void osfs_dirty_group(struct osfs_sb_info *sb_info, uint32_t group_no)
+{
+    if (!sb_info->bk)
+        return;
+    set_bit(OSFS_GROUP_BITMAPS_DIRTY, &sb_info->groups[group_no].dirty);
+    osfs_commit_kick(sb_info->bk);
+}
+
+/*
+ * Replay the journal if it holds a complete transaction that was not
+ * checkpointed yet (the id is still s_sequence and the checksum matches).
+ */
+static int osfs_journal_replay(struct osfs_backing *bk)
+{
+    struct osfs_journal_header *desc = bk->jbuf, *commit;
+    uint32_t block_size = bk->ds.s_block_size, n, d;
+    struct kvec vec = { .iov_base = bk->jbuf, .iov_len = block_size };
+    int ret;
+
+    memset(bk->jbuf, 0, (size_t)bk->ds.s_journal_blocks * block_size);
+    ret = osfs_bk_io(bk, bk->ds.s_journal_start, &vec, 1, block_size, false);
+    if (ret)
+        return ret;
+    if (desc->h_magic != OSFS_JOURNAL_MAGIC || desc->h_type != OSFS_JOURNAL_DESC ||
+        desc->h_sequence != bk->ds.s_sequence || desc->h_count == 0 || desc->h_count > bk->max_trans)
+        return 0;
+
+    // The rest of the descriptor, then the blocks and the commit record into their slots
+    n = desc->h_count;
+    d = osfs_journal_desc_blocks(block_size, n);
+    if (d > 1) {
+        vec = (struct kvec){ .iov_base = osfs_journal_block(bk, 1), .iov_len = (size_t)(d - 1) * block_size };
+        ret = osfs_bk_io(bk, bk->ds.s_journal_start + 1, &vec, 1, vec.iov_len, false);
+        if (ret)
+            return ret;
+    }
+    vec = (struct kvec){ .iov_base = osfs_journal_slot(bk, 0), .iov_len = (size_t)(n + 1) * block_size };
+    ret = osfs_bk_io(bk, bk->ds.s_journal_start + d, &vec, 1, vec.iov_len, false);
+    if (ret)
+        return ret;
+
+    commit = osfs_journal_slot(bk, n);
+    if (commit->h_magic != OSFS_JOURNAL_MAGIC || commit->h_type != OSFS_JOURNAL_COMMIT ||
+        commit->h_sequence != desc->h_sequence || commit->h_count != n ||
+        commit->h_checksum != crc32_le(~0, osfs_journal_slot(bk, 0), (size_t)n * block_size)) {
+        pr_info("osfs: Discarding incomplete transaction %llu in %s\n",
+                (unsigned long long)desc->h_sequence, bk->path);
+        return 0;
+    }
+
+    ret = osfs_checkpoint(bk, n);
+    if (!ret)
+        pr_info("osfs: Replayed transaction %llu (%u blocks) in %s\n",
+                (unsigned long long)desc->h_sequence, n, bk->path);
+    return ret;
+}
+
+// Read the data pages of a group that hold at least one allocated block
+static int osfs_load_group_data(struct osfs_sb_info *sb_info, uint32_t g)
+{
+    struct osfs_backing *bk = sb_info->bk;
+    struct osfs_group *group = &sb_info->groups[g];
+    struct osfs_io_batch batch = { .write = false };
+    uint32_t p, first, end;
+    int ret = 0;
+
+    for (p = 0, first = 0; first < group->nr_blocks; p++, first += sb_info->blocks_per_page) {
+        void **table;
+        void *page;
+
+        end = min(first + sb_info->blocks_per_page, group->nr_blocks);
+        if (find_next_bit(group->block_bitmap, end, first) >= end)
+            continue;
+        table = osfs_group_page_table(sb_info, group);
+        page = (void *)get_zeroed_page(GFP_KERNEL_ACCOUNT);
+        if (!table || !page) {
+            free_page((unsigned long)page);
+            return -ENOMEM;
+        }
+        table[p] = page;
+        ret = osfs_batch_add(bk, &batch, bk->ds.s_data_start + g * sb_info->blocks_per_group + first,
+                             page, (size_t)(end - first) << bk->block_size_bits);
+        if (ret)
+            return ret;
+    }
+    return osfs_batch_flush(bk, &batch);
+}
+
+/*
+ * Nothing read back is trusted: block 0 and the root directory have to
+ * be taken, and every block an inode in use points to has to be inside the
+ * volume and allocated (so its page was read), before anything follows
+ * those block numbers.
+ */
+static int osfs_backing_check(struct osfs_sb_info *sb_info)
+{
+    struct osfs_group *group0 = &sb_info->groups[0];
+    uint32_t g, ino;
+    unsigned long i;
+
+    if (!test_bit(0, group0->block_bitmap) || !test_bit(ROOT_INODE, group0->inode_bitmap) ||
+        !S_ISDIR(group0->inode_table[ROOT_INODE].i_mode)) {
+        pr_err("osfs_backing_load: Bitmaps or root inode of %s are corrupted\n", sb_info->bk->path);
+        return -EUCLEAN;
+    }
+    for (g = 0; g < sb_info->group_count; g++) {
+        struct osfs_group *group = &sb_info->groups[g];
+
+        for_each_set_bit(i, group->inode_bitmap, group->nr_inodes) {
+            ino = g * sb_info->inodes_per_group + i;
+            if (ino == 0 || ino >= sb_info->inode_count)
+                continue;
+            if (osfs_check_inode_blocks(sb_info, &group->inode_table[i])) {
+                pr_err("osfs_backing_load: Block map of inode %u in %s is corrupted\n",
+                       ino, sb_info->bk->path);
+                return -EUCLEAN;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Mount of an existing volume: replay the journal, then read the
+ * bitmaps, the inode tables of groups with inodes in use and the pages
+ * with allocated blocks, and check the block maps. Free space is never
+ * read.
+ */
+static int osfs_backing_load(struct osfs_sb_info *sb_info)
+{
+    struct osfs_backing *bk = sb_info->bk;
+    uint32_t g, free_blocks = 0, free_inodes = 0;
+    struct kvec vec;
+    int ret;
+
+    ret = osfs_journal_replay(bk);
+    if (ret)
+        return ret;
+
+    for (g = 0; g < sb_info->group_count; g++) {
+        struct osfs_group *group = &sb_info->groups[g];
+        uint32_t bitmap_dev = bk->bitmap_start + g * (1 + bk->ibitmap_blocks);
+
+        vec = (struct kvec){ .iov_base = group->block_bitmap,
+                             .iov_len = BITS_TO_LONGS(group->nr_blocks) * sizeof(unsigned long) };
+        ret = osfs_bk_io(bk, bitmap_dev, &vec, 1, vec.iov_len, false);
+        if (ret)
+            return ret;
+        group->nr_free_blocks = group->nr_blocks - bitmap_weight(group->block_bitmap, group->nr_blocks);
+
+        if (group->nr_inodes) {
+            vec = (struct kvec){ .iov_base = group->inode_bitmap,
+                                 .iov_len = BITS_TO_LONGS(group->nr_inodes) * sizeof(unsigned long) };
+            ret = osfs_bk_io(bk, bitmap_dev + 1, &vec, 1, vec.iov_len, false);
+            if (ret)
+                return ret;
+        }
+        group->nr_free_inodes = group->nr_inodes - bitmap_weight(group->inode_bitmap, group->nr_inodes);
+
+        if (group->nr_free_inodes < group->nr_inodes) {
+            group->inode_table = kvcalloc(group->nr_inodes, sizeof(struct osfs_inode), GFP_KERNEL_ACCOUNT);
+            if (!group->inode_table)
+                return -ENOMEM;
+            vec = (struct kvec){ .iov_base = group->inode_table,
+                                 .iov_len = (size_t)group->nr_inodes * sizeof(struct osfs_inode) };
+            ret = osfs_bk_io(bk, bk->itable_start + g * bk->itable_blocks, &vec, 1, vec.iov_len, false);
+            if (ret)
+                return ret;
+        }
+
+        ret = osfs_load_group_data(sb_info, g);
+        if (ret)
+            return ret;
+        free_blocks += group->nr_free_blocks;
+        free_inodes += group->nr_free_inodes;
+    }
+    ret = osfs_backing_check(sb_info);
+    if (ret)
+        return ret;
+
+    atomic_set(&sb_info->nr_free_blocks, free_blocks);
+    atomic_set(&sb_info->nr_free_inodes, free_inodes);
+    pr_info("osfs: Loaded %s (%u of %u blocks, %u of %u inodes in use)\n", bk->path,
+            sb_info->block_count - free_blocks, sb_info->block_count,
+            sb_info->inode_count - free_inodes, sb_info->inode_count);
+    return 0;
+}
+
+/**
+ * Function: osfs_backing_open
+ * Description: Opens the backing store and reads its superblock. When it
+ * holds an osfs volume (bk->loaded) the mount takes the geometry from it.
+ * Inputs:
+ *   - journal_blocks: journal size for a new volume
+ *   - commit_interval: seconds from the first change to its commit
+ * Returns:
+ *   - 0, or a negative error code.
+ */
+int osfs_backing_open(const char *path, uint32_t journal_blocks, unsigned int commit_interval,
+                      struct osfs_backing **bkp)
+{
+    struct osfs_disk_super *ds;
+    struct osfs_backing *bk;
+    struct kvec vec;
+    umode_t mode;
+    int ret;
+
+    bk = kzalloc(sizeof(*bk), GFP_KERNEL);
+    if (!bk)
+        return -ENOMEM;
+    init_rwsem(&bk->commit_lock);
+    mutex_init(&bk->commit_mutex);
+    INIT_DELAYED_WORK(&bk->commit_work, osfs_commit_worker);
+    bk->commit_interval = (unsigned long)commit_interval * HZ;
+
+    bk->path = kstrdup(path, GFP_KERNEL);
+    if (!bk->path) {
+        ret = -ENOMEM;
+        goto out_free;
+    }
+    bk->file = filp_open(path, O_RDWR | O_LARGEFILE, 0);
+    if (IS_ERR(bk->file)) {
+        ret = PTR_ERR(bk->file);
+        bk->file = NULL;
+        pr_err("osfs_backing_open: Cannot open %s (%d)\n", path, ret);
+        goto out_free;
+    }
+    mode = file_inode(bk->file)->i_mode;
+    if (!S_ISREG(mode) && !S_ISBLK(mode)) {
+        pr_err("osfs_backing_open: %s is not a regular file or a block device\n", path);
+        ret = -EINVAL;
+        goto out_free;
+    }
+
+    ds = &bk->ds;
+    vec = (struct kvec){ .iov_base = ds, .iov_len = sizeof(*ds) };
+    ret = osfs_bk_io(bk, 0, &vec, 1, sizeof(*ds), false);
+    if (ret)
+        goto out_free;
+
+    if (ds->s_magic == OSFS_DISK_MAGIC) {
+        if (ds->s_block_size < OSFS_MIN_BLOCK_SIZE || !is_power_of_2(ds->s_block_size) ||
+            ds->s_block_size > min_t(unsigned long, PAGE_SIZE, OSFS_MAX_BLOCK_SIZE) ||
+            ds->s_inode_count < ROOT_INODE + 1 || ds->s_inode_count > OSFS_MAX_INODES ||
+            ds->s_block_count < 1 || ds->s_block_count > OSFS_MAX_BLOCKS ||
+            ds->s_inode_size != sizeof(struct osfs_inode) ||
+            ds->s_journal_blocks < OSFS_MIN_JOURNAL_BLOCKS || ds->s_journal_blocks > OSFS_MAX_JOURNAL_BLOCKS) {
+            pr_err("osfs_backing_open: %s holds an incompatible osfs volume\n", path);
+            ret = -EINVAL;
+            goto out_free;
+        }
+        bk->loaded = true;
+    } else {
+        memset(ds, 0, sizeof(*ds));
+        ds->s_journal_blocks = journal_blocks;
+    }
+
+    *bkp = bk;
+    return 0;
+
+out_free:
+    osfs_backing_close(bk);
+    return ret;
+}
+
+/**
+ * Function: osfs_backing_setup
+ * Description: Lays the volume out on the backing store once the groups
+ * exist. An existing volume is loaded; a new one gets its superblock and
+ * an empty journal, and its bitmaps are written by the first commit.
+ * Returns:
+ *   - 0, or a negative error code.
+ */
+int osfs_backing_setup(struct osfs_sb_info *sb_info)
+{
+    struct osfs_backing *bk = sb_info->bk;
+    struct osfs_disk_super *ds = &bk->ds;
+    struct inode *dev_inode = file_inode(bk->file);
+    uint32_t block_size = sb_info->block_size, journal_start, data_start, g;
+    uint32_t fixed = 0, need;
+    struct kvec vec;
+    int ret;
+
+    bk->sb_info = sb_info;
+    bk->block_size_bits = sb_info->block_size_bits;
+    bk->ibitmap_blocks = DIV_ROUND_UP(sb_info->inodes_per_group, block_size * 8);
+    bk->bitmap_start = 1;
+    bk->itable_start = bk->bitmap_start + sb_info->group_count * (1 + bk->ibitmap_blocks);
+    bk->itable_blocks = DIV_ROUND_UP((size_t)sb_info->inodes_per_group * sizeof(struct osfs_inode), block_size);
+    journal_start = bk->itable_start + sb_info->group_count * bk->itable_blocks;
+
+    // One transaction may log every bitmap and inode table block, and room for the reservations
+    for (g = 0; g < sb_info->group_count; g++)
+        fixed += 1 + bk->ibitmap_blocks +
+                 DIV_ROUND_UP((size_t)sb_info->groups[g].nr_inodes * sizeof(struct osfs_inode), block_size);
+    need = fixed + 2 * OSFS_JOURNAL_OP_BLOCKS;
+    need += osfs_journal_desc_blocks(block_size, need) + 1;
+    if (ds->s_journal_blocks < need) {
+        if (bk->loaded || need > OSFS_MAX_JOURNAL_BLOCKS) {
+            pr_err("osfs_backing_setup: The journal of %s needs %u blocks for this volume\n", bk->path, need);
+            return -EINVAL;
+        }
+        pr_info("osfs: Journal of %s grown to %u blocks\n", bk->path, need);
+        ds->s_journal_blocks = need;
+    }
+    data_start = journal_start + ds->s_journal_blocks;
+    bk->max_trans = ((size_t)(ds->s_journal_blocks - 1) * block_size - sizeof(struct osfs_journal_header)) /
+                    (block_size + sizeof(uint32_t));
+    bk->desc_blocks = osfs_journal_desc_blocks(block_size, bk->max_trans);
+    bk->meta_limit = bk->max_trans - fixed;
+
+    if (bk->loaded) {
+        if (ds->s_journal_start != journal_start || ds->s_data_start != data_start) {
+            pr_err("osfs_backing_setup: Layout of %s does not match its geometry\n", bk->path);
+            return -EINVAL;
+        }
+    } else {
+        ds->s_magic = OSFS_DISK_MAGIC;
+        ds->s_block_size = block_size;
+        ds->s_inode_count = sb_info->inode_count;
+        ds->s_block_count = sb_info->block_count;
+        ds->s_inode_size = sizeof(struct osfs_inode);
+        ds->s_journal_start = journal_start;
+        ds->s_data_start = data_start;
+        ds->s_sequence = 1;
+    }
+
+    if (S_ISBLK(dev_inode->i_mode) &&
+        i_size_read(dev_inode) < ((loff_t)data_start + sb_info->block_count) << bk->block_size_bits) {
+        pr_err("osfs_backing_setup: %s is too small for the volume\n", bk->path);
+        return -ENOSPC;
+    }
+
+    bk->jbuf = kvmalloc((size_t)ds->s_journal_blocks * block_size, GFP_KERNEL_ACCOUNT);
+    if (!bk->jbuf)
+        return -ENOMEM;
+    for (g = 0; g < sb_info->group_count; g++) {
+        struct osfs_group *group = &sb_info->groups[g];
+
+        group->dirty_data = kvcalloc(BITS_TO_LONGS(group->nr_blocks), sizeof(unsigned long), GFP_KERNEL_ACCOUNT);
+        group->dirty_meta = kvcalloc(BITS_TO_LONGS(group->nr_blocks), sizeof(unsigned long), GFP_KERNEL_ACCOUNT);
+        group->dirty_itable = kvcalloc(BITS_TO_LONGS(bk->itable_blocks), sizeof(unsigned long), GFP_KERNEL_ACCOUNT);
+        group->pending_free = kvcalloc(BITS_TO_LONGS(group->nr_blocks), sizeof(unsigned long), GFP_KERNEL_ACCOUNT);
+        if (!group->dirty_data || !group->dirty_meta || !group->dirty_itable || !group->pending_free)
+            return -ENOMEM;
+    }
+
+    if (bk->loaded)
+        return osfs_backing_load(sb_info);
+
+    // A new volume: superblock, an empty journal, and bitmaps from the first commit
+    ret = osfs_write_disk_super(bk);
+    if (ret)
+        return ret;
+    memset(bk->jbuf, 0, block_size);
+    vec = (struct kvec){ .iov_base = bk->jbuf, .iov_len = block_size };
+    ret = osfs_bk_io(bk, journal_start, &vec, 1, block_size, true);
+    if (ret)
+        return ret;
+    for (g = 0; g < sb_info->group_count; g++)
+        set_bit(OSFS_GROUP_BITMAPS_DIRTY, &sb_info->groups[g].dirty);
+    pr_info("osfs: Formatted %s (journal %u blocks, data from block %u)\n",
+            bk->path, ds->s_journal_blocks, data_start);
+    return 0;
+}
+
+/**
+ * Function: osfs_backing_close
+ * Description: Stops the periodic commit and closes the backing store.
+ * The caller commits first if the volume is to be kept.
+ */
+void osfs_backing_close(struct osfs_backing *bk)
+{
+    cancel_delayed_work_sync(&bk->commit_work);
+    if (bk->file)
+        filp_close(bk->file, NULL);
+    kvfree(bk->jbuf);
+    kfree(bk->path);
+    kfree(bk);
+}
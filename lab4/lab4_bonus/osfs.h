@@ -9,13 +9,29 @@
 #include <linux/vmalloc.h>
 #include <linux/string.h>
 #include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/list_bl.h>
+#include <linux/rwsem.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/percpu.h>
+#include <linux/kobject.h>
+#include <linux/completion.h>
 
 #define OSFS_MAGIC 0x051AB520
 //#define BLOCK_SIZE 4096
+// Default volume size; mount -o inodes=N,blocks=N,block_size=N overrides it
 #define INODE_COUNT 20
 #define DATA_BLOCK_COUNT 20
+#define OSFS_MAX_INODES (1U << 24)
+#define OSFS_MAX_BLOCKS (1U << 30)
+// Without CAP_SYS_ADMIN (a user namespace mount) the bitmaps set up front stay small
+#define OSFS_MAX_USER_INODES (1U << 16)
+#define OSFS_MAX_USER_BLOCKS (1U << 20)
+#define OSFS_MIN_BLOCK_SIZE 1024  // block_size is a power of two up to PAGE_SIZE
+#define OSFS_MAX_BLOCK_SIZE 32768 // and fits the 16-bit rec_len of directory records
 #define MAX_FILENAME_LEN 255
-#define MAX_DIR_ENTRIES (BLOCK_SIZE / sizeof(struct osfs_dir_entry))
+#define OSFS_DIR_REC_LEN(name_len) ALIGN(sizeof(struct osfs_dir_entry) + (name_len), 4)
 
 // Multi-level indexing constants
 #define OSFS_N_DIRECT 12      // Number of direct blocks
@@ -24,15 +40,145 @@
 #define OSFS_N_BLOCKS (OSFS_N_DIRECT + OSFS_N_INDIRECT + OSFS_N_DINDIRECT)
 
 // Number of block pointers per indirect block
-#define OSFS_ADDR_PER_BLOCK (BLOCK_SIZE / sizeof(uint32_t))
+#define OSFS_ADDR_PER_BLOCK(sbi) ((sbi)->block_size / sizeof(uint32_t))
 
-#define BITMAP_SIZE(bits) (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
-
-#define INODE_BITMAP_SIZE BITMAP_SIZE(INODE_COUNT)
-#define BLOCK_BITMAP_SIZE BITMAP_SIZE(DATA_BLOCK_COUNT)
+// Extent mapping (regular files with OSFS_EXTENTS_FL)
+#define OSFS_EXTENTS_FL 0x1
+#define OSFS_EXT_MAGIC 0xF30A
+#define OSFS_EXT_MAX_DEPTH 4  // index levels above the leaves
+#define OSFS_DEFAULT_EXTENTS 1  // new regular files use extents
 
 #define ROOT_INODE 1
 
+// Backing store (mount -o backing=PATH, journal.c)
+#define OSFS_DISK_MAGIC 0x051AB5D0
+#define OSFS_JOURNAL_MAGIC 0x051AB5DB
+#define OSFS_JOURNAL_DESC 1          // Descriptor: the device block of every logged block
+#define OSFS_JOURNAL_COMMIT 2        // Commit record: the transaction is complete
+#define OSFS_DEFAULT_JOURNAL_BLOCKS 256
+#define OSFS_MIN_JOURNAL_BLOCKS 8
+#define OSFS_MAX_JOURNAL_BLOCKS 65536
+// Directory, index and extent blocks one metadata update dirties at most
+// (an extent insert that splits every level of the tree)
+#define OSFS_JOURNAL_OP_BLOCKS 32
+#define OSFS_DEFAULT_COMMIT_INTERVAL 5  // Seconds between a change and its commit; 0: only sync/fsync
+
+// osfs_group.dirty bits
+#define OSFS_GROUP_DATA_DIRTY 0      // dirty_data has bits set
+#define OSFS_GROUP_META_DIRTY 1      // dirty_meta or dirty_itable has bits set
+#define OSFS_GROUP_BITMAPS_DIRTY 2
+
+/**
+ * Struct: osfs_group
+ * Description: One block group: blocks_per_group data blocks and
+ * inodes_per_group inodes with their own bitmaps, inode table and lock.
+ * The inode table is allocated with the group's first inode, the page
+ * table with its first block and data pages with the first block that
+ * lives in them. All of it is charged to the mounter's memory cgroup.
+ */
+struct osfs_group {
+    spinlock_t lock;                // Bitmaps and free counts
+    uint32_t nr_blocks;             // Blocks in this group (the last one may be short)
+    uint32_t nr_inodes;
+    uint32_t nr_free_blocks;
+    uint32_t nr_free_inodes;
+    unsigned long *block_bitmap;
+    unsigned long *inode_bitmap;
+    struct osfs_inode *inode_table;
+    void **data_pages;              // One page holds blocks_per_page blocks, NULL until used
+    // Backing store only: what the next commit has to write
+    unsigned long dirty;            // OSFS_GROUP_*_DIRTY
+    unsigned long *dirty_data;      // File data blocks, written in place
+    unsigned long *dirty_meta;      // Directory, index and extent tree blocks, journaled
+    unsigned long *dirty_itable;    // Inode table blocks, journaled
+    unsigned long *pending_free;    // Freed since their bitmap was last staged, still taken
+};
+
+/**
+ * Struct: osfs_disk_super
+ * Description: Block 0 of the backing store.
+ */
+struct osfs_disk_super {
+    uint32_t s_magic;
+    uint32_t s_block_size;
+    uint32_t s_inode_count;
+    uint32_t s_block_count;
+    uint32_t s_inode_size;          // sizeof(struct osfs_inode) of the writer
+    uint32_t s_journal_blocks;
+    uint32_t s_journal_start;
+    uint32_t s_data_start;
+    uint64_t s_sequence;            // Next transaction; only a journal record with this id is replayed
+};
+
+/**
+ * Struct: osfs_journal_header
+ * Description: Starts the descriptor, followed by one uint32_t device
+ * block number per logged block (over as many blocks as that takes),
+ * then the logged blocks and the commit record.
+ */
+struct osfs_journal_header {
+    uint32_t h_magic;
+    uint32_t h_type;                // OSFS_JOURNAL_DESC or OSFS_JOURNAL_COMMIT
+    uint64_t h_sequence;
+    uint32_t h_count;               // Logged blocks
+    uint32_t h_checksum;            // Commit record: crc32 of the logged blocks
+};
+
+/**
+ * Struct: osfs_backing
+ * Description: State of a volume mounted with a backing store.
+ */
+struct osfs_backing {
+    struct osfs_sb_info *sb_info;
+    struct super_block *sb;         // Page cache writeback before a commit
+    struct file *file;
+    char *path;
+    struct osfs_disk_super ds;      // Copy of block 0
+    bool loaded;                    // ds came from the device
+    uint32_t block_size_bits;
+    uint32_t bitmap_start;          // Per group: the block bitmap, then ibitmap_blocks
+    uint32_t ibitmap_blocks;
+    uint32_t itable_start;          // Per group: itable_blocks blocks
+    uint32_t itable_blocks;
+    uint32_t max_trans;             // Blocks one transaction can log
+    uint32_t desc_blocks;           // Descriptor of a full transaction; logged blocks follow in jbuf
+    uint32_t meta_limit;            // Directory, index and extent blocks a commit has room for
+    atomic_t nr_dirty_meta;         // dirty_meta bits set
+    atomic_t meta_reserved;         // OSFS_JOURNAL_OP_BLOCKS per update in progress
+    struct rw_semaphore commit_lock;// Shared by metadata updates, exclusive while a commit copies them
+    struct mutex commit_mutex;      // One commit at a time
+    struct delayed_work commit_work;
+    unsigned long commit_interval;  // jiffies
+    void *jbuf;                     // Transaction being built: descriptor, logged blocks, commit record
+};
+
+/**
+ * Enum: osfs_stat
+ * Description: Per-mount counters, summed over CPUs in
+ * /sys/fs/osfs/<major>:<minor>/stats (stats.c).
+ */
+enum osfs_stat {
+    OSFS_STAT_LOOKUPS,
+    OSFS_STAT_LOOKUP_HITS,
+    OSFS_STAT_INODE_ALLOCS,
+    OSFS_STAT_BLOCK_ALLOCS,         // osfs_alloc_blocks calls that succeeded
+    OSFS_STAT_BLOCKS_ALLOCATED,
+    OSFS_STAT_BLOCKS_FREED,
+    OSFS_STAT_BITMAP_SCANNED,       // Bits looked at to find a free block or inode
+    OSFS_STAT_INDEX_WALKS,          // Indirect tables read by osfs_get_block
+    OSFS_STAT_EXTENT_MAPS,          // osfs_ext_map calls
+    OSFS_STAT_BYTES_READ,
+    OSFS_STAT_BYTES_WRITTEN,
+    OSFS_STAT_COMMITS,
+    OSFS_STAT_COMMIT_DATA_BLOCKS,
+    OSFS_STAT_COMMIT_JOURNAL_BLOCKS,
+    OSFS_STAT_NR,
+};
+
+struct osfs_stats {
+    u64 count[OSFS_STAT_NR];
+};
+
 /**
  * Struct: osfs_sb_info
  * Description: Superblock information for the osfs filesystem.
@@ -40,28 +186,77 @@
 struct osfs_sb_info {
     uint32_t magic;
     uint32_t block_size;
+    uint32_t block_size_bits;
     uint32_t inode_count;
     uint32_t block_count;
-    uint32_t nr_free_inodes;
-    uint32_t nr_free_blocks;
-    unsigned long *inode_bitmap;
-    unsigned long *block_bitmap;
-    void *inode_table;
-    void *data_blocks;
+    uint32_t blocks_per_group;      // Bits in one block, as in ext2
+    uint32_t inodes_per_group;
+    uint32_t blocks_per_page;
+    uint32_t group_count;
+    atomic_t nr_free_inodes;
+    atomic_t nr_free_blocks;
+    struct osfs_group *groups;
+    struct hlist_bl_head *dir_hash; // Name index of every directory (dir.c)
+    uint32_t dir_hash_bits;
+    uint32_t inode_goal;            // Next-fit start for inode allocation
+    uint32_t block_goal;            // Next-fit start when the caller has no goal
+    struct osfs_backing *bk;        // NULL when the volume lives only in memory
+    struct osfs_stats __percpu *stats;
+    struct kobject kobj;            // /sys/fs/osfs/<major>:<minor>
+    struct completion kobj_unregister;
 };
 
+static inline void osfs_stat_add(struct osfs_sb_info *sb_info, enum osfs_stat stat, u64 n)
+{
+    this_cpu_add(sb_info->stats->count[stat], n);
+}
+
 /**
  * Struct: osfs_dir_entry
- * Description: Directory entry structure.
+ * Description: Variable-length directory record. The records of a block
+ * chain through rec_len and cover the whole block; inode_no 0 marks
+ * unused space, and a record's rec_len beyond OSFS_DIR_REC_LEN(name_len)
+ * is free space a new entry can be split off.
  */
 struct osfs_dir_entry {
-    char filename[MAX_FILENAME_LEN];
     uint32_t inode_no;
+    uint16_t rec_len;       // Bytes to the next record
+    uint8_t name_len;
+    uint8_t file_type;      // DT_*
+    char name[];            // Not NUL-terminated
+};
+
+/**
+ * Struct: osfs_extent_header
+ * Description: Starts the inline extent root and every extent tree block.
+ */
+struct osfs_extent_header {
+    uint16_t eh_magic;
+    uint16_t eh_entries;    // Records in use
+    uint16_t eh_max;        // Records that fit
+    uint16_t eh_depth;      // 0: records are extents, else they point to nodes one level down
 };
 
+/**
+ * Struct: osfs_extent
+ * Description: A run of ee_len logical blocks from ee_block stored at
+ * ee_start..ee_start+ee_len-1. In an index (depth > 0) ee_start is the
+ * child node and ee_block the lowest logical block below it.
+ */
+struct osfs_extent {
+    uint32_t ee_block;
+    uint32_t ee_start;
+    uint32_t ee_len;
+};
+
+#define OSFS_INLINE_EXTENTS ((OSFS_N_BLOCKS * sizeof(uint32_t) - sizeof(struct osfs_extent_header)) / \
+                             sizeof(struct osfs_extent))
+#define OSFS_LEAF_EXTENTS(sbi) (((sbi)->block_size - sizeof(struct osfs_extent_header)) / sizeof(struct osfs_extent))
+
 /**
  * Struct: osfs_inode
- * Description: Filesystem-specific inode structure with multi-level indexing.
+ * Description: Filesystem-specific inode structure with multi-level indexing
+ * or, with OSFS_EXTENTS_FL, an extent tree rooted in the same space.
  */
 struct osfs_inode {
     uint32_t i_ino;
@@ -74,13 +269,82 @@ struct osfs_inode {
     struct timespec64 __i_atime;
     struct timespec64 __i_mtime;
     struct timespec64 __i_ctime;
+    uint32_t i_flags;                 // OSFS_EXTENTS_FL
+    uint32_t i_goal;                  // Allocation hint: block after the last one allocated
     
-    // Multi-level indexing structure
-    uint32_t i_block[OSFS_N_BLOCKS];  // [0-11]: direct blocks
-                                       // [12]: indirect block
-                                       // [13]: double indirect block
+    union {
+        // Multi-level indexing structure
+        uint32_t i_block[OSFS_N_BLOCKS];  // [0-11]: direct blocks
+                                           // [12]: indirect block
+                                           // [13]: double indirect block
+        // Extent root
+        struct {
+            struct osfs_extent_header i_eh;
+            struct osfs_extent i_extents[OSFS_INLINE_EXTENTS];
+        };
+    };
+};
+
+/**
+ * Struct: osfs_inode_info
+ * Description: In-memory part of an osfs inode. i_private of the VFS inode
+ * still points at the struct osfs_inode in the inode table.
+ */
+struct osfs_inode_info {
+    struct rw_semaphore map_lock;   // Block map (i_block[] or extents); read_folio and writeback share it
+    struct inode vfs_inode;
 };
 
+static inline struct osfs_inode_info *OSFS_I(struct inode *inode)
+{
+    return container_of(inode, struct osfs_inode_info, vfs_inode);
+}
+
+/**
+ * Function: osfs_block_addr
+ * Description: Address of data block block_no, NULL if its page has not
+ * been allocated. Blocks are contiguous in memory only within one page.
+ */
+static inline void *osfs_block_addr(struct osfs_sb_info *sb_info, uint32_t block_no)
+{
+    struct osfs_group *group = &sb_info->groups[block_no / sb_info->blocks_per_group];
+    uint32_t idx = block_no % sb_info->blocks_per_group;
+    void **pages = READ_ONCE(group->data_pages);
+    void *page;
+
+    if (!pages)
+        return NULL;
+    page = READ_ONCE(pages[idx / sb_info->blocks_per_page]);
+    if (!page)
+        return NULL;
+    return page + ((idx % sb_info->blocks_per_page) << sb_info->block_size_bits);
+}
+
+/**
+ * Function: osfs_meta_begin / osfs_meta_end
+ * Description: Bracket an update of metadata (bitmaps, inode table, block
+ * maps, directories) so that a commit never copies it half done. No-ops
+ * without a backing store. Taken inside map_lock, never nested. Each
+ * update reserves room in the next transaction first (osfs_journal_reserve).
+ */
+void osfs_journal_reserve(struct osfs_sb_info *sb_info);
+
+static inline void osfs_meta_begin(struct osfs_sb_info *sb_info)
+{
+    if (sb_info->bk) {
+        osfs_journal_reserve(sb_info);
+        down_read(&sb_info->bk->commit_lock);
+    }
+}
+
+static inline void osfs_meta_end(struct osfs_sb_info *sb_info)
+{
+    if (sb_info->bk) {
+        up_read(&sb_info->bk->commit_lock);
+        atomic_sub(OSFS_JOURNAL_OP_BLOCKS, &sb_info->bk->meta_reserved);
+    }
+}
+
 struct inode *osfs_iget(struct super_block *sb, unsigned long ino);
 struct osfs_inode *osfs_get_osfs_inode(struct super_block *sb, uint32_t ino);
 int osfs_get_free_inode(struct osfs_sb_info *sb_info);
@@ -88,14 +352,54 @@ int osfs_alloc_data_block(struct osfs_sb_info *sb_info, uint32_t *block_no);
 int osfs_fill_super(struct super_block *sb, void *data, int silent);
 struct inode *osfs_new_inode(const struct inode *dir, umode_t mode);
 void osfs_free_data_block(struct osfs_sb_info *sb_info, uint32_t block_no);
-void osfs_destroy_inode(struct inode *inode);
+int osfs_init_inodecache(void);
+void osfs_destroy_inodecache(void);
+void osfs_free_sb_info(struct osfs_sb_info *sb_info);
+int osfs_dir_index_init(struct osfs_sb_info *sb_info);
+void osfs_dir_index_destroy(struct osfs_sb_info *sb_info);
+int osfs_dir_index_load(struct super_block *sb);
 
 // New helper functions for multi-level indexing
 int osfs_get_block(struct inode *inode, sector_t block, uint32_t *phys_block, int create);
-void osfs_free_inode_blocks(struct inode *inode);
+void osfs_truncate_blocks(struct inode *inode, sector_t first);
+bool osfs_blocks_valid(struct osfs_sb_info *sb_info, uint32_t start, uint32_t count);
+int osfs_check_inode_blocks(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode);
+int osfs_map_blocks(struct inode *inode, sector_t block, uint32_t max_blocks,
+                    uint32_t *phys_block, uint32_t *count, int create);
+int osfs_alloc_blocks(struct osfs_sb_info *sb_info, uint32_t goal, uint32_t max_blocks,
+                      uint32_t *start, uint32_t *count);
+void osfs_free_blocks(struct osfs_sb_info *sb_info, uint32_t start, uint32_t count);
+void **osfs_group_page_table(struct osfs_sb_info *sb_info, struct osfs_group *group);
+int osfs_inode_alloc_blocks(struct inode *inode, uint32_t goal, uint32_t max_blocks,
+                            uint32_t *start, uint32_t *count);
+
+// Extent mapping (extent.c)
+void osfs_ext_init(struct osfs_inode *osfs_inode);
+int osfs_ext_map(struct inode *inode, sector_t block, uint32_t max_blocks,
+                 uint32_t *phys_block, uint32_t *count, int create);
+void osfs_ext_truncate(struct inode *inode, sector_t first);
+int osfs_ext_check(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode);
+
+// Backing store and journal (journal.c)
+int osfs_backing_open(const char *path, uint32_t journal_blocks, unsigned int commit_interval,
+                      struct osfs_backing **bkp);
+int osfs_backing_setup(struct osfs_sb_info *sb_info);
+void osfs_backing_close(struct osfs_backing *bk);
+int osfs_commit(struct osfs_sb_info *sb_info);
+void osfs_commit_async(struct osfs_sb_info *sb_info);
+void osfs_dirty_block(struct osfs_sb_info *sb_info, uint32_t block_no, uint32_t count, bool meta);
+void osfs_dirty_inode_table(struct osfs_sb_info *sb_info, uint32_t ino);
+void osfs_dirty_group(struct osfs_sb_info *sb_info, uint32_t group_no);
+
+// Statistics in sysfs (stats.c)
+int osfs_sysfs_init(void);
+void osfs_sysfs_exit(void);
+int osfs_sysfs_register(struct super_block *sb);
+void osfs_sysfs_unregister(struct osfs_sb_info *sb_info);
 
 extern const struct inode_operations osfs_file_inode_operations;
 extern const struct file_operations osfs_file_operations;
+extern const struct address_space_operations osfs_aops;
 extern const struct inode_operations osfs_dir_inode_operations;
 extern const struct file_operations osfs_dir_operations;
 extern const struct super_operations osfs_super_ops;
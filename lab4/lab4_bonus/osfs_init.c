@@ -53,9 +53,24 @@ static int __init osfs_init(void)
 {
     int ret;
 
+    ret = osfs_init_inodecache();
+    if (ret) {
+        pr_err("Failed to create inode cache\n");
+        return ret;
+    }
+
+    ret = osfs_sysfs_init();
+    if (ret) {
+        pr_err("Failed to create /sys/fs/osfs\n");
+        osfs_destroy_inodecache();
+        return ret;
+    }
+
     ret = register_filesystem(&osfs_type);
     if (ret) {
         pr_err("Failed to register filesystem\n");
+        osfs_sysfs_exit();
+        osfs_destroy_inodecache();
         return ret;
     }
 
@@ -80,6 +95,8 @@ static void __exit osfs_exit(void)
         pr_err("Failed to unregister filesystem\n");
     else
         pr_info("osfs: Successfully unregistered\n");
+    osfs_sysfs_exit();
+    osfs_destroy_inodecache();
 }
 
 /**
@@ -115,10 +132,19 @@ static void osfs_kill_superblock(struct super_block *sb)
 
     pr_info("osfs_kill_superblock: Unmounting file system\n");
 
+    // The directory is named after s_dev, which kill_anon_super hands back for reuse
+    if (sb_info)
+        osfs_sysfs_unregister(sb_info);
+
+    // Writes back and evicts every inode and dentry before the blocks go away
+    kill_anon_super(sb);
+
     if (sb_info) {
+        // Unmount synced the volume already; this catches what eviction dirtied
+        osfs_commit(sb_info);
         pr_info("osfs_kill_superblock: free blcok \n");
 
-        vfree(sb_info);
+        osfs_free_sb_info(sb_info);
         sb->s_fs_info = NULL;
     }
 
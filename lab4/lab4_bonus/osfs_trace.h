@@ -0,0 +1,133 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM osfs
+
+#if !defined(_OSFS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _OSFS_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+
+/*
+ * Tracepoints under /sys/kernel/tracing/events/osfs/. The events are
+ * created in stats.c (CREATE_TRACE_POINTS).
+ */
+
+DECLARE_EVENT_CLASS(osfs_dirent_class,
+    TP_PROTO(struct inode *dir, const char *name, unsigned int len, unsigned long ino),
+    TP_ARGS(dir, name, len, ino),
+    TP_STRUCT__entry(
+        __field(dev_t, dev)
+        __field(unsigned long, dir)
+        __field(unsigned long, ino)
+        __dynamic_array(char, name, len + 1)
+    ),
+    TP_fast_assign(
+        __entry->dev = dir->i_sb->s_dev;
+        __entry->dir = dir->i_ino;
+        __entry->ino = ino;
+        memcpy(__get_dynamic_array(name), name, len);
+        ((char *)__get_dynamic_array(name))[len] = '\0';
+    ),
+    TP_printk("dev %d:%d dir %lu name %s ino %lu",
+              MAJOR(__entry->dev), MINOR(__entry->dev), __entry->dir,
+              (char *)__get_dynamic_array(name), __entry->ino)
+);
+
+// ino 0: not found
+DEFINE_EVENT(osfs_dirent_class, osfs_lookup,
+    TP_PROTO(struct inode *dir, const char *name, unsigned int len, unsigned long ino),
+    TP_ARGS(dir, name, len, ino));
+
+DEFINE_EVENT(osfs_dirent_class, osfs_create,
+    TP_PROTO(struct inode *dir, const char *name, unsigned int len, unsigned long ino),
+    TP_ARGS(dir, name, len, ino));
+
+TRACE_EVENT(osfs_map_blocks,
+    TP_PROTO(struct inode *inode, sector_t block, uint32_t max_blocks, uint32_t phys_block,
+             uint32_t count, int create, int ret),
+    TP_ARGS(inode, block, max_blocks, phys_block, count, create, ret),
+    TP_STRUCT__entry(
+        __field(dev_t, dev)
+        __field(unsigned long, ino)
+        __field(sector_t, block)
+        __field(uint32_t, max_blocks)
+        __field(uint32_t, phys_block)
+        __field(uint32_t, count)
+        __field(int, create)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        __entry->dev = inode->i_sb->s_dev;
+        __entry->ino = inode->i_ino;
+        __entry->block = block;
+        __entry->max_blocks = max_blocks;
+        __entry->phys_block = phys_block;
+        __entry->count = count;
+        __entry->create = create;
+        __entry->ret = ret;
+    ),
+    TP_printk("dev %d:%d ino %lu block %llu max %u -> phys %u count %u create %d ret %d",
+              MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+              (unsigned long long)__entry->block, __entry->max_blocks,
+              __entry->phys_block, __entry->count, __entry->create, __entry->ret)
+);
+
+TRACE_EVENT(osfs_alloc_blocks,
+    TP_PROTO(uint32_t goal, uint32_t max_blocks, uint32_t start, uint32_t count),
+    TP_ARGS(goal, max_blocks, start, count),
+    TP_STRUCT__entry(
+        __field(uint32_t, goal)
+        __field(uint32_t, max_blocks)
+        __field(uint32_t, start)
+        __field(uint32_t, count)
+    ),
+    TP_fast_assign(
+        __entry->goal = goal;
+        __entry->max_blocks = max_blocks;
+        __entry->start = start;
+        __entry->count = count;
+    ),
+    TP_printk("goal %u max %u -> start %u count %u",
+              __entry->goal, __entry->max_blocks, __entry->start, __entry->count)
+);
+
+TRACE_EVENT(osfs_free_blocks,
+    TP_PROTO(uint32_t start, uint32_t count),
+    TP_ARGS(start, count),
+    TP_STRUCT__entry(
+        __field(uint32_t, start)
+        __field(uint32_t, count)
+    ),
+    TP_fast_assign(
+        __entry->start = start;
+        __entry->count = count;
+    ),
+    TP_printk("start %u count %u", __entry->start, __entry->count)
+);
+
+TRACE_EVENT(osfs_commit,
+    TP_PROTO(const char *path, uint32_t data_blocks, uint32_t journal_blocks, int ret),
+    TP_ARGS(path, data_blocks, journal_blocks, ret),
+    TP_STRUCT__entry(
+        __dynamic_array(char, path, strlen(path) + 1)
+        __field(uint32_t, data_blocks)
+        __field(uint32_t, journal_blocks)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        strcpy(__get_dynamic_array(path), path);
+        __entry->data_blocks = data_blocks;
+        __entry->journal_blocks = journal_blocks;
+        __entry->ret = ret;
+    ),
+    TP_printk("%s data %u journal %u ret %d", (char *)__get_dynamic_array(path),
+              __entry->data_blocks, __entry->journal_blocks, __entry->ret)
+);
+
+#endif /* _OSFS_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE osfs_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,120 @@
+#include <linux/fs.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/percpu.h>
+#include <linux/math64.h>
+#include "osfs.h"
+
+#define CREATE_TRACE_POINTS
+#include "osfs_trace.h"
+
+/*
+ * Every mount gets /sys/fs/osfs/<major>:<minor>/stats with the counters
+ * of enum osfs_stat, one "name value" per line. The counters are per CPU,
+ * so the hot paths only do a this_cpu_add; reading sums them up.
+ */
+
+static struct kset *osfs_kset;
+
+static const char * const osfs_stat_names[OSFS_STAT_NR] = {
+    [OSFS_STAT_LOOKUPS] = "lookups",
+    [OSFS_STAT_LOOKUP_HITS] = "lookup_hits",
+    [OSFS_STAT_INODE_ALLOCS] = "inode_allocs",
+    [OSFS_STAT_BLOCK_ALLOCS] = "block_allocs",
+    [OSFS_STAT_BLOCKS_ALLOCATED] = "blocks_allocated",
+    [OSFS_STAT_BLOCKS_FREED] = "blocks_freed",
+    [OSFS_STAT_BITMAP_SCANNED] = "bitmap_bits_scanned",
+    [OSFS_STAT_INDEX_WALKS] = "index_block_walks",
+    [OSFS_STAT_EXTENT_MAPS] = "extent_maps",
+    [OSFS_STAT_BYTES_READ] = "bytes_read",
+    [OSFS_STAT_BYTES_WRITTEN] = "bytes_written",
+    [OSFS_STAT_COMMITS] = "commits",
+    [OSFS_STAT_COMMIT_DATA_BLOCKS] = "commit_data_blocks",
+    [OSFS_STAT_COMMIT_JOURNAL_BLOCKS] = "commit_journal_blocks",
+};
+
+static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+    struct osfs_sb_info *sb_info = container_of(kobj, struct osfs_sb_info, kobj);
+    u64 sum[OSFS_STAT_NR] = {};
+    int cpu, i, len = 0;
+
+    for_each_possible_cpu(cpu) {
+        struct osfs_stats *stats = per_cpu_ptr(sb_info->stats, cpu);
+
+        for (i = 0; i < OSFS_STAT_NR; i++)
+            sum[i] += stats->count[i];
+    }
+    for (i = 0; i < OSFS_STAT_NR; i++)
+        len += sysfs_emit_at(buf, len, "%s %llu\n", osfs_stat_names[i], sum[i]);
+
+    len += sysfs_emit_at(buf, len, "lookup_hit_percent %llu\n",
+                         sum[OSFS_STAT_LOOKUPS] ?
+                         div64_u64(sum[OSFS_STAT_LOOKUP_HITS] * 100, sum[OSFS_STAT_LOOKUPS]) : 0);
+    len += sysfs_emit_at(buf, len, "free_blocks %d\n", atomic_read(&sb_info->nr_free_blocks));
+    len += sysfs_emit_at(buf, len, "free_inodes %d\n", atomic_read(&sb_info->nr_free_inodes));
+    return len;
+}
+
+static struct kobj_attribute osfs_attr_stats = __ATTR_RO(stats);
+
+static struct attribute *osfs_attrs[] = {
+    &osfs_attr_stats.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(osfs);
+
+static void osfs_sb_release(struct kobject *kobj)
+{
+    struct osfs_sb_info *sb_info = container_of(kobj, struct osfs_sb_info, kobj);
+
+    complete(&sb_info->kobj_unregister);
+}
+
+static const struct kobj_type osfs_sb_ktype = {
+    .default_groups = osfs_groups,
+    .sysfs_ops = &kobj_sysfs_ops,
+    .release = osfs_sb_release,
+};
+
+/**
+ * Function: osfs_sysfs_register
+ * Description: Adds /sys/fs/osfs/<major>:<minor> for a mount. Whatever the
+ * result, osfs_sysfs_unregister has to be called at unmount.
+ * Returns:
+ *   - 0, or a negative error code.
+ */
+int osfs_sysfs_register(struct super_block *sb)
+{
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
+
+    init_completion(&sb_info->kobj_unregister);
+    sb_info->kobj.kset = osfs_kset;
+    return kobject_init_and_add(&sb_info->kobj, &osfs_sb_ktype, NULL, "%u:%u",
+                                MAJOR(sb->s_dev), MINOR(sb->s_dev));
+}
+
+/**
+ * Function: osfs_sysfs_unregister
+ * Description: Removes the directory and waits until no reader is left.
+ */
+void osfs_sysfs_unregister(struct osfs_sb_info *sb_info)
+{
+    kobject_put(&sb_info->kobj);
+    wait_for_completion(&sb_info->kobj_unregister);
+}
+
+/**
+ * Function: osfs_sysfs_init
+ * Description: Creates /sys/fs/osfs (module load).
+ */
+int osfs_sysfs_init(void)
+{
+    osfs_kset = kset_create_and_add("osfs", NULL, fs_kobj);
+    return osfs_kset ? 0 : -ENOMEM;
+}
+
+void osfs_sysfs_exit(void)
+{
+    kset_unregister(osfs_kset);
+}
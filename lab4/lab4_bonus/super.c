@@ -1,91 +1,339 @@
 #include <linux/fs.h>
 #include <linux/pagemap.h>
 #include <linux/slab.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/writeback.h>
+#include <linux/backing-dev.h>
 #include "osfs.h"
 
+/**
+ * Struct: osfs_mount_opts
+ * Description: Volume geometry and backing store from the mount options.
+ */
+struct osfs_mount_opts {
+    unsigned int inodes;
+    unsigned int blocks;
+    unsigned int block_size;
+    char *backing;              // Backing store path, NULL for a memory-only volume
+    unsigned int commit;        // Seconds
+    unsigned int journal;       // Blocks
+};
+
+enum { Opt_inodes, Opt_blocks, Opt_block_size, Opt_backing, Opt_commit, Opt_journal, Opt_err };
+
+static const match_table_t osfs_tokens = {
+    { Opt_inodes, "inodes=%u" },
+    { Opt_blocks, "blocks=%u" },
+    { Opt_block_size, "block_size=%u" },
+    { Opt_backing, "backing=%s" },
+    { Opt_commit, "commit=%u" },
+    { Opt_journal, "journal=%u" },
+    { Opt_err, NULL },
+};
+
+/**
+ * Function: osfs_parse_options
+ * Description: Parses "inodes=N,blocks=N,block_size=N" and, for a volume
+ * kept in a file or block device, "backing=PATH,commit=SECONDS,journal=N";
+ * unset options keep the defaults in opts. A volume that already exists
+ * in the backing store keeps its own geometry.
+ * Returns:
+ *   - 0 on success, -EINVAL for an unknown or out-of-range option.
+ */
+static int osfs_parse_options(char *options, struct osfs_mount_opts *opts)
+{
+    substring_t args[MAX_OPT_ARGS];
+    char *p;
+    int value;
+
+    while (options && (p = strsep(&options, ",")) != NULL) {
+        if (!*p)
+            continue;
+        switch (match_token(p, osfs_tokens, args)) {
+        case Opt_inodes:
+            if (match_int(&args[0], &value) || value < ROOT_INODE + 1 || value > OSFS_MAX_INODES)
+                goto bad;
+            opts->inodes = value;
+            break;
+        case Opt_blocks:
+            if (match_int(&args[0], &value) || value < 1 || value > OSFS_MAX_BLOCKS)
+                goto bad;
+            opts->blocks = value;
+            break;
+        case Opt_block_size:
+            if (match_int(&args[0], &value) || value < OSFS_MIN_BLOCK_SIZE ||
+                value > min_t(unsigned long, PAGE_SIZE, OSFS_MAX_BLOCK_SIZE) || !is_power_of_2(value))
+                goto bad;
+            opts->block_size = value;
+            break;
+        case Opt_backing:
+            kfree(opts->backing);
+            opts->backing = match_strdup(&args[0]);
+            if (!opts->backing)
+                return -ENOMEM;
+            break;
+        case Opt_commit:
+            if (match_int(&args[0], &value) || value < 0)
+                goto bad;
+            opts->commit = value;
+            break;
+        case Opt_journal:
+            if (match_int(&args[0], &value) || value < OSFS_MIN_JOURNAL_BLOCKS || value > OSFS_MAX_JOURNAL_BLOCKS)
+                goto bad;
+            opts->journal = value;
+            break;
+        default:
+            goto bad;
+        }
+    }
+    return 0;
+
+bad:
+    pr_err("osfs: Bad mount option '%s'\n", p);
+    return -EINVAL;
+}
+
+/**
+ * Function: osfs_statfs
+ * Description: Reports the volume size and free counts of this mount.
+ */
+static int osfs_statfs(struct dentry *dentry, struct kstatfs *buf)
+{
+    struct osfs_sb_info *sb_info = dentry->d_sb->s_fs_info;
+
+    buf->f_type = OSFS_MAGIC;
+    buf->f_bsize = sb_info->block_size;
+    buf->f_blocks = sb_info->block_count;
+    buf->f_bfree = buf->f_bavail = atomic_read(&sb_info->nr_free_blocks);
+    buf->f_files = sb_info->inode_count;
+    buf->f_ffree = atomic_read(&sb_info->nr_free_inodes);
+    buf->f_namelen = MAX_FILENAME_LEN;
+    return 0;
+}
+
+/**
+ * Function: osfs_show_options
+ * Description: Shows the volume geometry and backing store in /proc/mounts.
+ */
+static int osfs_show_options(struct seq_file *m, struct dentry *root)
+{
+    struct osfs_sb_info *sb_info = root->d_sb->s_fs_info;
+    struct osfs_backing *bk = sb_info->bk;
+
+    seq_printf(m, ",inodes=%u,blocks=%u,block_size=%u",
+               sb_info->inode_count, sb_info->block_count, sb_info->block_size);
+    if (bk) {
+        seq_show_option(m, "backing", bk->path);
+        seq_printf(m, ",commit=%lu,journal=%u", bk->commit_interval / HZ, bk->ds.s_journal_blocks);
+    }
+    return 0;
+}
+
+static struct kmem_cache *osfs_inode_cachep;
+
+/**
+ * Function: osfs_alloc_inode
+ * Description: Allocates a VFS inode together with its osfs_inode_info.
+ */
+static struct inode *osfs_alloc_inode(struct super_block *sb)
+{
+    struct osfs_inode_info *oi = alloc_inode_sb(sb, osfs_inode_cachep, GFP_KERNEL);
+
+    return oi ? &oi->vfs_inode : NULL;
+}
+
+static void osfs_free_inode(struct inode *inode)
+{
+    kmem_cache_free(osfs_inode_cachep, OSFS_I(inode));
+}
+
+static void osfs_inode_init_once(void *obj)
+{
+    struct osfs_inode_info *oi = obj;
+
+    init_rwsem(&oi->map_lock);
+    inode_init_once(&oi->vfs_inode);
+}
+
+/**
+ * Function: osfs_init_inodecache
+ * Description: Creates the slab cache for osfs inodes (module load).
+ */
+int osfs_init_inodecache(void)
+{
+    osfs_inode_cachep = kmem_cache_create("osfs_inode_cache", sizeof(struct osfs_inode_info), 0,
+                                          SLAB_RECLAIM_ACCOUNT | SLAB_ACCOUNT,
+                                          osfs_inode_init_once);
+    return osfs_inode_cachep ? 0 : -ENOMEM;
+}
+
+/**
+ * Function: osfs_destroy_inodecache
+ * Description: Destroys the inode cache once every RCU-freed inode is gone.
+ */
+void osfs_destroy_inodecache(void)
+{
+    rcu_barrier();
+    kmem_cache_destroy(osfs_inode_cachep);
+}
+
+/**
+ * Function: osfs_write_inode
+ * Description: Copies the VFS inode's attributes back to the inode table.
+ * Data reach their blocks through the page cache writeback in file.c.
+ */
+static int osfs_write_inode(struct inode *inode, struct writeback_control *wbc)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    if (!osfs_inode)
+        return 0;
+    osfs_inode->i_mode = inode->i_mode;
+    osfs_inode->i_uid = i_uid_read(inode);
+    osfs_inode->i_gid = i_gid_read(inode);
+    osfs_inode->i_links_count = inode->i_nlink;
+    osfs_inode->i_size = i_size_read(inode);
+    osfs_inode->__i_atime = inode_get_atime(inode);
+    osfs_inode->__i_mtime = inode_get_mtime(inode);
+    osfs_inode->__i_ctime = inode_get_ctime(inode);
+    osfs_dirty_inode_table(inode->i_sb->s_fs_info, inode->i_ino);
+    return 0;
+}
+
+/**
+ * Function: osfs_dirty_inode
+ * Description: With a backing store the inode table is what a commit
+ * writes, so it is updated on every mark_inode_dirty rather than at
+ * writeback. Runs without commit_lock (callers may hold it already); a
+ * commit racing with it can at worst log half-updated timestamps.
+ */
+static void osfs_dirty_inode(struct inode *inode, int flags)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+
+    if (sb_info->bk)
+        osfs_write_inode(inode, NULL);
+}
+
+/**
+ * Function: osfs_sync_fs
+ * Description: Commits the volume to its backing store (sync, syncfs,
+ * unmount); without wait the commit only starts.
+ */
+static int osfs_sync_fs(struct super_block *sb, int wait)
+{
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
+
+    if (!wait) {
+        osfs_commit_async(sb_info);
+        return 0;
+    }
+    return osfs_commit(sb_info);
+}
+
 /**
  * Struct: osfs_super_ops
  * Description: Defines the superblock operations for the osfs filesystem.
+ * Unused inodes stay cached (generic_drop_inode) so their dirty page
+ * cache is written back before eviction.
  */
 const struct super_operations osfs_super_ops = {
-    .statfs = simple_statfs,            // Provides filesystem statistics
-    .drop_inode = generic_delete_inode, // Generic inode deletion
-    .destroy_inode = osfs_destroy_inode,
-
+    .statfs = osfs_statfs,              // Provides filesystem statistics
+    .alloc_inode = osfs_alloc_inode,
+    .free_inode = osfs_free_inode,
+    .write_inode = osfs_write_inode,
+    .dirty_inode = osfs_dirty_inode,
+    .sync_fs = osfs_sync_fs,
+    .show_options = osfs_show_options,
 };
 
-void osfs_destroy_inode(struct inode *inode)
+/**
+ * Function: osfs_free_sb_info
+ * Description: Releases the groups, their bitmaps, inode tables and data
+ * pages, and the superblock information itself.
+ */
+void osfs_free_sb_info(struct osfs_sb_info *sb_info)
 {
-    if (inode->i_private) {
-        inode->i_private = NULL;
+    uint32_t g, p;
+
+    if (sb_info->bk)
+        osfs_backing_close(sb_info->bk);
+    for (g = 0; sb_info->groups && g < sb_info->group_count; g++) {
+        struct osfs_group *group = &sb_info->groups[g];
+        uint32_t pages = DIV_ROUND_UP(group->nr_blocks, sb_info->blocks_per_page);
+
+        for (p = 0; group->data_pages && p < pages; p++)
+            if (group->data_pages[p])
+                free_page((unsigned long)group->data_pages[p]);
+        kvfree(group->data_pages);
+        kvfree(group->inode_table);
+        kvfree(group->block_bitmap);
+        kvfree(group->inode_bitmap);
+        kvfree(group->dirty_data);
+        kvfree(group->dirty_meta);
+        kvfree(group->dirty_itable);
+        kvfree(group->pending_free);
     }
+    kvfree(sb_info->groups);
+    osfs_dir_index_destroy(sb_info);
+    free_percpu(sb_info->stats);
+    kfree(sb_info);
 }
 
-
 /**
- * Function: osfs_fill_super
- * Description: Initializes the superblock with filesystem-specific information during mount.
- * Inputs:
- *   - sb: The superblock to be filled.
- *   - data: Data passed during mount.
- *   - silent: If non-zero, suppress certain error messages.
- * Returns:
- *   - 0 on successful initialization.
- *   - A negative error code on failure.
+ * Function: osfs_alloc_groups
+ * Description: Splits the volume into block groups. Only the bitmaps of
+ * each group are allocated here; inode tables, page tables and data pages
+ * follow on first use.
  */
-int osfs_fill_super(struct super_block *sb, void *data, int silent)
+static int osfs_alloc_groups(struct osfs_sb_info *sb_info)
 {
-    pr_info("osfs: Filling super start\n");
-    struct inode *root_inode;
-    struct osfs_sb_info *sb_info;
-    void *memory_region;
-    size_t total_memory_size;
-
-    // Calculate total memory size required
-    total_memory_size = sizeof(struct osfs_sb_info) +
-                        INODE_BITMAP_SIZE * sizeof(unsigned long) +
-                        BLOCK_BITMAP_SIZE * sizeof(unsigned long) +
-                        INODE_COUNT * sizeof(struct osfs_inode) +
-                        DATA_BLOCK_COUNT * BLOCK_SIZE;
-
-    // Allocate memory for superblock information and related structures
-    memory_region = vmalloc(total_memory_size);
-    if (!memory_region)
+    uint32_t g;
+
+    sb_info->groups = kvcalloc(sb_info->group_count, sizeof(struct osfs_group), GFP_KERNEL_ACCOUNT);
+    if (!sb_info->groups)
         return -ENOMEM;
 
-    memset(memory_region, 0, total_memory_size);
+    for (g = 0; g < sb_info->group_count; g++) {
+        struct osfs_group *group = &sb_info->groups[g];
+        uint32_t first_inode = g * sb_info->inodes_per_group;
 
-    // Initialize superblock information
-    sb_info = (struct osfs_sb_info *)memory_region;
-    sb_info->magic = OSFS_MAGIC;
-    sb_info->block_size = BLOCK_SIZE;
-    sb_info->inode_count = INODE_COUNT;
-    sb_info->block_count = DATA_BLOCK_COUNT;
-    sb_info->nr_free_inodes = INODE_COUNT - 1;
-    sb_info->nr_free_blocks = DATA_BLOCK_COUNT;
-
-    // Partition the memory region into respective components
-    sb_info->inode_bitmap = (unsigned long *)(sb_info + 1);
-    sb_info->block_bitmap = sb_info->inode_bitmap + INODE_BITMAP_SIZE;
-    sb_info->inode_table = (void *)(sb_info->block_bitmap + BLOCK_BITMAP_SIZE);
-    sb_info->data_blocks = (void *)((char *)sb_info->inode_table +
-                                    INODE_COUNT * sizeof(struct osfs_inode));
-
-    // Initialize bitmaps
-    memset(sb_info->inode_bitmap, 0, INODE_BITMAP_SIZE * sizeof(unsigned long));
-    memset(sb_info->block_bitmap, 0, BLOCK_BITMAP_SIZE * sizeof(unsigned long));
+        spin_lock_init(&group->lock);
+        group->nr_blocks = min(sb_info->blocks_per_group,
+                               sb_info->block_count - g * sb_info->blocks_per_group);
+        group->nr_inodes = first_inode < sb_info->inode_count ?
+                           min(sb_info->inodes_per_group, sb_info->inode_count - first_inode) : 0;
+        group->nr_free_blocks = group->nr_blocks;
+        group->nr_free_inodes = group->nr_inodes;
 
-    // Set superblock fields
-    sb->s_magic = sb_info->magic;
-    sb->s_fs_info = sb_info;
-    sb->s_op = &osfs_super_ops;
+        group->block_bitmap = kvcalloc(BITS_TO_LONGS(group->nr_blocks), sizeof(unsigned long),
+                                       GFP_KERNEL_ACCOUNT);
+        group->inode_bitmap = kvcalloc(BITS_TO_LONGS(group->nr_inodes) ?: 1, sizeof(unsigned long),
+                                       GFP_KERNEL_ACCOUNT);
+        if (!group->block_bitmap || !group->inode_bitmap)
+            return -ENOMEM;
+    }
+    return 0;
+}
+
+
+/**
+ * Function: osfs_make_root
+ * Description: Creates the root directory of a new volume.
+ * Returns:
+ *   - The root inode, or an ERR_PTR.
+ */
+static struct inode *osfs_make_root(struct super_block *sb)
+{
+    struct osfs_inode *root_osfs_inode;
+    struct inode *root_inode;
 
-    // Create root directory inode
     root_inode = new_inode(sb);
-    if (!root_inode) {
-        vfree(memory_region);
-        return -ENOMEM;
-    }
+    if (!root_inode)
+        return ERR_PTR(-ENOMEM);
 
     root_inode->i_ino = ROOT_INODE;
     root_inode->i_sb = sb;
@@ -96,11 +344,10 @@ int osfs_fill_super(struct super_block *sb, void *data, int silent)
     simple_inode_init_ts(root_inode);
     
     // Initialize root directory's osfs_inode
-    struct osfs_inode *root_osfs_inode = osfs_get_osfs_inode(sb, ROOT_INODE);
+    root_osfs_inode = osfs_get_osfs_inode(sb, ROOT_INODE);
     if (!root_osfs_inode) {
         iput(root_inode);
-        vfree(memory_region);
-        return -EIO;
+        return ERR_PTR(-EIO);
     }
     memset(root_osfs_inode, 0, sizeof(*root_osfs_inode));
 
@@ -109,24 +356,191 @@ int osfs_fill_super(struct super_block *sb, void *data, int silent)
     root_osfs_inode->i_links_count = 2;
     root_osfs_inode->__i_atime = root_osfs_inode->__i_mtime = root_osfs_inode->__i_ctime = current_time(root_inode);
     root_inode->i_private = root_osfs_inode;
+    insert_inode_hash(root_inode);
 
+    // Directory blocks are added through osfs_get_block on the first create
     root_osfs_inode->i_blocks = 0;
     root_osfs_inode->i_size = 0;
     memset(root_osfs_inode->i_block, 0, sizeof(root_osfs_inode->i_block));
 
-    // Mark root directory inode as used
-    set_bit(ROOT_INODE, sb_info->inode_bitmap);
-
     // Update root directory size
     root_inode->i_size = 0;
     inode_init_owner(&nop_mnt_idmap, root_inode, NULL, root_inode->i_mode);
+    // Owner and all into the inode table (and the first commit)
+    mark_inode_dirty(root_inode);
+    return root_inode;
+}
+
+/**
+ * Function: osfs_fill_super
+ * Description: Initializes the superblock with filesystem-specific information during mount.
+ * With a backing store that already holds a volume, the geometry, inodes
+ * and blocks come from there and the root is read back instead of created.
+ * Inputs:
+ *   - sb: The superblock to be filled.
+ *   - data: Mount options, "inodes=N,blocks=N,block_size=N,backing=PATH,commit=N,journal=N".
+ *   - silent: If non-zero, suppress certain error messages.
+ * Returns:
+ *   - 0 on successful initialization.
+ *   - A negative error code on failure.
+ */
+int osfs_fill_super(struct super_block *sb, void *data, int silent)
+{
+    pr_info("osfs: Filling super start\n");
+    struct osfs_mount_opts opts = {
+        .inodes = INODE_COUNT,
+        .blocks = DATA_BLOCK_COUNT,
+        .block_size = BLOCK_SIZE,
+        .commit = OSFS_DEFAULT_COMMIT_INTERVAL,
+        .journal = OSFS_DEFAULT_JOURNAL_BLOCKS,
+    };
+    struct inode *root_inode;
+    struct osfs_sb_info *sb_info;
+    struct osfs_group *group0;
+    bool loaded = false;
+    int ret;
+
+    ret = osfs_parse_options(data, &opts);
+    if (ret) {
+        kfree(opts.backing);
+        return ret;
+    }
+    // The group bitmaps are allocated at mount, for every block and inode of the volume
+    if ((opts.inodes > OSFS_MAX_USER_INODES || opts.blocks > OSFS_MAX_USER_BLOCKS) &&
+        !capable(CAP_SYS_ADMIN)) {
+        pr_err("osfs_fill_super: More than %u inodes or %u blocks needs CAP_SYS_ADMIN\n",
+               OSFS_MAX_USER_INODES, OSFS_MAX_USER_BLOCKS);
+        kfree(opts.backing);
+        return -EPERM;
+    }
+
+    sb_info = kzalloc(sizeof(*sb_info), GFP_KERNEL);
+    if (!sb_info) {
+        kfree(opts.backing);
+        return -ENOMEM;
+    }
+    sb_info->stats = alloc_percpu(struct osfs_stats);
+    if (!sb_info->stats) {
+        kfree(opts.backing);
+        ret = -ENOMEM;
+        goto out_free;
+    }
+
+    if (opts.backing) {
+        // A user namespace may mount a memory-only osfs; a volume read back from a
+        // file or device is parsed by the kernel, so that takes the real administrator
+        if (!capable(CAP_SYS_ADMIN)) {
+            pr_err("osfs_fill_super: backing= needs CAP_SYS_ADMIN in the initial namespace\n");
+            kfree(opts.backing);
+            ret = -EPERM;
+            goto out_free;
+        }
+        ret = osfs_backing_open(opts.backing, opts.journal, opts.commit, &sb_info->bk);
+        kfree(opts.backing);
+        if (ret)
+            goto out_free;
+        sb_info->bk->sb = sb;
+        loaded = sb_info->bk->loaded;
+        if (loaded) {
+            opts.inodes = sb_info->bk->ds.s_inode_count;
+            opts.blocks = sb_info->bk->ds.s_block_count;
+            opts.block_size = sb_info->bk->ds.s_block_size;
+        }
+    }
+
+    // Initialize superblock information
+    sb_info->magic = OSFS_MAGIC;
+    sb_info->block_size = opts.block_size;
+    sb_info->block_size_bits = ilog2(opts.block_size);
+    sb_info->inode_count = opts.inodes;
+    sb_info->block_count = opts.blocks;
+    sb_info->blocks_per_group = opts.block_size * 8;
+    sb_info->blocks_per_page = PAGE_SIZE / opts.block_size;
+    sb_info->group_count = DIV_ROUND_UP(opts.blocks, sb_info->blocks_per_group);
+    // Group 0 has to fit inode 0 and the root, even with more groups than inodes
+    sb_info->inodes_per_group = max_t(uint32_t, DIV_ROUND_UP(opts.inodes, sb_info->group_count),
+                                      ROOT_INODE + 1);
+    // Inode 0 is never used and the root inode is taken below
+    atomic_set(&sb_info->nr_free_inodes, opts.inodes - ROOT_INODE - 1);
+    atomic_set(&sb_info->nr_free_blocks, opts.blocks - 1);
+    sb_info->inode_goal = ROOT_INODE + 1;
+    sb_info->block_goal = 1;
+
+    ret = osfs_alloc_groups(sb_info);
+    if (ret)
+        goto out_free;
+
+    ret = osfs_dir_index_init(sb_info);
+    if (ret)
+        goto out_free;
+
+    // Lays out a new backing store, or reads the bitmaps, inodes and blocks of an existing one
+    if (sb_info->bk) {
+        ret = osfs_backing_setup(sb_info);
+        if (ret)
+            goto out_free;
+    }
+
+    if (!loaded) {
+        // Group 0 holds inode 0 and block 0, which are never used, and the root inode
+        group0 = &sb_info->groups[0];
+        group0->inode_table = kvcalloc(group0->nr_inodes, sizeof(struct osfs_inode), GFP_KERNEL_ACCOUNT);
+        if (!group0->inode_table) {
+            ret = -ENOMEM;
+            goto out_free;
+        }
+        __set_bit(0, group0->inode_bitmap);
+        __set_bit(ROOT_INODE, group0->inode_bitmap);
+        group0->nr_free_inodes -= ROOT_INODE + 1;
+        __set_bit(0, group0->block_bitmap);
+        group0->nr_free_blocks--;
+    }
+
+    // mount_nodev leaves the noop bdi, which never writes the page cache back
+    ret = super_setup_bdi(sb);
+    if (ret)
+        goto out_free;
+
+    // Set superblock fields
+    sb->s_magic = sb_info->magic;
+    sb->s_fs_info = sb_info;
+    sb->s_op = &osfs_super_ops;
+    sb->s_blocksize = sb_info->block_size;
+    sb->s_blocksize_bits = sb_info->block_size_bits;
+    // osfs_inode.i_size is 32 bits; the block maps could address far more
+    sb->s_maxbytes = U32_MAX;
+
+    // Create root directory inode, or read it back
+    root_inode = loaded ? osfs_iget(sb, ROOT_INODE) : osfs_make_root(sb);
+    if (IS_ERR(root_inode)) {
+        ret = PTR_ERR(root_inode);
+        goto out_free;
+    }
+
     // Set the root directory
     sb->s_root = d_make_root(root_inode);
     if (!sb->s_root) {
-        iput(root_inode);
-        vfree(memory_region);
-        return -ENOMEM;
+        ret = -ENOMEM;
+        goto out_free;
     }
-    pr_info("osfs: Superblock filled successfully \n");
+
+    // From here on kill_sb releases sb_info
+    ret = osfs_sysfs_register(sb);
+    if (ret)
+        return ret;
+    if (loaded)
+        ret = osfs_dir_index_load(sb);
+    else
+        ret = osfs_commit(sb_info);
+    if (ret)
+        return ret;
+
+    pr_info("osfs: Superblock filled successfully (%u inodes, %u blocks of %u bytes, %u groups)\n",
+            sb_info->inode_count, sb_info->block_count, sb_info->block_size, sb_info->group_count);
     return 0;
+
+out_free:
+    sb->s_fs_info = NULL;
+    osfs_free_sb_info(sb_info);
+    return ret;
 }